@@ -0,0 +1,37 @@
+#include "accel_conv.h"
+
+static inline int16_t saturate16(int32_t v)
+{
+    return (int16_t)CLAMP(v, INT16_MIN, INT16_MAX);
+}
+
+int16_t accel_counts_to_mg(int16_t counts, int32_t scale_q8)
+{
+    /* Round to nearest, the shift alone would floor negative values */
+    return saturate16((counts * scale_q8 + 128) >> 8);
+}
+
+int16_t accel_counts_to_q15(int16_t counts, uint8_t resolution_bits)
+{
+    /* A signed reading of resolution_bits spans [-1, 1) of full scale */
+    return (int16_t)(counts * (1 << (16 - resolution_bits)));
+}
+
+int16_t accel_sensor_value_to_mg(const struct sensor_value *val)
+{
+    /* Readings stay well inside +-2147 m/s^2, so micro units fit 32 bits
+     * and the scaling is a single 32x32->64 multiply. */
+    int32_t micro = val->val1 * 1000000 + val->val2;
+
+    return saturate16((int32_t)(((int64_t)micro * ACCEL_CONV_UMS2_TO_MG_Q32 + (1LL << 31)) >> 32));
+}
+
+void accel_convert_mg(const struct adxl345_data *in, struct adxl345_data *out,
+                      size_t count, int32_t scale_q8)
+{
+    for (size_t i = 0; i < count; i++) {
+        out[i].x = accel_counts_to_mg(in[i].x, scale_q8);
+        out[i].y = accel_counts_to_mg(in[i].y, scale_q8);
+        out[i].z = accel_counts_to_mg(in[i].z, scale_q8);
+    }
+}
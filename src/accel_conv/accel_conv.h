@@ -0,0 +1,27 @@
+#ifndef __accel_conv_h__
+#define __accel_conv_h__
+
+/* Integer conversions for accelerometer readings. No floating point, so
+ * nothing here pulls in the soft double routines. */
+
+#include <zephyr.h>
+#include <drivers/sensor.h>
+#include "adxl345.h"
+
+/** @brief ADXL345 scale in mg/LSB, Q8. range_shift is the DATA_FORMAT
+ * range in 10-bit mode and 0 in full resolution mode. **/
+#define ACCEL_CONV_SCALE_Q8(range_shift)    (1000 << (range_shift))
+
+/* 2^32 * 1000 / SENSOR_G rounded, turns micro-m/s^2 into mg with one
+ * multiply */
+#define ACCEL_CONV_UMS2_TO_MG_Q32           (((1000LL << 32) + SENSOR_G / 2) / SENSOR_G)
+
+/* Rounded to nearest, halves towards +inf, and saturated to int16_t */
+int16_t accel_counts_to_mg(int16_t counts, int32_t scale_q8);
+int16_t accel_counts_to_q15(int16_t counts, uint8_t resolution_bits);
+int16_t accel_sensor_value_to_mg(const struct sensor_value *val);
+
+void accel_convert_mg(const struct adxl345_data *in, struct adxl345_data *out,
+                      size_t count, int32_t scale_q8);
+
+#endif
@@ -0,0 +1,154 @@
+#include "accel_events.h"
+#include "accel_conv.h"
+#include "sample_clock.h"
+
+#include <sys/byteorder.h>
+
+static K_MSGQ_DEFINE(event_msgq, sizeof(struct accel_event), ACCEL_EVENTS_QUEUE_LEN, 4);
+
+static void deliver_events(struct k_work *work);
+
+static K_WORK_DEFINE(event_work, deliver_events);
+
+static accel_events_handler_t event_handler;
+static struct accel_events_stats stats;
+
+/* Producer state, only touched by the acquisition thread */
+static uint16_t event_seq;
+static uint8_t orientation;
+static uint8_t candidate;
+static uint8_t candidate_count;
+
+static void deliver_events(struct k_work *work)
+{
+    struct accel_event event;
+
+    ARG_UNUSED(work);
+
+    while (k_msgq_get(&event_msgq, &event, K_NO_WAIT) == 0) {
+        event_handler(&event);
+    }
+}
+
+static void queue_event(enum accel_event_type type, uint8_t detail, uint32_t timestamp)
+{
+    struct accel_event event = {
+        .seq = sys_cpu_to_le16(event_seq),
+        .timestamp = sys_cpu_to_le32((uint32_t)sample_clock_to_us(timestamp)),
+        .type = type,
+        .detail = detail,
+    };
+
+    if (!event_handler) {
+        return;
+    }
+    if (k_msgq_put(&event_msgq, &event, K_NO_WAIT) != 0) {
+        stats.dropped++;
+        return;
+    }
+
+    event_seq++;
+    stats.events++;
+    k_work_submit(&event_work);
+}
+
+int accel_events_init(accel_events_handler_t handler)
+{
+    if (handler == NULL) {
+        return -EINVAL;
+    }
+    event_handler = handler;
+    return 0;
+}
+
+void accel_events_service(uint8_t act_tap_status, uint8_t source, uint32_t timestamp)
+{
+    const uint8_t tap_axes = act_tap_status & (ACT_TAP_STATUS_TAP_X | ACT_TAP_STATUS_TAP_Y |
+                                               ACT_TAP_STATUS_TAP_Z);
+    const uint8_t act_axes = (act_tap_status & (ACT_TAP_STATUS_ACT_X | ACT_TAP_STATUS_ACT_Y |
+                                                ACT_TAP_STATUS_ACT_Z)) >> 4;
+
+    if (source & INT_FREE_FALL) {
+        queue_event(ACCEL_EVENT_FREE_FALL, 0, timestamp);
+    }
+    /* A double tap also sets the single tap bit for its first tap */
+    if (source & INT_DOUBLE_TAP) {
+        queue_event(ACCEL_EVENT_DOUBLE_TAP, tap_axes, timestamp);
+    } else if (source & INT_SINGLE_TAP) {
+        queue_event(ACCEL_EVENT_SINGLE_TAP, tap_axes, timestamp);
+    }
+    if (source & INT_ACTIVITY) {
+        queue_event(ACCEL_EVENT_ACTIVITY, act_axes, timestamp);
+    }
+    if (source & INT_INACTIVITY) {
+        queue_event(ACCEL_EVENT_INACTIVITY, 0, timestamp);
+    }
+}
+
+static inline int32_t magnitude(int16_t v)
+{
+    return v < 0 ? -(int32_t)v : v;
+}
+
+static uint8_t classify(const struct adxl345_data *sample, int32_t scale_q8)
+{
+    const int16_t mg[3] = {
+        accel_counts_to_mg(sample->x, scale_q8),
+        accel_counts_to_mg(sample->y, scale_q8),
+        accel_counts_to_mg(sample->z, scale_q8),
+    };
+    static const uint8_t up[3][2] = {
+        { Aup, Bup },
+        { Cup, Dup },
+        { Topup, Botup },
+    };
+    size_t axis = 0;
+
+    for (size_t i = 1; i < ARRAY_SIZE(mg); i++) {
+        if (magnitude(mg[i]) > magnitude(mg[axis])) {
+            axis = i;
+        }
+    }
+
+    /* Tilted halfway between two faces or moving: no clear answer */
+    if (magnitude(mg[axis]) < ACCEL_EVENTS_ORIENT_MG) {
+        return 0;
+    }
+    return up[axis][mg[axis] < 0];
+}
+
+void accel_events_update_orientation(const struct adxl345_data *sample, int32_t scale_q8,
+                                     uint32_t timestamp)
+{
+    uint8_t now = classify(sample, scale_q8);
+
+    if (now == 0 || now == orientation) {
+        candidate_count = 0;
+        return;
+    }
+
+    if (now != candidate) {
+        candidate = now;
+        candidate_count = 0;
+    }
+    if (++candidate_count < ACCEL_EVENTS_ORIENT_DEBOUNCE) {
+        return;
+    }
+
+    orientation = now;
+    candidate_count = 0;
+    queue_event(ACCEL_EVENT_ORIENTATION, orientation, timestamp);
+}
+
+uint8_t accel_events_orientation(void)
+{
+    return orientation;
+}
+
+void accel_events_get_stats(struct accel_events_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
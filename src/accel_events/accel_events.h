@@ -0,0 +1,62 @@
+#ifndef __accel_events_h__
+#define __accel_events_h__
+
+#include <zephyr.h>
+#include "adxl345.h"
+
+/* Event engine on top of the ADXL345 tap, activity, inactivity and
+ * free-fall detectors.
+ *
+ * The acquisition thread passes in the status registers on every INT1
+ * wakeup and the last sample of every batch for orientation tracking.
+ * Events are queued without blocking and handed to the handler from the
+ * system work queue, so the link only carries something when one happens. */
+
+#define ACCEL_EVENTS_QUEUE_LEN          8
+
+/** @brief Gravity on the dominant axis needed to call an orientation, mg. **/
+#define ACCEL_EVENTS_ORIENT_MG          800
+/** @brief Consecutive batches a new orientation has to hold. **/
+#define ACCEL_EVENTS_ORIENT_DEBOUNCE    3
+
+enum accel_event_type {
+    ACCEL_EVENT_SINGLE_TAP = 1,
+    ACCEL_EVENT_DOUBLE_TAP,
+    ACCEL_EVENT_ACTIVITY,
+    ACCEL_EVENT_INACTIVITY,
+    ACCEL_EVENT_FREE_FALL,
+    ACCEL_EVENT_ORIENTATION,
+};
+
+/** @brief Event notification. All fields are little-endian. seq
+ * increments once per event, timestamp is in microseconds. detail holds
+ * the ACT_TAP_STATUS_TAP_* bits for taps, the ACT_TAP_STATUS_ACT_* bits
+ * shifted down by 4 for activity, the enum adxl345_orientation for
+ * orientation changes and 0 otherwise. **/
+struct accel_event {
+    uint16_t seq;
+    uint32_t timestamp;
+    uint8_t type;
+    uint8_t detail;
+} __packed;
+
+/** @brief Called from the system work queue for each event. **/
+typedef void (*accel_events_handler_t)(const struct accel_event *event);
+
+struct accel_events_stats {
+    uint32_t events;        // events queued
+    uint32_t dropped;       // events lost to a full queue
+};
+
+int accel_events_init(accel_events_handler_t handler);
+
+/* Producer side, called from the acquisition thread */
+void accel_events_service(uint8_t act_tap_status, uint8_t source, uint32_t timestamp);
+void accel_events_update_orientation(const struct adxl345_data *sample, int32_t scale_q8,
+                                     uint32_t timestamp);
+
+/* Current orientation, 0 until one has been established */
+uint8_t accel_events_orientation(void);
+void accel_events_get_stats(struct accel_events_stats *stats);
+
+#endif
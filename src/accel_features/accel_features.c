@@ -0,0 +1,378 @@
+#include "accel_features.h"
+
+#include <string.h>
+#include <sys/byteorder.h>
+#include <sys/util.h>
+#include <logging/log.h>
+#include <timing/timing.h>
+
+#if defined(CONFIG_CMSIS_DSP_TRANSFORM)
+#include <arm_math.h>
+#else
+typedef int16_t q15_t;
+#endif
+
+#define LOG_MODULE_NAME accel_features
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+BUILD_ASSERT(ACCEL_FEATURES_WINDOW_LEN == 256 || ACCEL_FEATURES_WINDOW_LEN == 512 ||
+             ACCEL_FEATURES_WINDOW_LEN == 1024 || ACCEL_FEATURES_WINDOW_LEN == 2048,
+             "ACCEL_FEATURES_WINDOW_LEN must be 256, 512, 1024 or 2048");
+
+#define WINDOW_LEN          ACCEL_FEATURES_WINDOW_LEN
+#define BAND_BINS           (WINDOW_LEN / 2 / ACCEL_FEATURES_NUM_BANDS)
+
+/* The mean is removed before the FFT, so the samples (at most 13 bits)
+ * can be scaled up to use more of the q15 range. */
+#define INPUT_SHIFT         2
+
+struct window {
+    struct adxl345_data samples[WINDOW_LEN];
+    uint32_t timestamp;
+    uint8_t odr;
+};
+
+static K_THREAD_STACK_DEFINE(features_stack, ACCEL_FEATURES_STACK_SIZE);
+static struct k_thread features_thread;
+static K_SEM_DEFINE(window_ready, 0, 1);
+
+static accel_features_handler_t features_handler;
+static struct accel_features_stats stats;
+
+/* Producer state, only touched by the acquisition thread */
+static struct window windows[2];
+static uint8_t fill_idx;
+static uint8_t ready_idx;
+static size_t fill_count;
+static uint8_t window_odr = BW_RATE_DEFAULT;
+
+static atomic_t busy;           // the features thread owns windows[ready_idx]
+static atomic_t next_odr;       // odr + 1 requested by accel_features_set_odr()
+
+/* sin(pi * k / WINDOW_LEN) for k = 0 .. WINDOW_LEN / 2, for the Hann
+ * window and the FFT twiddles */
+static q15_t sine[WINDOW_LEN / 2 + 1];
+static q15_t hann[WINDOW_LEN];
+static q15_t fft_in[WINDOW_LEN];
+static q15_t spectrum[2 * WINDOW_LEN];
+static uint16_t frame_seq;
+
+#if defined(CONFIG_CMSIS_DSP_TRANSFORM)
+static arm_rfft_instance_q15 rfft;
+#endif
+
+static inline int16_t saturate16(int64_t v)
+{
+    return (int16_t)CLAMP(v, INT16_MIN, INT16_MAX);
+}
+
+static inline uint16_t saturate_u16(uint64_t v)
+{
+    return (uint16_t)MIN(v, UINT16_MAX);
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (v >= root + bit) {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+/* sin(pi * idx / WINDOW_LEN) for any idx */
+static int32_t sin_pi(uint32_t idx)
+{
+    int32_t sign = 1;
+
+    idx %= 2 * WINDOW_LEN;
+    if (idx >= WINDOW_LEN) {
+        idx -= WINDOW_LEN;
+        sign = -1;
+    }
+    if (idx > WINDOW_LEN / 2) {
+        idx = WINDOW_LEN - idx;
+    }
+    return sign * sine[idx];
+}
+
+static void init_tables(void)
+{
+    /* Taylor series up to x^9 is within q15 resolution on [0, pi/2], and
+     * the minimal libc has no libm */
+    for (size_t k = 0; k <= WINDOW_LEN / 2; k++) {
+        float x = 3.14159265f * (float)k / WINDOW_LEN;
+        float x2 = x * x;
+        float s = x * (1.0f - x2 / 6.0f * (1.0f - x2 / 20.0f * (1.0f - x2 / 42.0f * (1.0f - x2 / 72.0f))));
+
+        sine[k] = saturate16((int64_t)(s * 32767.0f + 0.5f));
+    }
+
+    /* Hann: sin^2(pi * n / N) */
+    for (size_t n = 0; n < WINDOW_LEN; n++) {
+        int32_t s = sin_pi(n);
+
+        hann[n] = (q15_t)((s * s) >> 15);
+    }
+}
+
+#if defined(CONFIG_CMSIS_DSP_TRANSFORM)
+
+static int fft_init(void)
+{
+    return arm_rfft_init_q15(&rfft, WINDOW_LEN, 0, 1) == ARM_MATH_SUCCESS ? 0 : -EINVAL;
+}
+
+/* Real FFT of fft_in into spectrum, scaled down by WINDOW_LEN. Only bins
+ * 0 .. WINDOW_LEN / 2 are used. */
+static void fft_run(void)
+{
+    arm_rfft_q15(&rfft, fft_in, spectrum);
+}
+
+#else
+
+static int fft_init(void)
+{
+    return 0;
+}
+
+/* Complex radix-2 FFT on the real input with a halving butterfly, which
+ * gives the same 1 / WINDOW_LEN scaling as arm_rfft_q15 */
+static void fft_run(void)
+{
+    const uint32_t n = WINDOW_LEN;
+
+    for (uint32_t i = 0; i < n; i++) {
+        spectrum[2 * i] = fft_in[i];
+        spectrum[2 * i + 1] = 0;
+    }
+
+    for (uint32_t i = 1, j = 0; i < n; i++) {
+        uint32_t bit = n >> 1;
+
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j) {
+            q15_t re = spectrum[2 * i];
+            q15_t im = spectrum[2 * i + 1];
+
+            spectrum[2 * i] = spectrum[2 * j];
+            spectrum[2 * i + 1] = spectrum[2 * j + 1];
+            spectrum[2 * j] = re;
+            spectrum[2 * j + 1] = im;
+        }
+    }
+
+    for (uint32_t len = 2; len <= n; len <<= 1) {
+        uint32_t step = n / len;
+
+        for (uint32_t i = 0; i < n; i += len) {
+            for (uint32_t k = 0; k < len / 2; k++) {
+                /* w = exp(-2 pi i k / len) */
+                int32_t wr = sin_pi(2 * k * step + n / 2);
+                int32_t wi = -sin_pi(2 * k * step);
+                q15_t *a = &spectrum[2 * (i + k)];
+                q15_t *b = &spectrum[2 * (i + k + len / 2)];
+                int32_t tr = (b[0] * wr - b[1] * wi) >> 15;
+                int32_t ti = (b[0] * wi + b[1] * wr) >> 15;
+                int32_t ar = a[0];
+                int32_t ai = a[1];
+
+                a[0] = (q15_t)((ar + tr) >> 1);
+                a[1] = (q15_t)((ai + ti) >> 1);
+                b[0] = (q15_t)((ar - tr) >> 1);
+                b[1] = (q15_t)((ai - ti) >> 1);
+            }
+        }
+    }
+}
+
+#endif
+
+static inline int16_t axis_sample(const struct adxl345_data *data, size_t axis)
+{
+    return axis == 0 ? data->x : axis == 1 ? data->y : data->z;
+}
+
+static void analyse_axis(const struct window *win, size_t axis, struct accel_features_axis *out)
+{
+    int32_t sum = 0;
+    int16_t min = INT16_MAX;
+    int16_t max = INT16_MIN;
+    uint64_t sum_sq = 0;
+    uint32_t peak = 0;
+    int16_t mean;
+    uint32_t rms;
+
+    for (size_t n = 0; n < WINDOW_LEN; n++) {
+        int16_t v = axis_sample(&win->samples[n], axis);
+
+        sum += v;
+        min = MIN(min, v);
+        max = MAX(max, v);
+    }
+    mean = (int16_t)((sum + (sum >= 0 ? WINDOW_LEN / 2 : -WINDOW_LEN / 2)) / WINDOW_LEN);
+
+    for (size_t n = 0; n < WINDOW_LEN; n++) {
+        int32_t ac = axis_sample(&win->samples[n], axis) - mean;
+
+        sum_sq += (uint64_t)((int64_t)ac * ac);
+        peak = MAX(peak, (uint32_t)(ac < 0 ? -ac : ac));
+        fft_in[n] = (q15_t)((saturate16(ac * BIT(INPUT_SHIFT)) * hann[n]) >> 15);
+    }
+    rms = isqrt64(sum_sq / WINDOW_LEN);
+
+    out->mean = sys_cpu_to_le16(mean);
+    out->rms = sys_cpu_to_le16(saturate_u16(rms));
+    out->p2p = sys_cpu_to_le16(saturate_u16(max - min));
+    out->crest = sys_cpu_to_le16(rms ? saturate_u16(((uint64_t)peak << 8) / rms) : 0);
+
+    fft_run();
+
+    /* With the spectrum scaled by 1/N, the mean square of the windowed
+     * input is the sum of |X[k]|^2 over all bins, i.e. twice the one-sided
+     * bins. 8/3 undoes the power loss of the Hann window. DC is skipped,
+     * the last band ends at Nyquist. */
+    for (size_t b = 0; b < ACCEL_FEATURES_NUM_BANDS; b++) {
+        uint64_t energy = 0;
+
+        for (size_t k = 1 + b * BAND_BINS; k <= (b + 1) * BAND_BINS; k++) {
+            int32_t re = spectrum[2 * k];
+            int32_t im = spectrum[2 * k + 1];
+
+            energy += (uint64_t)(re * re) + (uint64_t)(im * im);
+        }
+        out->bands[b] = sys_cpu_to_le16(saturate_u16(isqrt64(energy * 16 / 3) >> INPUT_SHIFT));
+    }
+}
+
+static void features_thread_fn(void *p1, void *p2, void *p3)
+{
+    struct accel_features_frame frame;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1) {
+        const struct window *win;
+        timing_t start, end;
+
+        k_sem_take(&window_ready, K_FOREVER);
+        win = &windows[ready_idx];
+        start = timing_counter_get();
+
+        for (size_t axis = 0; axis < ARRAY_SIZE(frame.axis); axis++) {
+            analyse_axis(win, axis, &frame.axis[axis]);
+        }
+
+        end = timing_counter_get();
+        stats.last_ns = timing_cycles_to_ns(timing_cycles_get(&start, &end));
+        stats.max_ns = MAX(stats.max_ns, stats.last_ns);
+        stats.windows++;
+        LOG_DBG("Window of %u analysed in %u ns", WINDOW_LEN, stats.last_ns);
+
+        frame.seq = sys_cpu_to_le16(frame_seq++);
+        frame.timestamp = sys_cpu_to_le32((uint32_t)sample_clock_to_us(win->timestamp));
+        frame.window_len = sys_cpu_to_le16(WINDOW_LEN);
+        frame.odr = win->odr;
+        frame.band_count = ACCEL_FEATURES_NUM_BANDS;
+
+        /* The producer may refill the window from here on */
+        atomic_clear(&busy);
+
+        features_handler(&frame);
+    }
+}
+
+int accel_features_init(accel_features_handler_t handler)
+{
+    int err;
+
+    if (handler == NULL) {
+        return -EINVAL;
+    }
+    features_handler = handler;
+
+    init_tables();
+    err = fft_init();
+    if (err) {
+        return err;
+    }
+
+    /* Analysis takes milliseconds, the 32 kHz kernel cycle counter would
+     * only resolve it to 30 us */
+    timing_init();
+    timing_start();
+
+    k_thread_create(&features_thread, features_stack,
+                    K_THREAD_STACK_SIZEOF(features_stack),
+                    features_thread_fn, NULL, NULL, NULL,
+                    ACCEL_FEATURES_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&features_thread, "features");
+
+    return 0;
+}
+
+void accel_features_feed(const struct adxl345_data *samples, size_t count,
+                         const struct sample_time *time)
+{
+    atomic_val_t odr = atomic_clear(&next_odr);
+
+    if (odr) {
+        /* Don't mix rates within a window */
+        window_odr = odr - 1;
+        fill_count = 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        struct window *win = &windows[fill_idx];
+
+        if (fill_count == 0) {
+            win->timestamp = sample_time_at(time, i);
+            win->odr = window_odr;
+        }
+        win->samples[fill_count++] = samples[i];
+        if (fill_count < WINDOW_LEN) {
+            continue;
+        }
+
+        fill_count = 0;
+        if (!atomic_cas(&busy, 0, 1)) {
+            /* Still analysing the other window, reuse this one */
+            stats.dropped++;
+            continue;
+        }
+        ready_idx = fill_idx;
+        fill_idx ^= 1;
+        k_sem_give(&window_ready);
+    }
+}
+
+void accel_features_set_odr(uint8_t odr)
+{
+    atomic_set(&next_odr, (atomic_val_t)odr + 1);
+}
+
+void accel_features_get_stats(struct accel_features_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
@@ -0,0 +1,75 @@
+#ifndef __accel_features_h__
+#define __accel_features_h__
+
+#include <zephyr.h>
+#include "adxl345.h"
+#include "sample_clock.h"
+
+/* Windowed feature extraction.
+ *
+ * Samples are collected into one of two window buffers while the other is
+ * analysed by the features thread. Per axis and window it computes mean,
+ * RMS, peak-to-peak, crest factor and the RMS in ACCEL_FEATURES_NUM_BANDS equal
+ * width bands of a Hann windowed real FFT (arm_rfft_q15 with
+ * CONFIG_CMSIS_DSP_TRANSFORM, a portable radix-2 FFT otherwise). If the
+ * previous window is still being analysed when the next one fills up, the
+ * new one is dropped. */
+
+/** @brief Samples per window and FFT length, a power of two from 256 to
+ * 2048, CONFIG_APP_FEATURES_WINDOW_LEN unless set here. **/
+#ifndef ACCEL_FEATURES_WINDOW_LEN
+#define ACCEL_FEATURES_WINDOW_LEN     CONFIG_APP_FEATURES_WINDOW_LEN
+#endif
+
+/** @brief Frequency bands reported per axis. **/
+#define ACCEL_FEATURES_NUM_BANDS      8
+
+#define ACCEL_FEATURES_STACK_SIZE     1024
+#define ACCEL_FEATURES_PRIORITY       K_PRIO_PREEMPT(10)
+
+/** @brief Features of one axis, in accelerometer counts. The band values
+ * are the RMS of the signal within each band, lowest band first; their
+ * squares add up to roughly rms squared. **/
+struct accel_features_axis {
+    int16_t mean;
+    uint16_t rms;           // of the signal with the mean removed
+    uint16_t p2p;
+    uint16_t crest;         // peak / rms, Q8
+    uint16_t bands[ACCEL_FEATURES_NUM_BANDS];
+} __packed;
+
+/** @brief Feature notification. All fields are little-endian. seq
+ * increments once per window, so dropped windows show up as gaps;
+ * timestamp is the capture time of the first sample in microseconds and
+ * odr the BW_RATE rate code of the samples. **/
+struct accel_features_frame {
+    uint16_t seq;
+    uint32_t timestamp;
+    uint16_t window_len;
+    uint8_t odr;
+    uint8_t band_count;
+    struct accel_features_axis axis[3];
+} __packed;
+
+/** @brief Called from the features thread with each analysed window. **/
+typedef void (*accel_features_handler_t)(const struct accel_features_frame *frame);
+
+struct accel_features_stats {
+    uint32_t windows;       // windows analysed
+    uint32_t dropped;       // windows lost while the previous one was busy
+    uint32_t last_ns;       // analysis time of the last window
+    uint32_t max_ns;
+};
+
+int accel_features_init(accel_features_handler_t handler);
+
+/* Producer side, called from the acquisition thread. Each window is
+ * stamped with the capture time of its own first sample. */
+void accel_features_feed(const struct adxl345_data *samples, size_t count,
+                         const struct sample_time *time);
+
+/* Starts a new window at the given rate code */
+void accel_features_set_odr(uint8_t odr);
+void accel_features_get_stats(struct accel_features_stats *stats);
+
+#endif
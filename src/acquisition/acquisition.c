@@ -0,0 +1,296 @@
+#include "acquisition.h"
+#include "accel_events.h"
+#include "accel_conv.h"
+
+#include <drivers/gpio.h>
+
+#define ADXL345_NODE DT_INST(0, adi_adxl345)
+#define USER_NODE    DT_PATH(zephyr_user)
+
+#if !DT_NODE_HAS_PROP(USER_NODE, adxl345_int1_gpios)
+#error "adxl345-int1-gpios is missing from the zephyr,user node"
+#endif
+
+static const struct device *i2c_dev = DEVICE_DT_GET(DT_BUS(ADXL345_NODE));
+static const struct gpio_dt_spec int1 = GPIO_DT_SPEC_GET(USER_NODE, adxl345_int1_gpios);
+
+static struct gpio_callback int1_cb;
+static K_SEM_DEFINE(int1_sem, 0, 1);
+
+/* Cycle count at the last INT1 edge. An edge that arrives while the FIFO
+ * is being drained doesn't mark a known sample and is not an anchor. */
+static uint32_t edge_cycles;
+static bool edge_valid;
+static atomic_t draining;
+
+static K_THREAD_STACK_DEFINE(acquisition_stack, ACQUISITION_STACK_SIZE);
+static struct k_thread acquisition_thread;
+
+static acquisition_handler_t sample_handler;
+static acquisition_config_handler_t config_handler;
+static struct acquisition_stats stats;
+static uint8_t event_mask;      // INT_EVENTS bits routed to INT1
+
+/* Configuration changes are applied by the acquisition thread, which owns
+ * the bus, between FIFO drains. */
+static K_MSGQ_DEFINE(config_msgq, sizeof(struct adxl345_config), 1, 4);
+static struct adxl345_config active_config = ADXL345_CONFIG_DEFAULT;
+
+static void apply_config(const struct adxl345_config *cfg)
+{
+    unsigned int key;
+    int err;
+
+    err = adxl345_configure(i2c_dev, cfg);
+    if (err) {
+        /* The driver put the previous settings back, but the FIFO was
+         * cleared on the way */
+        stats.errors++;
+        sample_clock_reset(active_config.odr);
+        return;
+    }
+
+    key = irq_lock();
+    active_config = *cfg;
+    irq_unlock(key);
+
+    sample_clock_reset(cfg->odr);
+
+    /* Whatever follows in the stream was taken with the new settings */
+    if (config_handler) {
+        config_handler(cfg);
+    }
+}
+
+static void int1_triggered(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins)
+{
+    ARG_UNUSED(port);
+    ARG_UNUSED(cb);
+    ARG_UNUSED(pins);
+
+    edge_cycles = k_cycle_get_32();
+    edge_valid = !atomic_get(&draining);
+    k_sem_give(&int1_sem);
+}
+
+/* Takes the capture of the edge that woke the thread, if it is an anchor */
+static bool take_edge(uint32_t *cycles)
+{
+    unsigned int key = irq_lock();
+    bool valid = edge_valid;
+
+    *cycles = edge_cycles;
+    edge_valid = false;
+    irq_unlock(key);
+
+    return valid;
+}
+
+static void acquisition_thread_fn(void *p1, void *p2, void *p3)
+{
+    struct adxl345_data batch[ADXL345_FIFO_DEPTH];
+    struct adxl345_config cfg;
+    struct sample_time time;
+    uint32_t retry_ms = ACQUISITION_RETRY_MS;
+    uint32_t edge;
+    bool anchor;
+    bool failed;
+    int n;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1) {
+        k_sem_take(&int1_sem, K_FOREVER);
+        stats.wakeups++;
+        atomic_set(&draining, 1);
+        anchor = take_edge(&edge);
+        failed = false;
+
+        if (k_msgq_get(&config_msgq, &cfg, K_NO_WAIT) == 0) {
+            apply_config(&cfg);
+            anchor = false;
+        }
+
+        /* INT1 is edge triggered. If new samples push the FIFO back over
+         * the watermark while it is being drained, or an event latches,
+         * the line never drops, so keep servicing until it does. */
+        do {
+            if (event_mask) {
+                uint8_t act_tap_status, source;
+
+                if (adxl345_event_status(i2c_dev, &act_tap_status, &source) != 0) {
+                    failed = true;
+                    break;
+                }
+                if (source & event_mask) {
+                    /* The edge may have been the event's */
+                    accel_events_service(act_tap_status, source, k_cycle_get_32());
+                    anchor = false;
+                }
+                if (source & INT_OVERRUN) {
+                    sample_clock_reset(active_config.odr);
+                    anchor = false;
+                }
+            }
+
+            /* A watermark edge means the watermark-th sample past the
+             * ones already read just completed */
+            if (anchor) {
+                sample_clock_anchor(edge, active_config.watermark - 1);
+                anchor = false;
+            }
+
+            n = adxl345_fifo_drain(i2c_dev, batch, ARRAY_SIZE(batch));
+            if (n < 0) {
+                failed = true;
+                break;
+            }
+            if (n > 0) {
+                stats.batches++;
+                stats.samples += n;
+                sample_clock_stamp(n, &time);
+                sample_handler(batch, n, &time);
+                accel_events_update_orientation(&batch[n - 1],
+                    ACCEL_CONV_SCALE_Q8(active_config.full_res ? 0 : active_config.range),
+                    sample_time_at(&time, n - 1));
+            }
+        } while (gpio_pin_get_dt(&int1) > 0);
+
+        atomic_clear(&draining);
+
+        if (!failed) {
+            retry_ms = ACQUISITION_RETRY_MS;
+            continue;
+        }
+
+        /* INT1 is still high after a failed transfer and won't raise
+         * another edge, so come back for it ourselves. Samples may have
+         * been lost, so the clock starts over. */
+        stats.errors++;
+        sample_clock_reset(active_config.odr);
+        k_sleep(K_MSEC(retry_ms));
+        retry_ms = MIN(retry_ms * 2, ACQUISITION_RETRY_MAX_MS);
+        if (gpio_pin_get_dt(&int1) > 0) {
+            k_sem_give(&int1_sem);
+        }
+    }
+}
+
+int acquisition_init(acquisition_handler_t handler)
+{
+    const struct adxl345_event_config event_config = ADXL345_EVENT_CONFIG_DEFAULT;
+    int err;
+
+    if (handler == NULL) {
+        return -EINVAL;
+    }
+    sample_handler = handler;
+
+    if (!device_is_ready(i2c_dev) || !device_is_ready(int1.port)) {
+        printk("ADXL345 bus or INT1 port not ready\n");
+        return -ENODEV;
+    }
+
+    active_config = (struct adxl345_config)ADXL345_CONFIG_DEFAULT;
+    active_config.fifo_mode = ADXL345_FIFO_STREAM;
+    active_config.watermark = ACQUISITION_FIFO_WATERMARK;
+    err = adxl345_configure(i2c_dev, &active_config);
+    if (err) {
+        return err;
+    }
+    sample_clock_reset(active_config.odr);
+
+    err = adxl345_event_config(i2c_dev, &event_config);
+    if (err < 0) {
+        return err;
+    }
+    event_mask = err;
+
+    err = gpio_pin_configure_dt(&int1, GPIO_INPUT);
+    if (err) {
+        printk("Couldn't configure INT1 pin (err %d)\n", err);
+        return err;
+    }
+    gpio_init_callback(&int1_cb, int1_triggered, BIT(int1.pin));
+    err = gpio_add_callback(int1.port, &int1_cb);
+    if (err) {
+        return err;
+    }
+    err = gpio_pin_interrupt_configure_dt(&int1, GPIO_INT_EDGE_TO_ACTIVE);
+    if (err) {
+        printk("Couldn't enable INT1 interrupt (err %d)\n", err);
+        return err;
+    }
+
+    k_thread_create(&acquisition_thread, acquisition_stack,
+                    K_THREAD_STACK_SIZEOF(acquisition_stack),
+                    acquisition_thread_fn, NULL, NULL, NULL,
+                    ACQUISITION_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&acquisition_thread, "acquisition");
+
+    /* Route the watermark to INT1 last so the first edge finds the
+     * thread waiting. Overrun shares the pin so a stalled consumer still
+     * gets woken up, and so do the event detectors, whose latched bits the
+     * thread clears on every pass. */
+    err = adxl345_int_config(i2c_dev, INT_WATERMARK | INT_OVERRUN | event_mask, 0);
+    if (err) {
+        return err;
+    }
+
+    /* The line may already be high from samples queued before the
+     * interrupt was armed. */
+    if (gpio_pin_get_dt(&int1) > 0) {
+        k_sem_give(&int1_sem);
+    }
+
+    return 0;
+}
+
+void acquisition_get_stats(struct acquisition_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
+
+int acquisition_configure(const struct adxl345_config *cfg)
+{
+    struct adxl345_config next = *cfg;
+    int err;
+
+    /* The pipeline depends on the watermark interrupt */
+    next.fifo_mode = ADXL345_FIFO_STREAM;
+    if (next.watermark == 0) {
+        next.watermark = ACQUISITION_FIFO_WATERMARK;
+    }
+
+    err = adxl345_check_config(&next, ADXL345_BUS_HZ);
+    if (err) {
+        return err;
+    }
+
+    /* Only the latest request matters */
+    k_msgq_purge(&config_msgq);
+    err = k_msgq_put(&config_msgq, &next, K_NO_WAIT);
+    if (err) {
+        return err;
+    }
+    k_sem_give(&int1_sem);
+    return 0;
+}
+
+void acquisition_get_config(struct adxl345_config *cfg)
+{
+    unsigned int key = irq_lock();
+
+    *cfg = active_config;
+    irq_unlock(key);
+}
+
+void acquisition_set_config_handler(acquisition_config_handler_t handler)
+{
+    config_handler = handler;
+}
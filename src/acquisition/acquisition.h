@@ -0,0 +1,52 @@
+#ifndef __acquisition_h__
+#define __acquisition_h__
+
+#include <zephyr.h>
+#include "adxl345.h"
+#include "sample_clock.h"
+
+/** @brief FIFO watermark that raises INT1 (entries). **/
+#define ACQUISITION_FIFO_WATERMARK  16
+
+#define ACQUISITION_STACK_SIZE      1024
+#define ACQUISITION_PRIORITY        K_PRIO_PREEMPT(2)
+
+/** @brief Backoff before servicing INT1 again after a failed transfer,
+ * doubled on each failure in a row up to the maximum. **/
+#define ACQUISITION_RETRY_MS        1
+#define ACQUISITION_RETRY_MAX_MS    64
+
+/** @brief Poll period with the in-tree sensor driver, which drains the
+ * whole FIFO on every fetch. **/
+#define ACQUISITION_POLL_MS         100
+/** @brief Rate the in-tree driver programs at init. **/
+#define ACQUISITION_SENSOR_ODR      ADXL345_ODR_25HZ
+
+/** @brief Called from the acquisition thread with each drained batch and
+ * the capture times of its samples. **/
+typedef void (*acquisition_handler_t)(const struct adxl345_data *samples, size_t count,
+                                      const struct sample_time *time);
+
+/** @brief Called from the acquisition thread once a new configuration is
+ * in effect, before the first sample taken with it is handed on. **/
+typedef void (*acquisition_config_handler_t)(const struct adxl345_config *cfg);
+
+struct acquisition_stats {
+    uint32_t wakeups;   // INT1 edges serviced by the thread
+    uint32_t batches;   // non-empty FIFO drains
+    uint32_t samples;   // samples handed to the handler
+    uint32_t errors;    // failed bus transfers
+};
+
+int acquisition_init(acquisition_handler_t handler);
+
+/* Validates cfg and hands it to the acquisition thread. The FIFO always
+ * runs in stream mode; a watermark of 0 keeps the default. Returns the
+ * adxl345_check_config() error if the settings are rejected, and -ENOTSUP
+ * with the in-tree driver. */
+int acquisition_configure(const struct adxl345_config *cfg);
+void acquisition_get_config(struct adxl345_config *cfg);
+void acquisition_set_config_handler(acquisition_config_handler_t handler);
+void acquisition_get_stats(struct acquisition_stats *stats);
+
+#endif
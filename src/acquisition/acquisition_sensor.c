@@ -0,0 +1,149 @@
+#include "acquisition.h"
+#include "accel_events.h"
+#include "accel_conv.h"
+
+#include <drivers/sensor.h>
+
+/* Acquisition through Zephyr's in-tree ADXL345 driver. Samples come back
+ * in m/s^2 and are turned into full resolution counts, so everything
+ * downstream sees the same data as with the application driver. */
+
+#define ADXL345_NODE DT_INST(0, adi_adxl345)
+
+/* mg per full resolution LSB, Q8 */
+#define FULL_RES_SCALE_Q8   ACCEL_CONV_SCALE_Q8(0)
+
+static const struct device *accel_dev = DEVICE_DT_GET(ADXL345_NODE);
+
+static K_THREAD_STACK_DEFINE(acquisition_stack, ACQUISITION_STACK_SIZE);
+static struct k_thread acquisition_thread;
+
+static acquisition_handler_t sample_handler;
+static struct acquisition_stats stats;
+
+static const struct adxl345_config active_config = {
+    .odr = ACQUISITION_SENSOR_ODR,
+    .range = ADXL345_RANGE_16G,
+    .full_res = true,
+    .fifo_mode = ADXL345_FIFO_STREAM,
+};
+
+static int16_t mg_to_counts(int16_t mg)
+{
+    return (int16_t)(((int32_t)mg * 256) / 1000);
+}
+
+static int read_sample(struct adxl345_data *sample)
+{
+    struct sensor_value xyz[3];
+    int err;
+
+    err = sensor_channel_get(accel_dev, SENSOR_CHAN_ACCEL_XYZ, xyz);
+    if (err) {
+        return err;
+    }
+
+    sample->x = mg_to_counts(accel_sensor_value_to_mg(&xyz[0]));
+    sample->y = mg_to_counts(accel_sensor_value_to_mg(&xyz[1]));
+    sample->z = mg_to_counts(accel_sensor_value_to_mg(&xyz[2]));
+    return 0;
+}
+
+static void acquisition_thread_fn(void *p1, void *p2, void *p3)
+{
+    struct adxl345_data batch[ADXL345_FIFO_DEPTH];
+    struct sample_time time;
+    uint32_t fetched;
+    int n;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1) {
+        k_sleep(K_MSEC(ACQUISITION_POLL_MS));
+        stats.wakeups++;
+
+        /* The driver drains its FIFO on fetch and returns the number of
+         * samples, which channel_get() then hands out one per call.
+         * Drivers that return 0 produce a single sample. */
+        n = sensor_sample_fetch(accel_dev);
+        fetched = k_cycle_get_32();
+        if (n < 0) {
+            stats.errors++;
+            continue;
+        }
+        n = CLAMP(n, 1, (int)ARRAY_SIZE(batch));
+
+        for (int i = 0; i < n; i++) {
+            if (read_sample(&batch[i]) != 0) {
+                stats.errors++;
+                n = i;
+                break;
+            }
+        }
+        if (n == 0) {
+            continue;
+        }
+
+        /* Without an interrupt the newest sample is only known to have
+         * completed before the fetch, within one period */
+        sample_clock_anchor(fetched, n - 1);
+        sample_clock_stamp(n, &time);
+
+        stats.batches++;
+        stats.samples += n;
+        sample_handler(batch, n, &time);
+        accel_events_update_orientation(&batch[n - 1], FULL_RES_SCALE_Q8,
+                                        sample_time_at(&time, n - 1));
+    }
+}
+
+int acquisition_init(acquisition_handler_t handler)
+{
+    if (handler == NULL) {
+        return -EINVAL;
+    }
+    sample_handler = handler;
+
+    if (!device_is_ready(accel_dev)) {
+        printk("ADXL345 sensor driver not ready\n");
+        return -ENODEV;
+    }
+    sample_clock_reset(active_config.odr);
+
+    k_thread_create(&acquisition_thread, acquisition_stack,
+                    K_THREAD_STACK_SIZEOF(acquisition_stack),
+                    acquisition_thread_fn, NULL, NULL, NULL,
+                    ACQUISITION_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&acquisition_thread, "acquisition");
+
+    return 0;
+}
+
+void acquisition_get_stats(struct acquisition_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
+
+int acquisition_configure(const struct adxl345_config *cfg)
+{
+    ARG_UNUSED(cfg);
+
+    /* The in-tree driver has no runtime rate or range attributes */
+    return -ENOTSUP;
+}
+
+void acquisition_get_config(struct adxl345_config *cfg)
+{
+    *cfg = active_config;
+}
+
+void acquisition_set_config_handler(acquisition_config_handler_t handler)
+{
+    /* The configuration never changes */
+    ARG_UNUSED(handler);
+}
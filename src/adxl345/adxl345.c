@@ -1,64 +1,333 @@
 #include "adxl345.h"
+#include "i2c_bus.h"
+#include <sys/byteorder.h>
+#include <logging/log.h>
 
-// #define LOG_MODULE_NAME adxl345
-// LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+#define LOG_MODULE_NAME adxl345
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_WRN);
 
-int adxl345_init(const struct device *dev_i2c)
+static struct adxl345_config current_config = ADXL345_CONFIG_DEFAULT;
+static uint8_t power_ctl = POWER_CTL_MEASURE;  // kept across reconfiguration
+
+static int adxl345_write_reg(const struct device *dev_i2c, uint8_t reg, uint8_t value)
 {
+    const uint8_t buf[2] = {reg, value};
     int ret;
-    
-    uint8_t config[2] = {POWER_CTL,0x08};
-    ret = i2c_write(dev_i2c, config, sizeof(config), ADXL345_ADDR);
+
+    ret = i2c_bus_write(dev_i2c, buf, sizeof(buf), ADXL345_ADDR, I2C_BUS_PRIO_HIGH);
     if(ret != 0){
-        printk("Failed to write to I2C device address %x at Reg. %x \n", ADXL345_ADDR,config[0]);
+        LOG_ERR("Failed to write to I2C device address %x at Reg. %x", ADXL345_ADDR, reg);
     }
+    return ret;
+}
+
+static int adxl345_read_reg(const struct device *dev_i2c, uint8_t reg, uint8_t *value)
+{
+    int ret;
 
-    config[0] = DATA_FORMAT;
-    config[1] = 0x00;
-    ret = i2c_write(dev_i2c, config, sizeof(config), ADXL345_ADDR);
+    ret = i2c_bus_write_read(dev_i2c, ADXL345_ADDR, &reg, 1, value, 1, I2C_BUS_PRIO_HIGH);
     if(ret != 0){
-        printk("Failed to write to I2C device address %x at Reg. %x \n", ADXL345_ADDR,config[0]);
+        LOG_ERR("Failed to write/read I2C device address %x at Reg. %x", ADXL345_ADDR, reg);
+    }
+    return ret;
+}
+
+int adxl345_init(const struct device *dev_i2c)
+{
+    const struct adxl345_config cfg = ADXL345_CONFIG_DEFAULT;
+
+    return adxl345_configure(dev_i2c, &cfg);
+}
+
+uint32_t adxl345_odr_mhz(uint8_t odr)
+{
+    return 3200000U >> (ADXL345_ODR_3200HZ - (odr & BW_RATE_RATE_MASK));
+}
+
+int adxl345_check_config(const struct adxl345_config *cfg, uint32_t bus_hz)
+{
+    uint64_t needed_bps;
+
+    if (cfg->odr > ADXL345_ODR_3200HZ || cfg->range > ADXL345_RANGE_16G ||
+        cfg->fifo_mode > ADXL345_FIFO_TRIGGER) {
+        return -EINVAL;
+    }
+    if (cfg->low_power && (cfg->odr < ADXL345_ODR_12_5HZ || cfg->odr > ADXL345_ODR_400HZ)) {
+        return -EINVAL;
+    }
+    if (cfg->fifo_mode != ADXL345_FIFO_BYPASS &&
+        (cfg->watermark < 1 || cfg->watermark > ADXL345_FIFO_WATERMARK_MAX)) {
+        return -EINVAL;
+    }
+
+    needed_bps = (uint64_t)adxl345_odr_mhz(cfg->odr) * ADXL345_BUS_BITS_PER_SAMPLE / 1000;
+    if (needed_bps * 100 > (uint64_t)bus_hz * ADXL345_BUS_BUDGET_PCT) {
+        return -ENOTSUP;
+    }
+
+    return 0;
+}
+
+static int program_config(const struct device *dev_i2c, const struct adxl345_config *cfg)
+{
+    int ret;
+    uint8_t data_format = cfg->range & DATA_FORMAT_RANGE_MASK;
+    uint8_t bw_rate = cfg->odr & BW_RATE_RATE_MASK;
+
+    if (cfg->full_res) {
+        data_format |= DATA_FORMAT_FULL_RES;
+    }
+    if (cfg->low_power) {
+        bw_rate |= BW_RATE_LOW_POWER;
     }
 
+    /* Reprogram from standby. Going through bypass clears the FIFO so no
+     * samples taken at the old rate or range are left behind. */
+    ret = adxl345_write_reg(dev_i2c, POWER_CTL, 0);
+    if (ret == 0) {
+        ret = adxl345_write_reg(dev_i2c, FIFO_CTL, 0);
+    }
+    if (ret == 0) {
+        ret = adxl345_write_reg(dev_i2c, BW_RATE, bw_rate);
+    }
+    if (ret == 0) {
+        ret = adxl345_write_reg(dev_i2c, DATA_FORMAT, data_format);
+    }
+    if (ret == 0 && cfg->fifo_mode != ADXL345_FIFO_BYPASS) {
+        ret = adxl345_fifo_config(dev_i2c, cfg->fifo_mode, cfg->watermark);
+    }
+    if (ret == 0) {
+        ret = adxl345_write_reg(dev_i2c, POWER_CTL, power_ctl);
+    }
     return ret;
 }
 
+int adxl345_configure(const struct device *dev_i2c, const struct adxl345_config *cfg)
+{
+    int ret;
+
+    ret = adxl345_check_config(cfg, ADXL345_BUS_HZ);
+    if (ret != 0) {
+        LOG_WRN("Rejected config odr %u range %u (err %d)", cfg->odr, cfg->range, ret);
+        return ret;
+    }
+
+    ret = program_config(dev_i2c, cfg);
+    if (ret != 0) {
+        /* A failure partway leaves the part in standby, so put the
+         * previous settings back and keep it measuring */
+        if (program_config(dev_i2c, &current_config) != 0) {
+            LOG_ERR("Couldn't restore the previous config, device may be in standby");
+        }
+        return ret;
+    }
+
+    current_config = *cfg;
+    return 0;
+}
+
+void adxl345_get_config(struct adxl345_config *cfg)
+{
+    *cfg = current_config;
+}
+
 int readXYZ(const struct device *dev_i2c, struct adxl345_data *adxl345_data)
+{
+    return adxl345_read_samples(dev_i2c, adxl345_data, 1);
+}
+
+int adxl345_read_samples(const struct device *dev_i2c, struct adxl345_data *samples, size_t count)
+{
+    int ret = 0;
+    uint8_t reg = DATAX0;
+    struct i2c_msg msgs[2 * ADXL345_READ_CHUNK];
+
+    /* DATAX0..DATAZ1 are little-endian and in the same order as the
+     * struct fields, so the device auto-increment fills each record
+     * directly. Every sample is a register write followed by a 6-byte
+     * read with a repeated start, 9 bytes on the wire with the two
+     * address bytes; a whole chunk goes out as one START ... STOP
+     * transfer. */
+    for (size_t done = 0; done < count; ) {
+        size_t n = MIN(count - done, ADXL345_READ_CHUNK);
+
+        for (size_t i = 0; i < n; i++) {
+            msgs[2 * i].buf = &reg;
+            msgs[2 * i].len = 1;
+            msgs[2 * i].flags = (i == 0) ? I2C_MSG_WRITE : (I2C_MSG_WRITE | I2C_MSG_RESTART);
+            msgs[2 * i + 1].buf = (uint8_t *)&samples[done + i];
+            msgs[2 * i + 1].len = ADXL345_SAMPLE_SIZE;
+            msgs[2 * i + 1].flags = I2C_MSG_RESTART | I2C_MSG_READ;
+        }
+        msgs[2 * n - 1].flags |= I2C_MSG_STOP;
+
+        ret = i2c_bus_transfer(dev_i2c, msgs, 2 * n, ADXL345_ADDR, I2C_BUS_PRIO_HIGH);
+        if(ret != 0){
+            LOG_ERR("Failed to burst read I2C device address %x at Reg. %x", ADXL345_ADDR, reg);
+            return ret;
+        }
+
+        for (size_t i = done; i < done + n; i++) {
+            samples[i].x = sys_le16_to_cpu(samples[i].x);
+            samples[i].y = sys_le16_to_cpu(samples[i].y);
+            samples[i].z = sys_le16_to_cpu(samples[i].z);
+        }
+        done += n;
+    }
+
+    return ret;
+}
+
+int adxl345_fifo_config(const struct device *dev_i2c, enum adxl345_fifo_mode mode, uint8_t watermark)
+{
+    if (mode > ADXL345_FIFO_TRIGGER) {
+        return -EINVAL;
+    }
+    if (mode != ADXL345_FIFO_BYPASS &&
+        (watermark < 1 || watermark > ADXL345_FIFO_WATERMARK_MAX)) {
+        return -EINVAL;
+    }
+
+    return adxl345_write_reg(dev_i2c, FIFO_CTL,
+                             (mode << FIFO_CTL_MODE_SHIFT) | (watermark & FIFO_CTL_SAMPLES_MASK));
+}
+
+int adxl345_fifo_entries(const struct device *dev_i2c, uint8_t *entries)
 {
     int ret;
-    
-    uint8_t acc_reading[6]= {0};
-    uint8_t sensor_regs[6] ={DATAX0,DATAX1,DATAY0,DATAY1,DATAZ0,DATAZ1};
+    uint8_t status;
 
-    ret = i2c_write_read(dev_i2c,ADXL345_ADDR,&sensor_regs[0],1,&acc_reading[0],1);
-    if(ret != 0){
-        printk("Failed to write/read I2C device address %x at Reg. %x \n", ADXL345_ADDR,sensor_regs[0]);
+    ret = adxl345_read_reg(dev_i2c, FIFO_STATUS, &status);
+    if (ret == 0) {
+        *entries = status & FIFO_STATUS_ENTRIES_MASK;
     }
-    ret = i2c_write_read(dev_i2c,ADXL345_ADDR,&sensor_regs[1],1,&acc_reading[1],1);
-    if(ret != 0){
-        printk("Failed to write/read I2C device address %x at Reg. %x \n", ADXL345_ADDR,sensor_regs[1]);
+    return ret;
+}
+
+int adxl345_fifo_drain(const struct device *dev_i2c, struct adxl345_data *samples, size_t max)
+{
+    int ret;
+    uint8_t entries;
+
+    ret = adxl345_fifo_entries(dev_i2c, &entries);
+    if (ret != 0) {
+        return ret;
     }
-    ret = i2c_write_read(dev_i2c,ADXL345_ADDR,&sensor_regs[2],1,&acc_reading[2],1);
-    if(ret != 0){
-        printk("Failed to write/read I2C device address %x at Reg. %x \n", ADXL345_ADDR,sensor_regs[2]);
+
+    /* Each DATAX0..DATAZ1 read pops one FIFO entry. The repeated start
+     * and address byte between samples keep the 5 us gap the datasheet
+     * asks for at 400 kHz. Entries beyond max stay in the FIFO for the
+     * next drain. */
+    entries = MIN(entries, max);
+    if (entries == 0) {
+        return 0;
     }
-    ret = i2c_write_read(dev_i2c,ADXL345_ADDR,&sensor_regs[3],1,&acc_reading[3],1);
-    if(ret != 0){
-        printk("Failed to write/read I2C device address %x at Reg. %x \n", ADXL345_ADDR,sensor_regs[3]);
+
+    ret = adxl345_read_samples(dev_i2c, samples, entries);
+    if (ret != 0) {
+        return ret;
     }
-    ret = i2c_write_read(dev_i2c,ADXL345_ADDR,&sensor_regs[4],1,&acc_reading[4],1);
-    if(ret != 0){
-        printk("Failed to write/read I2C device address %x at Reg. %x \n", ADXL345_ADDR,sensor_regs[4]);
+    return entries;
+}
+
+int adxl345_int_config(const struct device *dev_i2c, uint8_t enable, uint8_t int2_map)
+{
+    int ret;
+
+    /* Disable first so nothing fires on the wrong pin while remapping */
+    ret = adxl345_write_reg(dev_i2c, INT_ENABLE, 0);
+    if (ret != 0) {
+        return ret;
     }
-    ret = i2c_write_read(dev_i2c,ADXL345_ADDR,&sensor_regs[5],1,&acc_reading[5],1);
-    if(ret != 0){
-        printk("Failed to write/read I2C device address %x at Reg. %x \n", ADXL345_ADDR,sensor_regs[5]);
+    ret = adxl345_write_reg(dev_i2c, INT_MAP, int2_map);
+    if (ret != 0) {
+        return ret;
     }
+    return adxl345_write_reg(dev_i2c, INT_ENABLE, enable);
+}
 
-    /* STEP 10 - Convert the two bytes to a 12-bits */
-    adxl345_data->x = ((int16_t)acc_reading[1] << 8) + acc_reading[0];
-    adxl345_data->y = ((int16_t)acc_reading[3] << 8) + acc_reading[2];
-    adxl345_data->z = ((int16_t)acc_reading[5] << 8) + acc_reading[4];
+int adxl345_int_source(const struct device *dev_i2c, uint8_t *source)
+{
+    return adxl345_read_reg(dev_i2c, INT_SOURCE, source);
+}
 
-    return ret;
-}
\ No newline at end of file
+static uint8_t event_reg(uint32_t value, uint32_t per_lsb)
+{
+    return (uint8_t)MIN((value + per_lsb / 2) / per_lsb, UINT8_MAX);
+}
+
+int adxl345_event_config(const struct device *dev_i2c, const struct adxl345_event_config *cfg)
+{
+    const uint8_t regs[][2] = {
+        { THRESH_TAP, event_reg(cfg->tap_thresh_mg * 1000U, ADXL345_THRESH_UG_PER_LSB) },
+        { DUR, event_reg(cfg->tap_dur_us, ADXL345_DUR_US_PER_LSB) },
+        { LATENT, event_reg(cfg->tap_latent_ms * 1000U, ADXL345_LATENT_US_PER_LSB) },
+        { WINDOW, event_reg(cfg->tap_window_ms * 1000U, ADXL345_LATENT_US_PER_LSB) },
+        { TAP_AXES, cfg->tap_thresh_mg ? TAP_AXES_XYZ : 0 },
+        { THRESH_ACT, event_reg(cfg->act_thresh_mg * 1000U, ADXL345_THRESH_UG_PER_LSB) },
+        { THRESH_INACT, event_reg(cfg->inact_thresh_mg * 1000U, ADXL345_THRESH_UG_PER_LSB) },
+        { TIME_INACT, cfg->inact_time_s },
+        { ACT_INACT_CTL, ACT_INACT_CTL_ACT_AC | ACT_INACT_CTL_ACT_XYZ |
+                         ACT_INACT_CTL_INACT_AC | ACT_INACT_CTL_INACT_XYZ },
+        { THRESH_FF, event_reg(cfg->ff_thresh_mg * 1000U, ADXL345_THRESH_UG_PER_LSB) },
+        { TIME_FF, event_reg(cfg->ff_time_ms, ADXL345_TIME_FF_MS_PER_LSB) },
+    };
+    uint8_t enable = 0;
+    int ret;
+
+    for (size_t i = 0; i < ARRAY_SIZE(regs); i++) {
+        ret = adxl345_write_reg(dev_i2c, regs[i][0], regs[i][1]);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    if (cfg->tap_thresh_mg) {
+        enable |= INT_SINGLE_TAP;
+        if (cfg->tap_window_ms) {
+            enable |= INT_DOUBLE_TAP;
+        }
+    }
+    if (cfg->act_thresh_mg) {
+        enable |= INT_ACTIVITY;
+    }
+    if (cfg->inact_thresh_mg) {
+        enable |= INT_INACTIVITY;
+    }
+    if (cfg->ff_thresh_mg) {
+        enable |= INT_FREE_FALL;
+    }
+
+    /* Unlinked, both detectors keep firing for as long as their
+     * condition holds. Linked, activity is only looked for after
+     * inactivity and the other way round. */
+    if ((enable & (INT_ACTIVITY | INT_INACTIVITY)) == (INT_ACTIVITY | INT_INACTIVITY)) {
+        power_ctl = POWER_CTL_MEASURE | POWER_CTL_LINK;
+    } else {
+        power_ctl = POWER_CTL_MEASURE;
+    }
+    ret = adxl345_write_reg(dev_i2c, POWER_CTL, power_ctl);
+    if (ret != 0) {
+        return ret;
+    }
+    return enable;
+}
+
+int adxl345_event_status(const struct device *dev_i2c, uint8_t *act_tap_status, uint8_t *source)
+{
+    const uint8_t reg = ACT_TAP_STATUS;
+    uint8_t buf[INT_SOURCE - ACT_TAP_STATUS + 1];
+    int ret;
+
+    /* ACT_TAP_STATUS has to be read before INT_SOURCE clears the event,
+     * and the registers in between are harmless to read */
+    ret = i2c_bus_write_read(dev_i2c, ADXL345_ADDR, &reg, 1, buf, sizeof(buf), I2C_BUS_PRIO_HIGH);
+    if (ret != 0) {
+        LOG_ERR("Failed to burst read I2C device address %x at Reg. %x", ADXL345_ADDR, ACT_TAP_STATUS);
+        return ret;
+    }
+
+    *act_tap_status = buf[0];
+    *source = buf[INT_SOURCE - ACT_TAP_STATUS];
+    return 0;
+}
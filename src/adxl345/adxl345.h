@@ -32,9 +32,20 @@ local, and you've found our code helpful, please buy us a round!
 #error "i2c0 devicetree node is disabled"
 #define I2C0	""
 #endif
-// This is the right justified address of the accelerometer, when the SDO pin
-//  is grounded (as it is in our application).
+// I2C bus clock of the accelerometer, used to validate the ODR
+#if DT_HAS_COMPAT_STATUS_OKAY(adi_adxl345)
+#define ADXL345_BUS_HZ DT_PROP_OR(DT_BUS(DT_INST(0, adi_adxl345)), clock_frequency, 100000)
+#else
+#define ADXL345_BUS_HZ 100000
+#endif
+
+// This is the right justified address of the accelerometer. Take it from the
+//  devicetree node when there is one (0x53 with SDO grounded, 0x1D with SDO high).
+#if DT_HAS_COMPAT_STATUS_OKAY(adi_adxl345)
+#define ADXL345_ADDR DT_REG_ADDR(DT_INST(0, adi_adxl345))
+#else
 #define ADXL345_ADDR 0x1D
+#endif
 
 // Register map
 #define DEVID           0      // Reads 11100101/0xE5
@@ -69,6 +80,71 @@ local, and you've found our code helpful, please buy us a round!
 #define FIFO_CTL        0x38   // FIFO control
 #define FIFO_STATUS     0x39   // FIFO status
 
+// BW_RATE fields
+#define BW_RATE_LOW_POWER   BIT(4)
+#define BW_RATE_RATE_MASK   0x0F
+// BW_RATE rate code after reset (100 Hz)
+#define BW_RATE_DEFAULT     ADXL345_ODR_100HZ
+
+// POWER_CTL fields
+#define POWER_CTL_LINK      BIT(5)
+#define POWER_CTL_MEASURE   BIT(3)
+
+// DATA_FORMAT fields
+#define DATA_FORMAT_FULL_RES    BIT(3)
+#define DATA_FORMAT_RANGE_MASK  0x03
+
+// Bus bits per sample: address, register and re-address bytes plus six
+//  data bytes, 9 bits each with ACK, and the start/stop conditions.
+#define ADXL345_BUS_BITS_PER_SAMPLE 84
+// Share of the I2C bus the sample stream may take, in percent
+#define ADXL345_BUS_BUDGET_PCT      75
+
+// INT_ENABLE / INT_MAP / INT_SOURCE bits
+#define INT_DATA_READY  BIT(7)
+#define INT_SINGLE_TAP  BIT(6)
+#define INT_DOUBLE_TAP  BIT(5)
+#define INT_ACTIVITY    BIT(4)
+#define INT_INACTIVITY  BIT(3)
+#define INT_FREE_FALL   BIT(2)
+#define INT_WATERMARK   BIT(1)
+#define INT_OVERRUN     BIT(0)
+
+// TAP_AXES / ACT_TAP_STATUS axis bits
+#define TAP_AXES_SUPPRESS       BIT(3)
+#define TAP_AXES_XYZ            0x07
+#define ACT_TAP_STATUS_ACT_X    BIT(6)
+#define ACT_TAP_STATUS_ACT_Y    BIT(5)
+#define ACT_TAP_STATUS_ACT_Z    BIT(4)
+#define ACT_TAP_STATUS_ASLEEP   BIT(3)
+#define ACT_TAP_STATUS_TAP_X    BIT(2)
+#define ACT_TAP_STATUS_TAP_Y    BIT(1)
+#define ACT_TAP_STATUS_TAP_Z    BIT(0)
+
+// ACT_INACT_CTL fields, activity in the upper nibble, inactivity in the lower
+#define ACT_INACT_CTL_ACT_AC    BIT(7)
+#define ACT_INACT_CTL_ACT_XYZ   0x70
+#define ACT_INACT_CTL_INACT_AC  BIT(3)
+#define ACT_INACT_CTL_INACT_XYZ 0x07
+
+// Event detector scale factors
+#define ADXL345_THRESH_UG_PER_LSB   62500   // THRESH_TAP/ACT/INACT/FF
+#define ADXL345_DUR_US_PER_LSB      625
+#define ADXL345_LATENT_US_PER_LSB   1250    // LATENT and WINDOW
+#define ADXL345_TIME_FF_MS_PER_LSB  5
+
+// FIFO_CTL / FIFO_STATUS fields
+#define FIFO_CTL_MODE_SHIFT      6
+#define FIFO_CTL_TRIGGER         BIT(5)
+#define FIFO_CTL_SAMPLES_MASK    0x1F
+#define FIFO_STATUS_TRIG         BIT(7)
+#define FIFO_STATUS_ENTRIES_MASK 0x3F
+
+// 32 FIFO levels plus the output registers
+#define ADXL345_FIFO_DEPTH         33
+// The samples field is 5 bits wide, so the watermark tops out at 31
+#define ADXL345_FIFO_WATERMARK_MAX 31
+
 struct adxl345_data
 {
     /* data */
@@ -77,11 +153,137 @@ struct adxl345_data
     int16_t z;
 };
 
+// Bytes per sample in DATAX0..DATAZ1
+#define ADXL345_SAMPLE_SIZE 6
+// Samples per bus transfer in adxl345_read_samples()
+#define ADXL345_READ_CHUNK  8
 
-enum {Aup = 1, Bup, Cup, Dup, Topup, Botup};
+BUILD_ASSERT(sizeof(struct adxl345_data) == ADXL345_SAMPLE_SIZE,
+             "adxl345_data must match the DATAX0..DATAZ1 layout");
+
+enum adxl345_fifo_mode {
+    ADXL345_FIFO_BYPASS = 0,
+    ADXL345_FIFO_FIFO,
+    ADXL345_FIFO_STREAM,
+    ADXL345_FIFO_TRIGGER,
+};
+
+// BW_RATE rate codes, ODR = 3200 Hz / 2^(15 - code)
+enum adxl345_odr {
+    ADXL345_ODR_0_10HZ = 0x0,
+    ADXL345_ODR_0_20HZ,
+    ADXL345_ODR_0_39HZ,
+    ADXL345_ODR_0_78HZ,
+    ADXL345_ODR_1_56HZ,
+    ADXL345_ODR_3_13HZ,
+    ADXL345_ODR_6_25HZ,
+    ADXL345_ODR_12_5HZ,
+    ADXL345_ODR_25HZ,
+    ADXL345_ODR_50HZ,
+    ADXL345_ODR_100HZ,
+    ADXL345_ODR_200HZ,
+    ADXL345_ODR_400HZ,
+    ADXL345_ODR_800HZ,
+    ADXL345_ODR_1600HZ,
+    ADXL345_ODR_3200HZ,
+};
+
+enum adxl345_range {
+    ADXL345_RANGE_2G = 0,
+    ADXL345_RANGE_4G,
+    ADXL345_RANGE_8G,
+    ADXL345_RANGE_16G,
+};
+
+struct adxl345_config {
+    uint8_t odr;            // enum adxl345_odr
+    bool low_power;         // only valid from 12.5 to 400 Hz
+    uint8_t range;          // enum adxl345_range
+    bool full_res;          // 4 mg/LSB at every range instead of 10 bits
+    uint8_t fifo_mode;      // enum adxl345_fifo_mode
+    uint8_t watermark;
+};
+
+#define ADXL345_CONFIG_DEFAULT {            \
+    .odr = ADXL345_ODR_100HZ,               \
+    .low_power = false,                     \
+    .range = ADXL345_RANGE_2G,              \
+    .full_res = false,                      \
+    .fifo_mode = ADXL345_FIFO_BYPASS,       \
+    .watermark = 0,                         \
+}
+
+// Event detectors, in physical units; adxl345_event_config() rounds them
+//  to the register resolution and saturates at the register maximum.
+struct adxl345_event_config {
+    uint16_t tap_thresh_mg;     // 0 disables tap detection
+    uint16_t tap_dur_us;        // longest contact that still counts as a tap
+    uint16_t tap_latent_ms;     // dead time before the second tap window
+    uint16_t tap_window_ms;     // 0 disables double tap
+    uint16_t act_thresh_mg;     // 0 disables activity detection
+    uint16_t inact_thresh_mg;   // 0 disables inactivity detection
+    uint8_t inact_time_s;
+    uint16_t ff_thresh_mg;      // 0 disables free-fall detection
+    uint16_t ff_time_ms;
+};
+
+// Values from the datasheet application notes: a firm tap, 0.5 g of
+//  AC-coupled motion, 5 s of rest and a 150 ms drop.
+#define ADXL345_EVENT_CONFIG_DEFAULT {      \
+    .tap_thresh_mg = 3000,                  \
+    .tap_dur_us = 10000,                    \
+    .tap_latent_ms = 100,                   \
+    .tap_window_ms = 250,                   \
+    .act_thresh_mg = 500,                   \
+    .inact_thresh_mg = 188,                 \
+    .inact_time_s = 5,                      \
+    .ff_thresh_mg = 375,                    \
+    .ff_time_ms = 150,                      \
+}
+
+// INT_SOURCE bits raised by the event detectors
+#define INT_EVENTS  (INT_SINGLE_TAP | INT_DOUBLE_TAP | INT_ACTIVITY | INT_INACTIVITY | INT_FREE_FALL)
+
+// Which face points up: A..D are the +X, -X, +Y and -Y edges, Top and Bot
+//  the +Z and -Z faces.
+enum adxl345_orientation {Aup = 1, Bup, Cup, Dup, Topup, Botup};
 
 int adxl345_init(const struct device *dev_i2c);
+
+/* Runtime configuration. adxl345_check_config() returns -EINVAL for an
+ * invalid combination and -ENOTSUP when the I2C bus at bus_hz can't keep
+ * up with the ODR. adxl345_configure() checks against the devicetree bus
+ * speed, then reprograms the device from standby. If that fails partway
+ * it reprograms the previous configuration before returning the error. */
+int adxl345_check_config(const struct adxl345_config *cfg, uint32_t bus_hz);
+int adxl345_configure(const struct device *dev_i2c, const struct adxl345_config *cfg);
+void adxl345_get_config(struct adxl345_config *cfg);
+uint32_t adxl345_odr_mhz(uint8_t odr);
 int readXYZ(const struct device *dev_i2c, struct adxl345_data *adxl345_data);
+int adxl345_read_samples(const struct device *dev_i2c, struct adxl345_data *samples, size_t count);
+
+/* FIFO streaming. adxl345_fifo_config() takes a watermark of
+ * 1..ADXL345_FIFO_WATERMARK_MAX entries (ignored in bypass mode).
+ * adxl345_fifo_drain() reads FIFO_STATUS once, then pulls every queued
+ * entry (at most max) in one burst and returns how many were stored, or
+ * a negative error code. */
+int adxl345_fifo_config(const struct device *dev_i2c, enum adxl345_fifo_mode mode, uint8_t watermark);
+int adxl345_fifo_entries(const struct device *dev_i2c, uint8_t *entries);
+int adxl345_fifo_drain(const struct device *dev_i2c, struct adxl345_data *samples, size_t max);
+
+/* Interrupts. Bits set in int2_map go to INT2, the rest of enable goes to
+ * INT1. Reading INT_SOURCE clears the latched event bits. */
+int adxl345_int_config(const struct device *dev_i2c, uint8_t enable, uint8_t int2_map);
+int adxl345_int_source(const struct device *dev_i2c, uint8_t *source);
+
+/* Event detectors. adxl345_event_config() returns the INT_EVENTS bits
+ * that the configuration enables (for adxl345_int_config()) or a negative
+ * error code. adxl345_event_status() reads ACT_TAP_STATUS and INT_SOURCE
+ * in one burst, in the order the datasheet asks for, and so also clears
+ * the latched event bits. With both activity and inactivity enabled the
+ * detectors are linked, so each fires once per change of state. */
+int adxl345_event_config(const struct device *dev_i2c, const struct adxl345_event_config *cfg);
+int adxl345_event_status(const struct device *dev_i2c, uint8_t *act_tap_status, uint8_t *source);
 void adxl345_main_loop();
 
 #endif
\ No newline at end of file
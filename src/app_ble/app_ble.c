@@ -0,0 +1,512 @@
+#include "app_ble.h"
+#include "remote.h"
+#include "acquisition.h"
+#include "sample_ring.h"
+#include "link_tuning.h"
+#include "dsp_filter.h"
+#include "accel_features.h"
+#include "accel_events.h"
+#include "flash_log.h"
+#include "time_sync.h"
+#include "msg_proto.h"
+
+#include <bluetooth/services/bas.h>
+#include <dk_buttons_and_leds.h>
+#include <sys/byteorder.h>
+#include <logging/log.h>
+
+#define LOG_MODULE_NAME app_ble
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+/* Message characteristic record types, see msg_proto.h for the framing.
+ * Values and replies are listed after each type. */
+#define MSG_SET_ACCEL_CONFIG        0x01    /* odr, range, flags, watermark */
+#define MSG_ACCEL_FLAG_FULL_RES     BIT(0)
+#define MSG_ACCEL_FLAG_LOW_POWER    BIT(1)
+#define MSG_SET_FILTER              0x02    /* lowpass Hz (le16), highpass Hz (le16), decimation log2 */
+#define MSG_LOG_DOWNLOAD            0x03    /* stream the flash log over L2CAP */
+#define MSG_LOG_ERASE               0x04
+#define MSG_TIME_SYNC               0x05    /* seq, host send time (le64), host receive time of the previous reply (le64) */
+#define MSG_TIME_SYNC_REPLY_LEN     13      /* seq, device receive time (le64), reply delay (le32) */
+#define MSG_TIME_SYNC_STATUS        0x06
+#define MSG_TIME_SYNC_STATUS_REPLY_LEN 25   /* synced, offset (le64), ref (le64), skew ppb (le32), delay (le32) */
+#define MSG_STREAM                  0x07    /* 1 to stream, 0 to stop, optional frame format */
+#define MSG_GET_STATS               0x08
+#define MSG_GET_STATS_REPLY_LEN     28      /* samples, bus errors, ring overruns, frames, samples sent,
+                                             * samples dropped (le32 each), clock drift ppm (le32) */
+#define MSG_LOG_CAPTURE             0x09    /* sample budget (le32), 0 stops, 0xffffffff until the log is full */
+
+#define CONN_STATUS_LED DK_LED2
+
+static atomic_t conn_count;
+SAMPLE_RING_DEFINE(sample_ring, SAMPLE_RING_CAPACITY);
+
+/* Filter changes are applied by the acquisition thread between batches,
+ * like acquisition_configure() does with the sensor settings */
+static K_MSGQ_DEFINE(filter_msgq, sizeof(struct dsp_filter_config), 1, 4);
+
+/* Time sync exchange waiting for the host receive time of its reply,
+ * which comes with the next request. The model follows the host that
+ * last synced, sync_conn. */
+static struct bt_conn *sync_conn;
+static struct time_sync_exchange sync_pending;
+static uint8_t sync_pending_seq;
+static bool sync_pending_valid;
+
+/* Passed to the command handlers */
+struct msg_context {
+    struct bt_conn *conn;
+    uint64_t received;      // device time the write came in
+};
+
+/* Runs on the acquisition thread, ahead of the batch it filters first */
+static void apply_filter(const struct dsp_filter_config *filter)
+{
+    struct adxl345_config cfg;
+    int err;
+
+    acquisition_get_config(&cfg);
+    err = dsp_filter_configure(filter, adxl345_odr_mhz(cfg.odr));
+    if (err) {
+        /* The ODR changed since the command was checked */
+        LOG_WRN("Filter doesn't fit the current ODR (err %d)", err);
+        return;
+    }
+    set_adxl345_stream_odr(dsp_filter_output_odr(cfg.odr));
+    LOG_INF("Filter LP %u mHz, HP %u mHz, decimation %u", filter->lowpass_mhz,
+            filter->highpass_mhz, BIT(filter->decimation_log2));
+}
+
+void app_ble_on_samples(const struct adxl345_data *samples, size_t count,
+                        const struct sample_time *time)
+{
+    struct dsp_filter_config filter;
+
+    if (k_msgq_get(&filter_msgq, &filter, K_NO_WAIT) == 0) {
+        apply_filter(&filter);
+    }
+
+    /* Never blocks; samples that don't fit are counted as overruns */
+    dsp_filter_put(&sample_ring, samples, count, time);
+    adxl345_stream_kick();
+
+    if (features_notifications_enabled()) {
+        accel_features_feed(samples, count, time);
+    }
+}
+
+/* Runs on the features thread once per analysed window */
+static void on_features(const struct accel_features_frame *frame)
+{
+    int err = send_features_notification(frame);
+
+    if (err && err != -ENOTCONN) {
+        LOG_DBG("Couldn't send features (err %d)", err);
+    }
+}
+
+/* Runs on the system work queue for each accelerometer event */
+static void on_accel_event(const struct accel_event *event)
+{
+    int err;
+
+    LOG_INF("Accelerometer event %u (detail 0x%02x)", event->type, event->detail);
+
+    err = send_event_notification(event);
+    if (err && err != -ENOTCONN) {
+        LOG_WRN("Couldn't send event (err %d)", err);
+    }
+}
+
+static void on_connected(struct bt_conn *conn, uint8_t err)
+{
+    if (err) {
+        LOG_ERR("connection err: %d", err);
+        return;
+    }
+    LOG_INF("Connected %p.", (void *)conn);
+
+    atomic_inc(&conn_count);
+    dk_set_led_on(CONN_STATUS_LED);
+    /* Make everything logged so far downloadable */
+    flash_log_flush();
+}
+
+static void on_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    LOG_INF("Disconnected %p (reason: %d)", (void *)conn, reason);
+    if (atomic_dec(&conn_count) == 1) {
+        dk_set_led_off(CONN_STATUS_LED);
+    }
+
+    if (conn == sync_conn) {
+        bt_conn_unref(sync_conn);
+        sync_conn = NULL;
+        sync_pending_valid = false;
+    }
+}
+
+/* Each central gets the connection parameters for what it takes */
+static void on_notif_changed(struct bt_conn *conn, enum bt_button_notifications_enabled status)
+{
+    if (status == BT_BUTTON_NOTIFICATIONS_ENABLED) {
+        link_tuning_set_profile(conn, LINK_PROFILE_STREAMING);
+    } else {
+        link_tuning_set_profile(conn, LINK_PROFILE_LOW_POWER);
+    }
+}
+
+/* Runs on the acquisition thread once the sensor runs with cfg, ahead of
+ * the first sample taken with it. So the filter, the stream rate and the
+ * feature windows switch exactly there, not while samples taken at the
+ * old rate are still in the FIFO and the ring. */
+static void on_accel_config(const struct adxl345_config *cfg)
+{
+    struct dsp_filter_config filter;
+    int err;
+
+    /* The filter is designed for the sample rate, so redo it */
+    dsp_filter_get_config(&filter);
+    err = dsp_filter_configure(&filter, adxl345_odr_mhz(cfg->odr));
+    if (err) {
+        LOG_WRN("Filter doesn't fit the new ODR, bypassing it");
+        dsp_filter_configure(&DSP_FILTER_CONFIG_BYPASS, adxl345_odr_mhz(cfg->odr));
+    }
+    set_adxl345_stream_odr(dsp_filter_output_odr(cfg->odr));
+    accel_features_set_odr(cfg->odr);
+    LOG_INF("Accelerometer ODR %u mHz, range %u", adxl345_odr_mhz(cfg->odr), cfg->range);
+}
+
+static int cmd_set_accel_config(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    struct adxl345_config cfg = {
+        .odr = value[0],
+        .range = value[1],
+        .full_res = value[2] & MSG_ACCEL_FLAG_FULL_RES,
+        .low_power = value[2] & MSG_ACCEL_FLAG_LOW_POWER,
+        .watermark = value[3],
+    };
+    int err;
+
+    /* on_accel_config() follows once the acquisition thread applied it */
+    err = acquisition_configure(&cfg);
+    if (err) {
+        LOG_WRN("Rejected accelerometer config (err %d)", err);
+    }
+    return err;
+}
+
+static int cmd_set_filter(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    struct dsp_filter_config filter = {
+        .lowpass_mhz = sys_get_le16(&value[0]) * 1000U,
+        .highpass_mhz = sys_get_le16(&value[2]) * 1000U,
+        .decimation_log2 = value[4],
+    };
+    struct adxl345_config cfg;
+    int err;
+
+    acquisition_get_config(&cfg);
+    err = dsp_filter_check_config(&filter, adxl345_odr_mhz(cfg.odr));
+    if (err) {
+        LOG_WRN("Rejected filter config (err %d)", err);
+        return err;
+    }
+
+    /* apply_filter() follows with the next batch. Only the latest
+     * request matters. */
+    k_msgq_purge(&filter_msgq);
+    return k_msgq_put(&filter_msgq, &filter, K_NO_WAIT);
+}
+
+static int cmd_log_download(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    int err;
+
+    err = flash_log_download_start();
+    if (err == 0) {
+        err = adxl345_backlog_download(flash_log_download_next);
+    }
+    if (err) {
+        LOG_WRN("Couldn't start the log download (err %d)", err);
+    }
+    return err;
+}
+
+static int cmd_log_capture(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    uint32_t max_samples = sys_get_le32(&value[0]);
+    int err;
+
+    err = flash_log_capture(max_samples);
+    if (err) {
+        LOG_WRN("Couldn't arm the log capture (err %d)", err);
+        return err;
+    }
+    LOG_INF("Sample log capture %s, budget %u", max_samples ? "armed" : "stopped", max_samples);
+    return 0;
+}
+
+static int cmd_log_erase(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    int err;
+
+    err = flash_log_erase();
+    if (err) {
+        LOG_WRN("Couldn't erase the log (err %d)", err);
+    }
+    return err;
+}
+
+static int cmd_time_sync(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    const struct msg_context *msg = ctx;
+    uint8_t seq = value[0];
+    uint64_t t4 = sys_get_le64(&value[9]);
+    int err;
+
+    if (msg->conn != sync_conn) {
+        /* Another host, with another epoch */
+        if (sync_conn) {
+            bt_conn_unref(sync_conn);
+        }
+        sync_conn = bt_conn_ref(msg->conn);
+        sync_pending_valid = false;
+        time_sync_reset();
+    }
+
+    if (sync_pending_valid && t4 && seq == (uint8_t)(sync_pending_seq + 1)) {
+        sync_pending.t4 = t4;
+        err = time_sync_add(&sync_pending);
+        if (err) {
+            LOG_DBG("Dropped time sync exchange (err %d)", err);
+        }
+    }
+
+    sync_pending_seq = seq;
+    sync_pending.t1 = sys_get_le64(&value[1]);
+    sync_pending.t2 = msg->received;
+    sync_pending_valid = true;
+
+    reply[0] = seq;
+    sys_put_le64(msg->received, &reply[1]);
+
+    /* As late as possible; the rest of the delay until the connection
+     * event is part of the round trip */
+    sync_pending.t3 = time_sync_device_us();
+    sys_put_le32(sync_pending.t3 - msg->received, &reply[9]);
+    return MSG_TIME_SYNC_REPLY_LEN;
+}
+
+static int cmd_time_sync_status(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    struct time_sync_model model;
+
+    time_sync_get_model(&model);
+
+    reply[0] = model.synced;
+    sys_put_le64(model.offset_us, &reply[1]);
+    sys_put_le64(model.ref_us, &reply[9]);
+    sys_put_le32(model.skew_ppb, &reply[17]);
+    sys_put_le32(model.delay_us, &reply[21]);
+    return MSG_TIME_SYNC_STATUS_REPLY_LEN;
+}
+
+static int cmd_stream(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    const struct msg_context *msg = ctx;
+    enum adxl345_frame_format format = len > 1 ? value[1] : ADXL345_FRAME_DELTA;
+    int err;
+
+    err = set_adxl345_stream_mode(msg->conn, value[0] != 0, format);
+    if (err) {
+        LOG_WRN("Rejected stream mode (err %d)", err);
+        return err;
+    }
+    LOG_INF("Stream %s on %p, format %u", value[0] ? "started" : "stopped", (void *)msg->conn, format);
+    return 0;
+}
+
+static int cmd_get_stats(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    struct acquisition_stats acq;
+    struct sample_ring_stats ring;
+    struct adxl345_tx_stats tx;
+    struct sample_clock_stats clock;
+
+    acquisition_get_stats(&acq);
+    sample_ring_get_stats(&sample_ring, &ring);
+    get_adxl345_tx_stats(&tx);
+    sample_clock_get_stats(&clock);
+
+    sys_put_le32(acq.samples, &reply[0]);
+    sys_put_le32(acq.errors, &reply[4]);
+    sys_put_le32(ring.overruns, &reply[8]);
+    sys_put_le32(tx.frames_sent, &reply[12]);
+    sys_put_le32(tx.samples_sent, &reply[16]);
+    sys_put_le32(tx.dropped, &reply[20]);
+    sys_put_le32(clock.drift_ppm, &reply[24]);
+    return MSG_GET_STATS_REPLY_LEN;
+}
+
+/* Indexed by record type */
+static const struct msg_command commands[] = {
+    [MSG_SET_ACCEL_CONFIG] = { cmd_set_accel_config, 4, 4 },
+    [MSG_SET_FILTER] = { cmd_set_filter, 5, 5 },
+    [MSG_LOG_DOWNLOAD] = { cmd_log_download, 0, 0 },
+    [MSG_LOG_ERASE] = { cmd_log_erase, 0, 0 },
+    [MSG_TIME_SYNC] = { cmd_time_sync, 17, 17 },
+    [MSG_TIME_SYNC_STATUS] = { cmd_time_sync_status, 0, 0 },
+    [MSG_STREAM] = { cmd_stream, 1, 2 },
+    [MSG_GET_STATS] = { cmd_get_stats, 0, 0 },
+    [MSG_LOG_CAPTURE] = { cmd_log_capture, 4, 4 },
+};
+
+BUILD_ASSERT(MSG_TIME_SYNC_STATUS_REPLY_LEN <= MSG_REPLY_MAX &&
+             MSG_GET_STATS_REPLY_LEN <= MSG_REPLY_MAX, "command reply too long");
+/* Errors the handlers pass on from the config, filter, log and stream calls */
+BUILD_ASSERT(MSG_STATUS_FITS(EINVAL) && MSG_STATUS_FITS(ENOTSUP) && MSG_STATUS_FITS(ENOMSG) &&
+             MSG_STATUS_FITS(ENODEV) && MSG_STATUS_FITS(ENOTCONN) && MSG_STATUS_FITS(EIO) &&
+             MSG_STATUS_FITS(EMSGSIZE), "handler errno doesn't fit the reply status");
+
+static void send_reply(const uint8_t *reply, uint16_t len, void *ctx)
+{
+    const struct msg_context *msg = ctx;
+    int err;
+
+    err = send_message_notification(msg->conn, reply, len);
+    if (err && err != -ENOTCONN) {
+        LOG_WRN("Couldn't send reply to 0x%02x (err %d)", reply[0] & ~MSG_REPLY_FLAG, err);
+    }
+}
+
+static void on_data_received(struct bt_conn *conn, const uint8_t *const data, uint16_t len)
+{
+    /* First, so time sync requests are stamped before any other work */
+    struct msg_context msg = {
+        .conn = conn,
+        .received = time_sync_device_us(),
+    };
+    int ret;
+
+    LOG_DBG("Received data on conn %p. Len: %d", (void *)conn, len);
+    LOG_HEXDUMP_DBG(data, len, "Data:");
+
+    ret = msg_dispatch(commands, ARRAY_SIZE(commands), data, len, send_reply, &msg);
+    if (ret < 0) {
+        LOG_WRN("Malformed command write (err %d)", ret);
+    }
+}
+
+/* Runs on the system work queue. The phone went away mid-stream, so keep
+ * what follows until it comes back or the log is full. */
+static void on_stream_lost(void)
+{
+    int err;
+
+    err = flash_log_capture(FLASH_LOG_CAPTURE_UNTIL_FULL);
+    if (err) {
+        LOG_WRN("Couldn't arm the log capture (err %d)", err);
+        return;
+    }
+    LOG_INF("Stream lost, sample log capture armed");
+}
+
+static struct bt_conn_cb bluetooth_callbacks = {
+    .connected = on_connected,
+    .disconnected = on_disconnected,
+};
+
+static struct bt_remote_service_cb remote_service_callbacks = {
+    .notif_changed = on_notif_changed,
+    .data_received = on_data_received,
+    .stream_lost = on_stream_lost,
+};
+
+static void button_handler(uint32_t button_state, uint32_t has_changed)
+{
+    uint8_t button_pressed = 0;
+    int err;
+
+    if (has_changed & button_state) {
+        switch (has_changed) {
+        case DK_BTN1_MSK:
+            button_pressed = 1;
+            break;
+        case DK_BTN2_MSK:
+            button_pressed = 2;
+            break;
+        case DK_BTN3_MSK:
+            button_pressed = 3;
+            break;
+        case DK_BTN4_MSK:
+            button_pressed = 4;
+            break;
+        default:
+            break;
+        }
+        LOG_INF("Button %d pressed.", button_pressed);
+        set_button_value(button_pressed);
+        /* To every subscribed connection */
+        err = send_button_notification(NULL, &button_pressed, 1);
+        if (err) {
+            LOG_WRN("Couldn't send notificaton. (err: %d)", err);
+        }
+    }
+}
+
+void app_ble_on_battery(const struct battery_state *state)
+{
+    /* Notifies subscribers only when the level changes */
+    bt_bas_set_battery_level(state->soc);
+}
+
+enum app_ble_link app_ble_link(void)
+{
+    if (adxl345_stream_subscribers() > 0) {
+        return APP_BLE_STREAMING;
+    }
+    return atomic_get(&conn_count) > 0 ? APP_BLE_CONNECTED : APP_BLE_DISCONNECTED;
+}
+
+int app_ble_init(void)
+{
+    struct adxl345_config cfg;
+    int err;
+
+    err = dk_buttons_init(button_handler);
+    if (err) {
+        LOG_ERR("Couldn't init buttons (err %d)", err);
+    }
+
+    err = bluetooth_init(&bluetooth_callbacks, &remote_service_callbacks);
+    if (err) {
+        LOG_ERR("Couldn't initialize Bluetooth. err: %d", err);
+        return err;
+    }
+
+    /* Valid before acquisition starts, and fixed with the in-tree driver */
+    acquisition_get_config(&cfg);
+    set_adxl345_stream_source(&sample_ring, dsp_filter_output_odr(cfg.odr));
+    acquisition_set_config_handler(on_accel_config);
+
+    err = flash_log_init();
+    if (err) {
+        LOG_ERR("Couldn't open the sample log. err: %d", err);
+    } else {
+        set_adxl345_offline_sink(flash_log_append);
+    }
+
+    err = accel_events_init(on_accel_event);
+    if (err) {
+        LOG_ERR("Couldn't start the event engine. err: %d", err);
+    }
+
+    err = accel_features_init(on_features);
+    if (err) {
+        LOG_ERR("Couldn't start feature extraction. err: %d", err);
+    }
+    accel_features_set_odr(cfg.odr);
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __app_ble_h__
+#define __app_ble_h__
+
+#include <zephyr.h>
+#include "adxl345.h"
+#include "battery.h"
+#include "sample_clock.h"
+
+/* Bluetooth front end: the remote service, the filtered sample stream
+ * with its flash backlog, features and events, the message
+ * characteristic commands, the Battery Service and the DK buttons. */
+
+enum app_ble_link {
+    APP_BLE_DISCONNECTED,
+    APP_BLE_CONNECTED,
+    APP_BLE_STREAMING,      // a central takes the sample stream
+};
+
+int app_ble_init(void);
+
+/* Stream handler for app_sensor_init(), runs on the acquisition thread */
+void app_ble_on_samples(const struct adxl345_data *samples, size_t count,
+                        const struct sample_time *time);
+
+/* Battery handler for battery_init(), updates the Battery Service */
+void app_ble_on_battery(const struct battery_state *state);
+
+/* Of all connections together */
+enum app_ble_link app_ble_link(void);
+
+#endif
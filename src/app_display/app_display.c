@@ -0,0 +1,219 @@
+#include "app_display.h"
+#include "display_flush.h"
+
+#include <device.h>
+#include <drivers/display.h>
+#include <lvgl.h>
+#include <stdio.h>
+#include <string.h>
+#include <logging/log.h>
+
+#define LOG_MODULE_NAME app_display
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+#define FRAME_MS    (1000 / CONFIG_APP_DISPLAY_FPS)
+
+/* Redraws per case in the startup benchmark */
+#define BENCHMARK_FRAMES    20
+
+/* Text a label shows, compared before handing LVGL a new one */
+struct label {
+    lv_obj_t *obj;
+    char text[32];
+};
+
+static const struct device *display_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_display));
+
+static K_THREAD_STACK_DEFINE(display_stack, APP_DISPLAY_STACK_SIZE);
+static struct k_thread display_thread;
+static K_MSGQ_DEFINE(snapshot_msgq, sizeof(struct app_display_status), 1, 4);
+
+static struct label count_label;
+static struct label ble_status_label;
+static struct label battery_status_label;
+static struct app_display_stats stats;
+
+static void create_labels(void)
+{
+    lv_obj_t *hello_world_label;
+
+    hello_world_label = lv_label_create(lv_scr_act(), NULL);
+    lv_label_set_text(hello_world_label, "Hello world!");
+    lv_obj_align(hello_world_label, NULL, LV_ALIGN_CENTER, 0, 0);
+
+    battery_status_label.obj = lv_label_create(lv_scr_act(), NULL);
+    lv_obj_align(battery_status_label.obj, NULL, LV_ALIGN_IN_TOP_LEFT, 0, 20);
+
+    ble_status_label.obj = lv_label_create(lv_scr_act(), NULL);
+    lv_obj_align(ble_status_label.obj, NULL, LV_ALIGN_IN_TOP_LEFT, 0, 0);
+
+    count_label.obj = lv_label_create(lv_scr_act(), NULL);
+    lv_obj_align(count_label.obj, NULL, LV_ALIGN_IN_BOTTOM_LEFT, 0, 0);
+
+    /* Labels are created with placeholder text; start from blank */
+    lv_label_set_text_static(battery_status_label.obj, "");
+    lv_label_set_text_static(ble_status_label.obj, "");
+    lv_label_set_text_static(count_label.obj, "");
+}
+
+static void set_label(struct label *label, const char *text)
+{
+    if (strcmp(label->text, text) == 0) {
+        return;
+    }
+
+    strncpy(label->text, text, sizeof(label->text) - 1);
+    lv_label_set_text(label->obj, label->text);
+    stats.label_updates++;
+}
+
+static void render(const struct app_display_status *status)
+{
+    char text[sizeof(((struct label *)0)->text)];
+
+    if (status->battery.valid) {
+        snprintf(text, sizeof(text), "Bat: %u.%03uV %u%%", status->battery.voltage_mv / 1000,
+                 status->battery.voltage_mv % 1000, status->battery.soc);
+    } else {
+        text[0] = '\0';
+    }
+    set_label(&battery_status_label, text);
+
+    set_label(&ble_status_label, status->link ? status->link : "");
+
+    snprintf(text, sizeof(text), "X:%d,Y:%d,Z:%d",
+             status->accel_mg.x, status->accel_mg.y, status->accel_mg.z);
+    set_label(&count_label, text);
+}
+
+/* Lets the last transfer of a frame finish, so the bus is free and the
+ * frame time includes it */
+static void flush_wait(void)
+{
+    if (IS_ENABLED(CONFIG_APP_DISPLAY_ASYNC_FLUSH)) {
+        display_flush_wait();
+    }
+}
+
+/* Average time to redraw obj, including the transfer to the panel */
+static uint32_t time_redraws(lv_obj_t *obj)
+{
+    uint32_t start = k_cycle_get_32();
+
+    for (int i = 0; i < BENCHMARK_FRAMES; i++) {
+        lv_obj_invalidate(obj);
+        lv_refr_now(NULL);
+        flush_wait();
+    }
+
+    return k_cyc_to_us_floor32((k_cycle_get_32() - start) / BENCHMARK_FRAMES);
+}
+
+static void benchmark(void)
+{
+    uint32_t full_us, partial_us;
+
+    full_us = time_redraws(lv_scr_act());
+    partial_us = time_redraws(count_label.obj);
+    LOG_INF("Frame time: full screen %u us, one label %u us", full_us, partial_us);
+
+#if defined(CONFIG_APP_DISPLAY_ASYNC_FLUSH)
+    struct display_flush_stats flush;
+
+    display_flush_get_stats(&flush);
+    LOG_INF("Flush: %u transfers, %u bytes, setup %u us, waiting %u us", flush.flushes,
+            flush.bytes, k_cyc_to_us_floor32(flush.setup_cycles),
+            k_cyc_to_us_floor32(flush.wait_cycles));
+#endif
+}
+
+static void display_thread_fn(void *p1, void *p2, void *p3)
+{
+    struct app_display_status status;
+    int64_t next_frame = 0;
+    int64_t wait;
+    uint32_t start, cycles;
+    bool drawn;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    if (IS_ENABLED(CONFIG_APP_DISPLAY_ASYNC_FLUSH) && display_flush_init() != 0) {
+        LOG_WRN("Async flush unavailable, flushing synchronously");
+    }
+
+    create_labels();
+    lv_task_handler();
+    flush_wait();
+    display_blanking_off(display_dev);
+
+    if (IS_ENABLED(CONFIG_APP_DISPLAY_BENCHMARK)) {
+        benchmark();
+    }
+
+    while (1) {
+        drawn = false;
+
+        /* LVGL's own timers still need servicing when nothing changes */
+        if (k_msgq_get(&snapshot_msgq, &status, K_MSEC(APP_DISPLAY_IDLE_MS)) == 0) {
+            wait = next_frame - k_uptime_get();
+            if (wait > 0) {
+                k_msleep(wait);
+                /* Draw whatever is newest once the frame slot opens */
+                k_msgq_get(&snapshot_msgq, &status, K_NO_WAIT);
+            }
+            next_frame = k_uptime_get() + FRAME_MS;
+
+            start = k_cycle_get_32();
+            render(&status);
+            drawn = true;
+        }
+
+        lv_task_handler();
+        flush_wait();
+
+        if (drawn) {
+            cycles = k_cycle_get_32() - start;
+            stats.frames++;
+            stats.last_cycles = cycles;
+            stats.max_cycles = MAX(stats.max_cycles, cycles);
+        }
+    }
+}
+
+void app_display_update(const struct app_display_status *status)
+{
+    stats.snapshots++;
+
+    /* Only the latest snapshot matters */
+    if (k_msgq_num_used_get(&snapshot_msgq) > 0) {
+        k_msgq_purge(&snapshot_msgq);
+        stats.coalesced++;
+    }
+    k_msgq_put(&snapshot_msgq, status, K_NO_WAIT);
+}
+
+void app_display_get_stats(struct app_display_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
+
+int app_display_init(void)
+{
+    if (!device_is_ready(display_dev)) {
+        LOG_ERR("Display not ready");
+        return -ENODEV;
+    }
+
+    k_thread_create(&display_thread, display_stack,
+                    K_THREAD_STACK_SIZEOF(display_stack),
+                    display_thread_fn, NULL, NULL, NULL,
+                    APP_DISPLAY_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&display_thread, "display");
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef __app_display_h__
+#define __app_display_h__
+
+#include <zephyr.h>
+#include "adxl345.h"
+#include "battery.h"
+
+/* Status screen on the LVGL display: link state, battery and the latest
+ * reading.
+ *
+ * LVGL runs on its own low priority thread so SPI transfers to the panel
+ * never hold up acquisition or the radio. Producers post snapshots,
+ * which never block and replace one that hasn't been drawn yet. The
+ * thread redraws at most CONFIG_APP_DISPLAY_FPS times a second and only
+ * touches labels whose text changed, so LVGL only invalidates what
+ * differs. */
+
+#define APP_DISPLAY_STACK_SIZE      2048
+#define APP_DISPLAY_PRIORITY        K_PRIO_PREEMPT(14)
+
+/** @brief Longest gap between LVGL task handler runs without new data. **/
+#define APP_DISPLAY_IDLE_MS         100
+
+struct app_display_status {
+    const char *link;               // static string, NULL leaves the line blank
+    struct battery_state battery;
+    struct adxl345_data accel_mg;
+};
+
+struct app_display_stats {
+    uint32_t snapshots;         // snapshots posted
+    uint32_t coalesced;         // replaced before they were drawn
+    uint32_t frames;            // snapshots drawn
+    uint32_t label_updates;     // labels whose text changed
+    uint32_t last_cycles;       // label updates plus LVGL flush of the last frame
+    uint32_t max_cycles;
+};
+
+int app_display_init(void);
+
+/* Posts a snapshot for the render thread */
+void app_display_update(const struct app_display_status *status);
+void app_display_get_stats(struct app_display_stats *stats);
+
+#endif
@@ -0,0 +1,52 @@
+#include "app_sensor.h"
+#include "accel_conv.h"
+
+#include <logging/log.h>
+
+#define LOG_MODULE_NAME app_sensor
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+static acquisition_handler_t stream_handler;
+static struct adxl345_data latest_sample;
+
+/* Runs on the acquisition thread once per batch */
+static void on_samples(const struct adxl345_data *samples, size_t count,
+                       const struct sample_time *time)
+{
+    unsigned int key;
+
+    if (stream_handler) {
+        stream_handler(samples, count, time);
+    }
+
+    key = irq_lock();
+    latest_sample = samples[count - 1];
+    irq_unlock(key);
+}
+
+void app_sensor_latest_mg(struct adxl345_data *mg)
+{
+    struct adxl345_config cfg;
+    unsigned int key;
+
+    key = irq_lock();
+    *mg = latest_sample;
+    irq_unlock(key);
+
+    acquisition_get_config(&cfg);
+    accel_convert_mg(mg, mg, 1, ACCEL_CONV_SCALE_Q8(cfg.full_res ? 0 : cfg.range));
+}
+
+int app_sensor_init(acquisition_handler_t stream)
+{
+    int err;
+
+    stream_handler = stream;
+
+    err = acquisition_init(on_samples);
+    if (err) {
+        LOG_ERR("Couldn't start %s acquisition (err %d)",
+                DT_LABEL(DT_INST(0, adi_adxl345)), err);
+    }
+    return err;
+}
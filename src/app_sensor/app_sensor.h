@@ -0,0 +1,19 @@
+#ifndef __app_sensor_h__
+#define __app_sensor_h__
+
+#include <zephyr.h>
+#include "adxl345.h"
+#include "acquisition.h"
+
+/* Accelerometer front end shared by every application variant.
+ *
+ * Starts acquisition with whichever driver the build selected, keeps the
+ * latest sample for the display and the log, and hands every batch on to
+ * the stream handler when one is given. */
+
+int app_sensor_init(acquisition_handler_t stream);
+
+/* Latest sample in mg */
+void app_sensor_latest_mg(struct adxl345_data *mg);
+
+#endif
@@ -0,0 +1,150 @@
+#include "battery.h"
+#include "i2c_bus.h"
+
+#include <drivers/sensor.h>
+#include <logging/log.h>
+
+#define LOG_MODULE_NAME battery
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+#if !DT_HAS_COMPAT_STATUS_OKAY(ti_bq274xx)
+#error "No ti,bq274xx compatible node found in the device tree"
+#endif
+
+static const struct device *gauge = DEVICE_DT_GET(DT_INST(0, ti_bq274xx));
+static const struct device *gauge_bus = DEVICE_DT_GET(DT_BUS(DT_INST(0, ti_bq274xx)));
+
+static K_THREAD_STACK_DEFINE(battery_stack, BATTERY_STACK_SIZE);
+static struct k_thread battery_thread;
+
+static battery_handler_t battery_handler;
+static struct battery_state cache;
+static int64_t updated;
+static struct battery_stats stats;
+
+/* sensor_value in base units to thousandths */
+static int32_t milli(const struct sensor_value *val)
+{
+    return val->val1 * 1000 + val->val2 / 1000;
+}
+
+static int read_channel(enum sensor_channel chan, struct sensor_value *val)
+{
+    int err;
+
+    /* The driver talks to the bus itself, so take it for one channel at
+     * a time and let queued accelerometer transfers in between */
+    i2c_bus_acquire(gauge_bus);
+    err = sensor_sample_fetch_chan(gauge, chan);
+    i2c_bus_release(gauge_bus);
+    if (err) {
+        return err;
+    }
+    return sensor_channel_get(gauge, chan, val);
+}
+
+static int read_gauge(struct battery_state *state)
+{
+    struct sensor_value val;
+    int err;
+
+    err = read_channel(SENSOR_CHAN_GAUGE_VOLTAGE, &val);
+    if (err) {
+        return err;
+    }
+    state->voltage_mv = milli(&val);
+
+    err = read_channel(SENSOR_CHAN_GAUGE_STATE_OF_CHARGE, &val);
+    if (err) {
+        return err;
+    }
+    state->soc = CLAMP(val.val1, 0, 100);
+
+    err = read_channel(SENSOR_CHAN_GAUGE_AVG_CURRENT, &val);
+    if (err) {
+        return err;
+    }
+    state->current_ma = CLAMP(milli(&val), INT16_MIN, INT16_MAX);
+
+    err = read_channel(SENSOR_CHAN_GAUGE_TEMP, &val);
+    if (err) {
+        return err;
+    }
+    state->temp_dc = val.val1 * 10 + val.val2 / 100000;
+
+    state->valid = true;
+    return 0;
+}
+
+static void battery_thread_fn(void *p1, void *p2, void *p3)
+{
+    struct battery_state state;
+    uint32_t start, cycles;
+    unsigned int key;
+    int err;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1) {
+        start = k_cycle_get_32();
+        err = read_gauge(&state);
+        cycles = k_cycle_get_32() - start;
+
+        stats.reads++;
+        stats.last_cycles = cycles;
+        stats.max_cycles = MAX(stats.max_cycles, cycles);
+
+        if (err) {
+            stats.errors++;
+            LOG_WRN("Couldn't read the fuel gauge (err %d)", err);
+        } else {
+            key = irq_lock();
+            cache = state;
+            updated = k_uptime_get();
+            irq_unlock(key);
+
+            LOG_DBG("%u mV, %u %%, %d mA", state.voltage_mv, state.soc, state.current_ma);
+            if (battery_handler) {
+                battery_handler(&state);
+            }
+        }
+
+        k_sleep(K_MSEC(BATTERY_INTERVAL_MS));
+    }
+}
+
+void battery_get(struct battery_state *state)
+{
+    unsigned int key = irq_lock();
+
+    *state = cache;
+    state->age_ms = state->valid ? (uint32_t)(k_uptime_get() - updated) : 0;
+    irq_unlock(key);
+}
+
+void battery_get_stats(struct battery_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
+
+int battery_init(battery_handler_t handler)
+{
+    if (!device_is_ready(gauge)) {
+        LOG_ERR("Could not get %s device", DT_LABEL(DT_INST(0, ti_bq274xx)));
+        return -ENODEV;
+    }
+    battery_handler = handler;
+
+    k_thread_create(&battery_thread, battery_stack,
+                    K_THREAD_STACK_SIZEOF(battery_stack),
+                    battery_thread_fn, NULL, NULL, NULL,
+                    BATTERY_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&battery_thread, "battery");
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef __battery_h__
+#define __battery_h__
+
+#include <zephyr.h>
+
+/* BQ274xx fuel gauge service.
+ *
+ * A low priority thread samples voltage, state of charge, average current
+ * and temperature every BATTERY_INTERVAL_MS and caches them; readers only
+ * ever see the cache. The gauge shares the I2C bus with the ADXL345 and
+ * holds it through i2c_bus_acquire() for one channel at a time, so
+ * acquisition waits for at most one channel read. How long that takes
+ * shows up as max_hold_cycles in the i2c_bus stats. Failed reads keep
+ * the previous values. */
+
+#define BATTERY_INTERVAL_MS     30000
+
+#define BATTERY_STACK_SIZE      1024
+#define BATTERY_PRIORITY        K_PRIO_PREEMPT(13)
+
+struct battery_state {
+    bool valid;             // false until the first good read
+    uint16_t voltage_mv;
+    uint8_t soc;            // state of charge, percent
+    int16_t current_ma;     // average, negative while discharging
+    int16_t temp_dc;        // tenths of a degree Celsius
+    uint32_t age_ms;        // since the last good read, filled in by battery_get()
+};
+
+struct battery_stats {
+    uint32_t reads;
+    uint32_t errors;
+    uint32_t last_cycles;   // duration of the last gauge read
+    uint32_t max_cycles;
+};
+
+/** @brief Called from the battery thread after every good read. **/
+typedef void (*battery_handler_t)(const struct battery_state *state);
+
+int battery_init(battery_handler_t handler);
+void battery_get(struct battery_state *state);
+void battery_get_stats(struct battery_stats *stats);
+
+#endif
@@ -0,0 +1,143 @@
+#include "accel_codec.h"
+
+#include <errno.h>
+
+static inline uint16_t zigzag_encode(int16_t v)
+{
+    return (uint16_t)(((uint16_t)v << 1) ^ (uint16_t)(v >> 15));
+}
+
+static inline int16_t zigzag_decode(uint16_t v)
+{
+    return (int16_t)((v >> 1) ^ (uint16_t)-(int16_t)(v & 1));
+}
+
+static size_t varint_put(uint16_t v, uint8_t *out)
+{
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+static size_t varint_get(const uint8_t *in, size_t len, uint16_t *v)
+{
+    uint32_t acc = 0;
+
+    for (size_t n = 0; n < len && n < 3; n++) {
+        acc |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            if (acc > UINT16_MAX) {
+                return 0;
+            }
+            *v = (uint16_t)acc;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+void accel_codec_enc_init(struct accel_codec_enc *enc, uint16_t keyframe_interval)
+{
+    enc->prev[0] = enc->prev[1] = enc->prev[2] = 0;
+    enc->keyframe_interval = keyframe_interval;
+    enc->since_key = 0;
+    enc->key_pending = true;
+    enc->key_sample = false;
+}
+
+void accel_codec_force_keyframe(struct accel_codec_enc *enc)
+{
+    enc->key_pending = true;
+}
+
+size_t accel_codec_begin_block(struct accel_codec_enc *enc, uint8_t *out)
+{
+    bool key = enc->key_pending || enc->since_key >= enc->keyframe_interval;
+
+    out[0] = key ? ACCEL_CODEC_FLAG_KEYFRAME : 0;
+    if (key) {
+        enc->key_pending = false;
+        enc->key_sample = true;
+        enc->since_key = 0;
+    }
+    return ACCEL_CODEC_BLOCK_HEADER_LEN;
+}
+
+size_t accel_codec_encode(struct accel_codec_enc *enc, const int16_t xyz[3], uint8_t *out)
+{
+    size_t n = 0;
+
+    for (int i = 0; i < 3; i++) {
+        /* Deltas wrap modulo 2^16, which the decoder undoes */
+        int16_t v = enc->key_sample ? xyz[i] : (int16_t)(xyz[i] - enc->prev[i]);
+
+        n += varint_put(zigzag_encode(v), out + n);
+        enc->prev[i] = xyz[i];
+    }
+
+    enc->key_sample = false;
+    if (enc->since_key < UINT16_MAX) {
+        enc->since_key++;
+    }
+    return n;
+}
+
+void accel_codec_dec_init(struct accel_codec_dec *dec)
+{
+    dec->prev[0] = dec->prev[1] = dec->prev[2] = 0;
+    dec->synced = false;
+}
+
+int accel_codec_decode_block(struct accel_codec_dec *dec, const uint8_t *in, size_t len,
+                             bool contiguous, int16_t (*out)[3], size_t max)
+{
+    size_t pos = ACCEL_CODEC_BLOCK_HEADER_LEN;
+    size_t count = 0;
+    bool key;
+
+    if (len < ACCEL_CODEC_BLOCK_HEADER_LEN) {
+        return -EBADMSG;
+    }
+    key = in[0] & ACCEL_CODEC_FLAG_KEYFRAME;
+
+    if (!contiguous) {
+        dec->synced = false;
+    }
+    if (!key && !dec->synced) {
+        return -EAGAIN;
+    }
+
+    while (pos < len) {
+        if (count == max) {
+            /* prev has moved part way into the block */
+            dec->synced = false;
+            return -EBADMSG;
+        }
+        for (int i = 0; i < 3; i++) {
+            uint16_t zz;
+            size_t n = varint_get(in + pos, len - pos, &zz);
+
+            if (n == 0) {
+                dec->synced = false;
+                return -EBADMSG;
+            }
+            pos += n;
+
+            if (key && count == 0) {
+                out[count][i] = zigzag_decode(zz);
+            } else {
+                out[count][i] = (int16_t)(dec->prev[i] + zigzag_decode(zz));
+            }
+            dec->prev[i] = out[count][i];
+        }
+        count++;
+    }
+
+    dec->synced = true;
+    return count;
+}
@@ -0,0 +1,54 @@
+#ifndef __accel_codec_h__
+#define __accel_codec_h__
+
+/* Delta codec for the accelerometer stream.
+ *
+ * Plain C with no Zephyr dependencies so the decoder can be built into
+ * host tools as the reference implementation.
+ *
+ * A block (one BLE frame payload) is a flags byte followed by samples.
+ * Each sample is three zigzag varints, X then Y then Z. In a keyframe
+ * block the first sample carries absolute values. Every other sample
+ * carries the difference to the sample before it. Keyframes are placed
+ * at block starts once keyframe_interval samples have gone by, so a
+ * decoder that missed a block resynchronises at the next keyframe. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ACCEL_CODEC_FLAG_KEYFRAME       0x01
+
+/* Worst case: three 3-byte varints */
+#define ACCEL_CODEC_MAX_SAMPLE_LEN      9
+#define ACCEL_CODEC_BLOCK_HEADER_LEN    1
+
+/* Samples between keyframes */
+#define ACCEL_CODEC_KEYFRAME_INTERVAL   400
+
+struct accel_codec_enc {
+    int16_t prev[3];
+    uint16_t keyframe_interval;
+    uint16_t since_key;
+    bool key_pending;       // next block starts with a keyframe
+    bool key_sample;        // next sample is written as absolute values
+};
+
+struct accel_codec_dec {
+    int16_t prev[3];
+    bool synced;
+};
+
+void accel_codec_enc_init(struct accel_codec_enc *enc, uint16_t keyframe_interval);
+void accel_codec_force_keyframe(struct accel_codec_enc *enc);
+size_t accel_codec_begin_block(struct accel_codec_enc *enc, uint8_t *out);
+size_t accel_codec_encode(struct accel_codec_enc *enc, const int16_t xyz[3], uint8_t *out);
+
+/* Decodes one block into out. Pass contiguous = false when blocks were
+ * lost before this one. Returns the number of samples decoded, -EAGAIN
+ * while waiting for a keyframe, or -EBADMSG for a malformed block. */
+void accel_codec_dec_init(struct accel_codec_dec *dec);
+int accel_codec_decode_block(struct accel_codec_dec *dec, const uint8_t *in, size_t len,
+                             bool contiguous, int16_t (*out)[3], size_t max);
+
+#endif
@@ -0,0 +1,190 @@
+#include "display_flush.h"
+
+#include <drivers/spi.h>
+#include <drivers/gpio.h>
+#include <sys/byteorder.h>
+#include <lvgl.h>
+#include <logging/log.h>
+
+#define LOG_MODULE_NAME display_flush
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+#define ST7735R_NODE DT_CHOSEN(zephyr_display)
+
+#if !DT_NODE_HAS_COMPAT(ST7735R_NODE, sitronix_st7735r)
+#error "The async flush drives an ST7735R as zephyr,display"
+#endif
+
+// ST7735R commands
+#define ST7735R_CMD_CASET   0x2A
+#define ST7735R_CMD_RASET   0x2B
+#define ST7735R_CMD_RAMWR   0x2C
+
+// Logical levels of cmd-data-gpios, as used by the Zephyr driver
+#define CMD_DATA_PIN_COMMAND    1
+#define CMD_DATA_PIN_DATA       0
+
+#define X_OFFSET DT_PROP(ST7735R_NODE, x_offset)
+#define Y_OFFSET DT_PROP(ST7735R_NODE, y_offset)
+
+/* One LVGL draw buffer. With dynamic allocation they come out of the
+ * system heap, which also holds LVGL's objects. */
+#define VDB_BYTES \
+    (LV_HOR_RES_MAX * LV_VER_RES_MAX * CONFIG_LVGL_VDB_SIZE / 100 * sizeof(lv_color_t))
+#define VDB_COUNT (IS_ENABLED(CONFIG_LVGL_DOUBLE_VDB) ? 2 : 1)
+
+#if defined(CONFIG_LVGL_BUFFER_ALLOC_DYNAMIC)
+BUILD_ASSERT(VDB_COUNT * VDB_BYTES <= CONFIG_HEAP_MEM_POOL_SIZE / 2,
+             "LVGL draw buffers take more than half of the heap, lower LVGL_VDB_SIZE");
+#endif
+
+/* Same bus settings as the driver. The bus stays locked from the window
+ * commands until the pixel transfer completes. */
+static const struct spi_dt_spec spi = SPI_DT_SPEC_GET(ST7735R_NODE,
+    SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_HOLD_ON_CS | SPI_LOCK_ON, 0);
+static const struct gpio_dt_spec cmd_data = GPIO_DT_SPEC_GET(ST7735R_NODE, cmd_data_gpios);
+
+static struct k_poll_signal flush_signal;
+static struct k_poll_event flush_event = K_POLL_EVENT_STATIC_INITIALIZER(
+    K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &flush_signal, 0);
+static bool in_flight;
+static lv_disp_drv_t *pending_drv;
+
+/* The driver reads these until the transfer completes */
+static struct spi_buf pixel_buf;
+static const struct spi_buf_set pixel_bufs = {
+    .buffers = &pixel_buf,
+    .count = 1,
+};
+
+static struct display_flush_stats stats;
+
+static int write_cmd(uint8_t cmd, const void *data, size_t len)
+{
+    struct spi_buf buf = {.buf = &cmd, .len = 1};
+    const struct spi_buf_set bufs = {.buffers = &buf, .count = 1};
+    int err;
+
+    gpio_pin_set_dt(&cmd_data, CMD_DATA_PIN_COMMAND);
+    err = spi_write_dt(&spi, &bufs);
+    if (err || len == 0) {
+        return err;
+    }
+
+    buf.buf = (void *)data;
+    buf.len = len;
+    gpio_pin_set_dt(&cmd_data, CMD_DATA_PIN_DATA);
+    return spi_write_dt(&spi, &bufs);
+}
+
+static int set_window(const lv_area_t *area)
+{
+    uint16_t range[2];
+    int err;
+
+    range[0] = sys_cpu_to_be16(area->x1 + X_OFFSET);
+    range[1] = sys_cpu_to_be16(area->x2 + X_OFFSET);
+    err = write_cmd(ST7735R_CMD_CASET, range, sizeof(range));
+    if (err) {
+        return err;
+    }
+
+    range[0] = sys_cpu_to_be16(area->y1 + Y_OFFSET);
+    range[1] = sys_cpu_to_be16(area->y2 + Y_OFFSET);
+    err = write_cmd(ST7735R_CMD_RASET, range, sizeof(range));
+    if (err) {
+        return err;
+    }
+
+    return write_cmd(ST7735R_CMD_RAMWR, NULL, 0);
+}
+
+static void flush_cb(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_p)
+{
+    uint32_t start = k_cycle_get_32();
+    int err;
+
+    err = set_window(area);
+    if (err == 0) {
+        pixel_buf.buf = color_p;
+        pixel_buf.len = lv_area_get_width(area) * lv_area_get_height(area) * sizeof(lv_color_t);
+
+        /* RAMWR leaves the pin selecting commands, the pixels are data */
+        gpio_pin_set_dt(&cmd_data, CMD_DATA_PIN_DATA);
+
+        k_poll_signal_reset(&flush_signal);
+        flush_event.state = K_POLL_STATE_NOT_READY;
+        err = spi_write_async(spi.bus, &spi.config, &pixel_bufs, &flush_signal);
+    }
+
+    stats.flushes++;
+    stats.setup_cycles += k_cycle_get_32() - start;
+
+    if (err) {
+        LOG_WRN("Flush failed (err %d)", err);
+        stats.errors++;
+        spi_release(spi.bus, &spi.config);
+        lv_disp_flush_ready(drv);
+        return;
+    }
+
+    stats.bytes += pixel_buf.len;
+    pending_drv = drv;
+    in_flight = true;
+}
+
+void display_flush_wait(void)
+{
+    unsigned int signaled;
+    uint32_t start;
+    int result;
+
+    if (!in_flight) {
+        return;
+    }
+
+    start = k_cycle_get_32();
+    k_poll(&flush_event, 1, K_FOREVER);
+    stats.wait_cycles += k_cycle_get_32() - start;
+
+    k_poll_signal_check(&flush_signal, &signaled, &result);
+    if (result < 0) {
+        stats.errors++;
+    }
+
+    spi_release(spi.bus, &spi.config);
+    in_flight = false;
+    lv_disp_flush_ready(pending_drv);
+}
+
+/* LVGL spins on this while it waits for a buffer */
+static void flush_wait_cb(lv_disp_drv_t *drv)
+{
+    display_flush_wait();
+    lv_disp_flush_ready(drv);
+}
+
+void display_flush_get_stats(struct display_flush_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
+
+int display_flush_init(void)
+{
+    lv_disp_t *disp = lv_disp_get_default();
+
+    if (disp == NULL || !spi_is_ready(&spi) || !device_is_ready(cmd_data.port)) {
+        return -ENODEV;
+    }
+
+    k_poll_signal_init(&flush_signal);
+
+    disp->driver.flush_cb = flush_cb;
+    disp->driver.wait_cb = flush_wait_cb;
+
+    LOG_INF("Async flush, %u x %u byte draw buffers", VDB_COUNT, VDB_BYTES);
+    return 0;
+}
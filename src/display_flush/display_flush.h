@@ -0,0 +1,33 @@
+#ifndef __display_flush_h__
+#define __display_flush_h__
+
+#include <zephyr.h>
+
+/* Asynchronous LVGL flush for the ST7735R.
+ *
+ * Replaces the synchronous flush of Zephyr's LVGL glue on the default
+ * display. The window commands go out as before, the pixels with
+ * spi_write_async(), which runs on EasyDMA on nRF. The flush callback
+ * returns straight away, so with CONFIG_LVGL_DOUBLE_VDB LVGL renders the
+ * next area into the other buffer while the previous one is on the bus.
+ * Completion is collected from LVGL's wait callback the next time it
+ * needs the buffer.
+ *
+ * Everything here runs on the thread that calls lv_task_handler(). Call
+ * display_flush_wait() at the end of a frame, and before using the
+ * display API directly, which would otherwise block on the SPI bus the
+ * pending transfer holds. */
+
+struct display_flush_stats {
+    uint32_t flushes;
+    uint32_t bytes;             // pixel bytes handed to DMA
+    uint32_t errors;
+    uint32_t setup_cycles;      // window commands and DMA start, total
+    uint32_t wait_cycles;       // renderer blocked on a pending transfer, total
+};
+
+int display_flush_init(void);
+void display_flush_wait(void);
+void display_flush_get_stats(struct display_flush_stats *stats);
+
+#endif
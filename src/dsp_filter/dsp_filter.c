@@ -0,0 +1,426 @@
+#include "dsp_filter.h"
+
+#include <string.h>
+#include <sys/util.h>
+
+#if defined(CONFIG_CMSIS_DSP_FILTERING)
+#include <arm_math.h>
+#else
+typedef int16_t q15_t;
+#endif
+
+/* Biquad coefficients are Q14, {b0, 0, b1, b2, a1, a2} per stage with the
+ * feedback terms negated, as arm_biquad_cascade_df1_q15() expects. */
+#define BIQUAD_POST_SHIFT   1
+#define BIQUAD_COEFFS       6
+#define BIQUAD_STATE        4
+
+/* Q of the two sections of a 4th order Butterworth response */
+#define BUTTERWORTH4_Q1     0.5411961f
+#define BUTTERWORTH4_Q2     1.3065630f
+
+#define DECIM_TAPS_MAX      64
+
+/* Samples are at most 13 bits, scaling them up keeps the truncation
+ * error of the q15 kernels well below one count and still leaves a bit of
+ * headroom for filter overshoot. */
+#define HEADROOM_SHIFT      2
+
+/* Hamming windowed sinc, cutoff at the output Nyquist rate, 8 taps per
+ * decimation step, unity DC gain. Symmetric, so the time reversed order
+ * CMSIS wants is the same table. */
+static const q15_t decim2_taps[16] = {
+    -79, -136, 312, 654, -1244, -2280, 4501, 14654,
+    14654, 4501, -2280, -1244, 654, 312, -136, -79,
+};
+
+static const q15_t decim4_taps[32] = {
+    -21, -60, -84, -52, 78, 273, 387, 221,
+    -301, -974, -1305, -731, 1017, 3642, 6306, 7986,
+    7986, 6306, 3642, 1017, -731, -1305, -974, -301,
+    221, 387, 273, 78, -52, -84, -60, -21,
+};
+
+static const q15_t decim8_taps[64] = {
+    -5, -16, -26, -36, -43, -45, -36, -16,
+    19, 65, 117, 165, 196, 195, 153, 63,
+    -73, -239, -414, -563, -650, -638, -494, -203,
+    239, 810, 1474, 2175, 2849, 3429, 3853, 4078,
+    4078, 3853, 3429, 2849, 2175, 1474, 810, 239,
+    -203, -494, -638, -650, -563, -414, -239, -73,
+    63, 153, 195, 196, 165, 117, 65, 19,
+    -16, -36, -45, -43, -36, -26, -16, -5,
+};
+
+static const struct {
+    const q15_t *taps;
+    uint16_t count;
+} decim_filters[DSP_FILTER_MAX_DECIM_LOG2 + 1] = {
+    [1] = { decim2_taps, ARRAY_SIZE(decim2_taps) },
+    [2] = { decim4_taps, ARRAY_SIZE(decim4_taps) },
+    [3] = { decim8_taps, ARRAY_SIZE(decim8_taps) },
+};
+
+struct axis_state {
+#if defined(CONFIG_CMSIS_DSP_FILTERING)
+    arm_biquad_casd_df1_inst_q15 biquad;
+    arm_fir_decimate_instance_q15 decim;
+#endif
+    q15_t biquad_state[BIQUAD_STATE * DSP_FILTER_MAX_STAGES];
+    q15_t decim_state[DECIM_TAPS_MAX + DSP_FILTER_BLOCK - 1];
+    q15_t pending[BIT(DSP_FILTER_MAX_DECIM_LOG2) - 1];
+};
+
+static const size_t axis_offset[] = {
+    offsetof(struct adxl345_data, x),
+    offsetof(struct adxl345_data, y),
+    offsetof(struct adxl345_data, z),
+};
+
+static K_MUTEX_DEFINE(filter_lock);
+
+static struct dsp_filter_config active_config;
+static q15_t biquad_coeffs[BIQUAD_COEFFS * DSP_FILTER_MAX_STAGES];
+static uint8_t num_stages;
+static uint8_t decim_factor = 1;
+static size_t pending;      // samples per axis waiting for a full decimation period
+static uint32_t decim_delay;    // group delay of the decimation FIR in cycles
+static struct axis_state axes[ARRAY_SIZE(axis_offset)];
+static q15_t work[DSP_FILTER_BLOCK];
+static q15_t result[DSP_FILTER_BLOCK];
+
+static inline int16_t saturate16(int64_t v)
+{
+    return (int16_t)CLAMP(v, INT16_MIN, INT16_MAX);
+}
+
+static inline q15_t to_q14(float v)
+{
+    return saturate16((int64_t)(v * 16384.0f + (v < 0.0f ? -0.5f : 0.5f)));
+}
+
+static inline int16_t *axis_value(struct adxl345_data *data, size_t axis)
+{
+    return (int16_t *)((uint8_t *)data + axis_offset[axis]);
+}
+
+/* sin and cos of 2x for 0 <= x <= pi/2. The minimal libc has no libm and
+ * the Q14 coefficients don't need more than the Taylor terms up to x^10. */
+static void sin_cos_2x(float x, float *sin2x, float *cos2x)
+{
+    float x2 = x * x;
+    float s = x * (1.0f - x2 / 6.0f * (1.0f - x2 / 20.0f * (1.0f - x2 / 42.0f * (1.0f - x2 / 72.0f))));
+    float c = 1.0f - x2 / 2.0f * (1.0f - x2 / 12.0f * (1.0f - x2 / 30.0f *
+              (1.0f - x2 / 56.0f * (1.0f - x2 / 90.0f))));
+
+    *sin2x = 2.0f * s * c;
+    *cos2x = 1.0f - 2.0f * s * s;
+}
+
+/* RBJ cookbook low/high-pass section at cutoff / rate */
+static void design_biquad(q15_t *coeffs, bool highpass, uint32_t cutoff_mhz,
+                          uint32_t odr_mhz, float q)
+{
+    float sn, cs;
+
+    sin_cos_2x(3.14159265f * (float)cutoff_mhz / (float)odr_mhz, &sn, &cs);
+
+    float alpha = sn / (2.0f * q);
+    float a0 = 1.0f + alpha;
+    float b0 = (highpass ? 1.0f + cs : 1.0f - cs) / 2.0f;
+
+    coeffs[0] = to_q14(b0 / a0);
+    coeffs[1] = 0;
+    coeffs[3] = coeffs[0];
+    coeffs[4] = to_q14(2.0f * cs / a0);
+    coeffs[5] = to_q14(-(1.0f - alpha) / a0);
+
+    /* Rounded on its own, b1 puts the DC gain off by about 0.1% near the
+     * lowest cutoff. Pick it so the Q14 numerator sums to exactly 0
+     * (high-pass) or to 1 minus the feedback terms (low-pass). */
+    if (highpass) {
+        coeffs[2] = -2 * coeffs[0];
+    } else {
+        coeffs[2] = (1 << 14) - coeffs[4] - coeffs[5] - 2 * coeffs[0];
+    }
+}
+
+#if defined(CONFIG_CMSIS_DSP_FILTERING)
+
+static void axis_init(struct axis_state *axis)
+{
+    const uint8_t log2 = active_config.decimation_log2;
+
+    memset(axis, 0, sizeof(*axis));
+    if (num_stages) {
+        arm_biquad_cascade_df1_init_q15(&axis->biquad, num_stages, biquad_coeffs,
+                                        axis->biquad_state, BIQUAD_POST_SHIFT);
+    }
+    if (log2) {
+        arm_fir_decimate_init_q15(&axis->decim, decim_filters[log2].count, decim_factor,
+                                  decim_filters[log2].taps, axis->decim_state,
+                                  DSP_FILTER_BLOCK);
+    }
+}
+
+static inline void run_biquad(struct axis_state *axis, q15_t *buf, size_t count)
+{
+    arm_biquad_cascade_df1_q15(&axis->biquad, buf, buf, count);
+}
+
+static inline void run_decimate(struct axis_state *axis, const q15_t *in, q15_t *out, size_t count)
+{
+    arm_fir_decimate_q15(&axis->decim, in, out, count);
+}
+
+#else
+
+/* Portable versions with the same arithmetic as the CMSIS q15 kernels:
+ * 64-bit accumulation, truncating shift, saturation on the way out. */
+
+static void axis_init(struct axis_state *axis)
+{
+    memset(axis, 0, sizeof(*axis));
+}
+
+static void run_biquad(struct axis_state *axis, q15_t *buf, size_t count)
+{
+    for (uint8_t s = 0; s < num_stages; s++) {
+        const q15_t *c = &biquad_coeffs[BIQUAD_COEFFS * s];
+        q15_t *st = &axis->biquad_state[BIQUAD_STATE * s];
+        q15_t x1 = st[0], x2 = st[1], y1 = st[2], y2 = st[3];
+
+        for (size_t i = 0; i < count; i++) {
+            int64_t acc = (int32_t)c[0] * buf[i] + (int32_t)c[2] * x1 + (int32_t)c[3] * x2;
+
+            acc += (int32_t)c[4] * y1 + (int32_t)c[5] * y2;
+            x2 = x1;
+            x1 = buf[i];
+            y2 = y1;
+            y1 = saturate16(acc >> (15 - BIQUAD_POST_SHIFT));
+            buf[i] = y1;
+        }
+
+        st[0] = x1;
+        st[1] = x2;
+        st[2] = y1;
+        st[3] = y2;
+    }
+}
+
+static void run_decimate(struct axis_state *axis, const q15_t *in, q15_t *out, size_t count)
+{
+    const q15_t *taps = decim_filters[active_config.decimation_log2].taps;
+    const uint16_t num_taps = decim_filters[active_config.decimation_log2].count;
+    q15_t *state = axis->decim_state;
+
+    /* The state holds the last num_taps - 1 inputs followed by this block */
+    memcpy(&state[num_taps - 1], in, count * sizeof(q15_t));
+
+    for (size_t j = 0; j < count / decim_factor; j++) {
+        const q15_t *x = &state[j * decim_factor + decim_factor - 1];
+        int64_t acc = 0;
+
+        for (uint16_t k = 0; k < num_taps; k++) {
+            acc += (int32_t)taps[k] * x[k];
+        }
+        out[j] = saturate16(acc >> 15);
+    }
+
+    memmove(state, &state[count], (num_taps - 1) * sizeof(q15_t));
+}
+
+#endif
+
+static size_t filter_block(struct sample_record *records, size_t count)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    if (num_stages == 0 && decim_factor == 1) {
+        return count;
+    }
+
+    /* The output never gets ahead of the input, so each axis is gathered
+     * and written back over the same records without clobbering samples
+     * that are still to be read. */
+    while (in < count) {
+        size_t n = MIN(count - in, DSP_FILTER_BLOCK - pending);
+        size_t total = pending + n;
+        size_t usable = total - total % decim_factor;
+        size_t produced = usable / decim_factor;
+
+        for (size_t ax = 0; ax < ARRAY_SIZE(axes); ax++) {
+            struct axis_state *axis = &axes[ax];
+            const q15_t *filtered = work;
+
+            for (size_t i = 0; i < n; i++) {
+                work[pending + i] = saturate16(*axis_value(&records[in + i].data, ax) * BIT(HEADROOM_SHIFT));
+            }
+
+            if (num_stages) {
+                run_biquad(axis, &work[pending], n);
+            }
+
+            if (decim_factor > 1) {
+                memcpy(work, axis->pending, pending * sizeof(q15_t));
+                if (usable) {
+                    run_decimate(axis, work, result, usable);
+                }
+                memcpy(axis->pending, &work[usable], (total - usable) * sizeof(q15_t));
+                filtered = result;
+            }
+
+            for (size_t j = 0; j < produced; j++) {
+                *axis_value(&records[out + j].data, ax) =
+                    (filtered[j] + BIT(HEADROOM_SHIFT - 1)) >> HEADROOM_SHIFT;
+            }
+        }
+
+        /* An output is taken when the newest input of its window comes in,
+         * work[j * decim_factor + decim_factor - 1], with work[0] being the
+         * oldest pending input. The symmetric FIR centres it (taps - 1) / 2
+         * inputs earlier. Pending inputs are fewer than decim_factor, so
+         * that input is always in this block. */
+        for (size_t j = 0; decim_factor > 1 && j < produced; j++) {
+            records[out + j].timestamp =
+                records[in + j * decim_factor + decim_factor - 1 - pending].timestamp - decim_delay;
+        }
+
+        pending = total - usable;
+        in += n;
+        out += produced;
+    }
+
+    return out;
+}
+
+int dsp_filter_check_config(const struct dsp_filter_config *cfg, uint32_t odr_mhz)
+{
+    const uint32_t cutoffs[] = { cfg->lowpass_mhz, cfg->highpass_mhz };
+
+    for (size_t i = 0; i < ARRAY_SIZE(cutoffs); i++) {
+        if (cutoffs[i] == 0) {
+            continue;
+        }
+        if (cutoffs[i] >= odr_mhz / 2 || cutoffs[i] < odr_mhz / DSP_FILTER_MIN_CUTOFF_DIV) {
+            return -EINVAL;
+        }
+    }
+
+    if (cfg->decimation_log2 > DSP_FILTER_MAX_DECIM_LOG2) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+int dsp_filter_configure(const struct dsp_filter_config *cfg, uint32_t odr_mhz)
+{
+    int err;
+
+    err = dsp_filter_check_config(cfg, odr_mhz);
+    if (err) {
+        return err;
+    }
+
+    k_mutex_lock(&filter_lock, K_FOREVER);
+
+    active_config = *cfg;
+    num_stages = 0;
+    if (cfg->lowpass_mhz) {
+        design_biquad(&biquad_coeffs[BIQUAD_COEFFS * num_stages++], false,
+                      cfg->lowpass_mhz, odr_mhz, BUTTERWORTH4_Q1);
+        design_biquad(&biquad_coeffs[BIQUAD_COEFFS * num_stages++], false,
+                      cfg->lowpass_mhz, odr_mhz, BUTTERWORTH4_Q2);
+    }
+    if (cfg->highpass_mhz) {
+        design_biquad(&biquad_coeffs[BIQUAD_COEFFS * num_stages++], true,
+                      cfg->highpass_mhz, odr_mhz, BUTTERWORTH4_Q1);
+        design_biquad(&biquad_coeffs[BIQUAD_COEFFS * num_stages++], true,
+                      cfg->highpass_mhz, odr_mhz, BUTTERWORTH4_Q2);
+    }
+
+    decim_factor = BIT(cfg->decimation_log2);
+    pending = 0;
+    for (size_t ax = 0; ax < ARRAY_SIZE(axes); ax++) {
+        axis_init(&axes[ax]);
+    }
+
+    k_mutex_unlock(&filter_lock);
+
+    return 0;
+}
+
+void dsp_filter_get_config(struct dsp_filter_config *cfg)
+{
+    k_mutex_lock(&filter_lock, K_FOREVER);
+    *cfg = active_config;
+    k_mutex_unlock(&filter_lock);
+}
+
+size_t dsp_filter_process(struct sample_record *records, size_t count)
+{
+    size_t n;
+
+    k_mutex_lock(&filter_lock, K_FOREVER);
+    n = filter_block(records, count);
+    k_mutex_unlock(&filter_lock);
+
+    return n;
+}
+
+size_t dsp_filter_put(struct sample_ring *ring, const struct adxl345_data *samples,
+                      size_t count, const struct sample_time *time)
+{
+    struct sample_record *records;
+    size_t done = 0;
+    size_t published = 0;
+
+    k_mutex_lock(&filter_lock, K_FOREVER);
+
+    if (decim_factor > 1) {
+        /* (taps - 1) / 2 input periods, the period being Q32 */
+        decim_delay = ((decim_filters[active_config.decimation_log2].count - 1) * time->period) >> 33;
+    }
+
+    /* Decimated blocks leave part of each claim unpublished, so keep
+     * claiming from the head until the batch is used up or the ring is full */
+    while (done < count) {
+        size_t n = MIN(sample_ring_put_claim(ring, &records), count - done);
+        size_t m;
+
+        if (n == 0) {
+            break;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            records[i].timestamp = sample_time_at(time, done + i);
+            records[i].data = samples[done + i];
+        }
+
+        m = filter_block(records, n);
+        sample_ring_put_finish(ring, m);
+        done += n;
+        published += m;
+    }
+
+    k_mutex_unlock(&filter_lock);
+
+    if (done < count) {
+        sample_ring_put_overrun(ring, count - done);
+    }
+
+    return published;
+}
+
+uint8_t dsp_filter_output_odr(uint8_t odr)
+{
+    uint8_t log2;
+
+    k_mutex_lock(&filter_lock, K_FOREVER);
+    log2 = active_config.decimation_log2;
+    k_mutex_unlock(&filter_lock);
+
+    return odr > log2 ? odr - log2 : 0;
+}
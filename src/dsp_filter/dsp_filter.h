@@ -0,0 +1,70 @@
+#ifndef __dsp_filter_h__
+#define __dsp_filter_h__
+
+#include <zephyr.h>
+#include "adxl345.h"
+#include "sample_ring.h"
+#include "sample_clock.h"
+
+/* Filter stage between acquisition and transmit.
+ *
+ * Each axis runs through an optional biquad cascade (4th order Butterworth
+ * low-pass and/or high-pass, two sections each) and an optional decimator
+ * by 2, 4 or 8 with a windowed-sinc anti-aliasing FIR. Samples are processed in q15
+ * with the CMSIS-DSP kernels when CONFIG_CMSIS_DSP_FILTERING is enabled and
+ * with an equivalent portable C implementation otherwise.
+ *
+ * Blocks are filtered in the sample ring itself: dsp_filter_put() claims
+ * free records, copies the raw batch in, filters and decimates them in
+ * place and only publishes what is left. */
+
+/** @brief Samples per axis processed by one kernel call. **/
+#define DSP_FILTER_BLOCK            32
+
+#define DSP_FILTER_MAX_STAGES       4
+#define DSP_FILTER_MAX_DECIM_LOG2   3
+
+/** @brief Lowest cutoff as a fraction of the sample rate (1/n). Below this
+ * the q15 biquads drift into limit cycles of several counts. **/
+#define DSP_FILTER_MIN_CUTOFF_DIV   20
+
+/** @brief Counts a settled DC level may be off at the lowest cutoff, from
+ * truncation in the q15 sections. It shrinks to one count by rate / 8. **/
+#define DSP_FILTER_DC_DEAD_BAND_LP  6
+#define DSP_FILTER_DC_DEAD_BAND_HP  3
+
+struct dsp_filter_config {
+    uint32_t lowpass_mhz;       // 0 disables the low-pass section
+    uint32_t highpass_mhz;      // 0 disables the high-pass section
+    uint8_t decimation_log2;    // 0 disables the decimator
+};
+
+#define DSP_FILTER_CONFIG_BYPASS    ((struct dsp_filter_config){ 0 })
+
+/* dsp_filter_check_config() validates cfg against the input sample rate.
+ * It returns -EINVAL if a cutoff is outside [rate / DSP_FILTER_MIN_CUTOFF_DIV,
+ * rate / 2) or the decimation is out of range. dsp_filter_configure()
+ * checks the same, then resets the filter state; call it from the thread
+ * that runs dsp_filter_put(), so the stream rate can switch at the same
+ * sample. */
+int dsp_filter_check_config(const struct dsp_filter_config *cfg, uint32_t odr_mhz);
+int dsp_filter_configure(const struct dsp_filter_config *cfg, uint32_t odr_mhz);
+void dsp_filter_get_config(struct dsp_filter_config *cfg);
+
+/* Filters count records in place. The decimated output is compacted to the
+ * front of the block and its length returned. Input that doesn't complete a
+ * decimation period is held back for the next call. Decimated samples
+ * are stamped at the centre of their FIR window, with the input period of
+ * the last dsp_filter_put(). */
+size_t dsp_filter_process(struct sample_record *records, size_t count);
+
+/* Producer side replacement for sample_ring_put() that runs the samples
+ * through the filter on their way into the ring, each stamped with its
+ * own capture time. */
+size_t dsp_filter_put(struct sample_ring *ring, const struct adxl345_data *samples,
+                      size_t count, const struct sample_time *time);
+
+/* ADXL345 ODR code of the filtered stream for an input ODR code */
+uint8_t dsp_filter_output_odr(uint8_t odr);
+
+#endif
@@ -0,0 +1,406 @@
+#include "flash_log.h"
+#include "adxl345_frame.h"
+#include "accel_codec.h"
+#include "sample_clock.h"
+
+#include <fs/fcb.h>
+#include <storage/flash_map.h>
+#include <sys/byteorder.h>
+#include <logging/log.h>
+
+#define LOG_MODULE_NAME flash_log
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+#define FLASH_LOG_AREA_ID   FLASH_AREA_ID(storage)
+#define FLASH_LOG_MAGIC     0x4c584441      // "ADXL"
+#define FLASH_LOG_VERSION   2
+
+/* FCB on-flash overhead, each part padded to the write alignment: a
+ * sector header, and per entry a 1-2 byte length and a CRC byte */
+#define FCB_SECTOR_HDR_LEN  8
+#define FCB_ENTRY_LEN_LEN   2
+#define FCB_ENTRY_CRC_LEN   1
+
+struct staging_block {
+    uint8_t data[FLASH_LOG_BLOCK_MAX];
+    size_t len;
+    uint8_t count;
+};
+
+static struct fcb fcb;
+static struct flash_sector sectors[FLASH_LOG_MAX_SECTORS];
+static size_t block_size;
+static bool ready;
+static bool full;               // an append hit the end, until the next erase
+
+static K_SEM_DEFINE(block_ready, 0, 1);
+static K_THREAD_STACK_DEFINE(flash_log_stack, FLASH_LOG_STACK_SIZE);
+static struct k_thread flash_log_thread;
+static struct flash_log_stats stats;
+
+/* Staging state, appends come from the system work queue and flushes
+ * from the Bluetooth thread */
+static K_MUTEX_DEFINE(staging_lock);
+static struct staging_block staging[2];
+static uint8_t fill_idx;
+static uint8_t write_idx;
+static atomic_t writing;        // the writer thread owns staging[write_idx]
+static struct accel_codec_enc encoder;
+static uint8_t block_odr;
+static uint16_t block_seq;
+static uint32_t capture_left;   // samples the capture still takes
+
+/* Serialises the FCB between the writer thread, erases and download
+ * reads; the staging buffers never wait on it */
+static K_MUTEX_DEFINE(fcb_lock);
+static struct fcb_entry download_loc;
+static uint16_t download_off;   // bytes of the entry at download_loc already read
+static bool downloading;
+static int64_t download_start;
+
+static size_t entry_flash_len(size_t len)
+{
+    return ROUND_UP(FCB_ENTRY_LEN_LEN, fcb.f_align) + ROUND_UP(len, fcb.f_align) +
+           ROUND_UP(FCB_ENTRY_CRC_LEN, fcb.f_align);
+}
+
+/* Called with fcb_lock held. Returns -ENOSPC once the log is full; the
+ * oldest sector is never rotated out, so flash wear stays bounded by the
+ * captures that were asked for. */
+static int write_block(const struct staging_block *blk)
+{
+    struct fcb_entry loc;
+    int err;
+
+    err = fcb_append(&fcb, blk->len, &loc);
+    if (err) {
+        return err;
+    }
+
+    err = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), blk->data, blk->len);
+    if (err) {
+        return err;
+    }
+    err = fcb_append_finish(&fcb, &loc);
+    if (err) {
+        return err;
+    }
+
+    stats.payload_bytes += blk->len;
+    stats.flash_bytes += entry_flash_len(blk->len);
+    return 0;
+}
+
+static void flash_log_thread_fn(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1) {
+        const struct staging_block *blk;
+        int err;
+
+        k_sem_take(&block_ready, K_FOREVER);
+        blk = &staging[write_idx];
+
+        k_mutex_lock(&fcb_lock, K_FOREVER);
+        err = write_block(blk);
+        k_mutex_unlock(&fcb_lock);
+        if (err == -ENOSPC) {
+            LOG_INF("Sample log full, capture stopped");
+            stats.samples_dropped += blk->count;
+            full = true;
+            flash_log_capture(0);
+        } else if (err) {
+            LOG_WRN("Couldn't write log block (err %d)", err);
+            stats.samples_dropped += blk->count;
+        } else {
+            stats.blocks_written++;
+            stats.samples_logged += blk->count;
+        }
+
+        atomic_clear(&writing);
+    }
+}
+
+/* Called with staging_lock held */
+static void seal_block(void)
+{
+    struct staging_block *blk = &staging[fill_idx];
+    struct adxl345_frame_header *hdr = (struct adxl345_frame_header *)blk->data;
+
+    if (blk->count == 0) {
+        return;
+    }
+    hdr->count = blk->count;
+
+    if (!atomic_cas(&writing, 0, 1)) {
+        /* Still writing the previous block; flash is far slower than the
+         * sample rate only while a sector is being erased */
+        stats.samples_dropped += blk->count;
+    } else {
+        write_idx = fill_idx;
+        fill_idx ^= 1;
+        k_sem_give(&block_ready);
+    }
+
+    staging[fill_idx].len = 0;
+    staging[fill_idx].count = 0;
+}
+
+/* Called with staging_lock held */
+static void start_block(struct staging_block *blk, const struct sample_record *first, uint8_t odr)
+{
+    struct adxl345_frame_header *hdr = (struct adxl345_frame_header *)blk->data;
+
+    hdr->seq = sys_cpu_to_le16(block_seq++);
+    hdr->timestamp = sys_cpu_to_le32((uint32_t)sample_clock_to_us(first->timestamp));
+    hdr->count = 0;
+    hdr->odr = odr;
+    hdr->format = ADXL345_FRAME_DELTA;
+    hdr->period = sys_cpu_to_le32(sample_clock_period_us_q8(odr));
+
+    /* Every block starts from absolute values so it decodes on its own */
+    accel_codec_force_keyframe(&encoder);
+    blk->len = sizeof(*hdr) + accel_codec_begin_block(&encoder, blk->data + sizeof(*hdr));
+    blk->count = 0;
+    block_odr = odr;
+}
+
+int flash_log_capture(uint32_t max_samples)
+{
+    if (!ready) {
+        return -ENODEV;
+    }
+    if (max_samples && full) {
+        return -ENOSPC;
+    }
+
+    k_mutex_lock(&staging_lock, K_FOREVER);
+    capture_left = max_samples;
+    if (max_samples == 0) {
+        seal_block();
+    }
+    k_mutex_unlock(&staging_lock);
+
+    return 0;
+}
+
+size_t flash_log_append(const struct sample_record *records, size_t count, uint8_t odr)
+{
+    if (!ready) {
+        return 0;
+    }
+
+    k_mutex_lock(&staging_lock, K_FOREVER);
+
+    count = MIN(count, capture_left);
+    if (count == 0) {
+        k_mutex_unlock(&staging_lock);
+        return 0;
+    }
+
+    if (staging[fill_idx].count && odr != block_odr) {
+        seal_block();
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        struct staging_block *blk = &staging[fill_idx];
+        const int16_t xyz[3] = {records[i].data.x, records[i].data.y, records[i].data.z};
+
+        if (blk->count == 0) {
+            start_block(blk, &records[i], odr);
+        }
+
+        blk->len += accel_codec_encode(&encoder, xyz, blk->data + blk->len);
+        blk->count++;
+
+        if (blk->count == UINT8_MAX || blk->len + ACCEL_CODEC_MAX_SAMPLE_LEN > block_size) {
+            seal_block();
+        }
+    }
+
+    if (capture_left != FLASH_LOG_CAPTURE_UNTIL_FULL) {
+        capture_left -= count;
+        if (capture_left == 0) {
+            LOG_INF("Sample log capture done");
+            seal_block();
+        }
+    }
+
+    k_mutex_unlock(&staging_lock);
+
+    return count;
+}
+
+void flash_log_flush(void)
+{
+    if (!ready) {
+        return;
+    }
+
+    k_mutex_lock(&staging_lock, K_FOREVER);
+    seal_block();
+    k_mutex_unlock(&staging_lock);
+}
+
+int flash_log_download_start(void)
+{
+    if (!ready) {
+        return -ENODEV;
+    }
+
+    flash_log_flush();
+
+    k_mutex_lock(&fcb_lock, K_FOREVER);
+    /* An empty location makes fcb_getnext() start at the oldest entry */
+    memset(&download_loc, 0, sizeof(download_loc));
+    download_off = 0;
+    stats.download_bytes = 0;
+    download_start = k_uptime_get();
+    downloading = true;
+    k_mutex_unlock(&fcb_lock);
+    return 0;
+}
+
+/* Called with fcb_lock held. Moves on to the next entry only once the
+ * current one has been read to its end. */
+static int read_next(uint8_t *buf, size_t size)
+{
+    size_t len;
+    int err;
+
+    if (!downloading) {
+        return 0;
+    }
+    if (size == 0) {
+        return -EMSGSIZE;
+    }
+
+    if (download_off == 0) {
+        err = fcb_getnext(&fcb, &download_loc);
+        if (err) {
+            /* Past the newest entry */
+            downloading = false;
+            stats.download_ms = k_uptime_get() - download_start;
+            LOG_INF("Log download done, %u bytes in %u ms", stats.download_bytes, stats.download_ms);
+            return 0;
+        }
+    }
+
+    len = MIN(size, download_loc.fe_data_len - download_off);
+    err = flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(download_loc) + download_off, buf, len);
+    if (err) {
+        return err;
+    }
+
+    download_off += len;
+    if (download_off == download_loc.fe_data_len) {
+        download_off = 0;
+    }
+    stats.download_bytes += len;
+    return len;
+}
+
+int flash_log_download_next(uint8_t *buf, size_t size)
+{
+    int ret;
+
+    k_mutex_lock(&fcb_lock, K_FOREVER);
+    ret = read_next(buf, size);
+    k_mutex_unlock(&fcb_lock);
+
+    return ret;
+}
+
+int flash_log_erase(void)
+{
+    int err;
+
+    if (!ready) {
+        return -ENODEV;
+    }
+
+    k_mutex_lock(&fcb_lock, K_FOREVER);
+    downloading = false;
+    err = fcb_clear(&fcb);
+    if (err == 0) {
+        stats.sectors_erased += fcb.f_sector_cnt;
+        full = false;
+    }
+    k_mutex_unlock(&fcb_lock);
+
+    return err;
+}
+
+size_t flash_log_block_size(void)
+{
+    return block_size;
+}
+
+void flash_log_get_stats(struct flash_log_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    out->capture_left = capture_left;
+    irq_unlock(key);
+}
+
+int flash_log_init(void)
+{
+    const struct flash_area *fap;
+    uint32_t sector_cnt = ARRAY_SIZE(sectors);
+    size_t per_entry;
+    int err;
+
+    err = flash_area_get_sectors(FLASH_LOG_AREA_ID, &sector_cnt, sectors);
+    if (err) {
+        LOG_ERR("Couldn't get the storage sectors (err %d)", err);
+        return err;
+    }
+
+    fcb.f_magic = FLASH_LOG_MAGIC;
+    fcb.f_version = FLASH_LOG_VERSION;
+    fcb.f_sector_cnt = sector_cnt;
+    fcb.f_scratch_cnt = 0;
+    fcb.f_sectors = sectors;
+
+    err = fcb_init(FLASH_LOG_AREA_ID, &fcb);
+    if (err) {
+        /* Not an FCB of ours (first boot, or another layout), start over */
+        LOG_WRN("Formatting the sample log (err %d)", err);
+        err = flash_area_open(FLASH_LOG_AREA_ID, &fap);
+        if (err == 0) {
+            err = flash_area_erase(fap, 0, fap->fa_size);
+            flash_area_close(fap);
+        }
+        if (err == 0) {
+            err = fcb_init(FLASH_LOG_AREA_ID, &fcb);
+        }
+        if (err) {
+            LOG_ERR("Couldn't initialize the sample log (err %d)", err);
+            return err;
+        }
+    }
+
+    /* Largest block of which FLASH_LOG_BLOCKS_PER_SECTOR fit in a sector */
+    per_entry = (sectors[0].fs_size - ROUND_UP(FCB_SECTOR_HDR_LEN, fcb.f_align)) /
+                FLASH_LOG_BLOCKS_PER_SECTOR;
+    block_size = ROUND_DOWN(per_entry - ROUND_UP(FCB_ENTRY_LEN_LEN, fcb.f_align) -
+                            ROUND_UP(FCB_ENTRY_CRC_LEN, fcb.f_align), fcb.f_align);
+    block_size = MIN(block_size, FLASH_LOG_BLOCK_MAX);
+
+    accel_codec_enc_init(&encoder, ACCEL_CODEC_KEYFRAME_INTERVAL);
+
+    k_thread_create(&flash_log_thread, flash_log_stack,
+                    K_THREAD_STACK_SIZEOF(flash_log_stack),
+                    flash_log_thread_fn, NULL, NULL, NULL,
+                    FLASH_LOG_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&flash_log_thread, "flash_log");
+
+    ready = true;
+    LOG_INF("Sample log: %u sectors, %u byte blocks", sector_cnt, block_size);
+    return 0;
+}
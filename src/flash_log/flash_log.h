@@ -0,0 +1,75 @@
+#ifndef __flash_log_h__
+#define __flash_log_h__
+
+#include <zephyr.h>
+#include "sample_ring.h"
+
+/* Flash-backed log of samples that couldn't be streamed.
+ *
+ * Samples are delta-encoded into RAM blocks laid out exactly like ADXL345
+ * stream frames (struct adxl345_frame_header followed by one keyframed
+ * accel_codec block), so each block decodes on its own and the phone can
+ * parse a download with its stream code. A full block is handed to the
+ * writer thread, which appends it to an FCB in the storage partition
+ * (pm_static_<board>.yml under the partition manager).
+ * Blocks are sized so that FLASH_LOG_BLOCKS_PER_SECTOR of them, with the
+ * FCB headers, fill a flash sector.
+ *
+ * Capture is off until flash_log_capture() arms it with a sample budget,
+ * as the BLE app does when the stream loses its last subscriber, and
+ * stops once the budget is used up or the log is full. Nothing is rotated
+ * out, so every capture costs at most one erase per sector, when the log
+ * is erased for the next one.
+ *
+ * The backlog is read back oldest first. */
+
+#define FLASH_LOG_BLOCKS_PER_SECTOR     4
+/** @brief RAM staging buffer, the upper bound of the block size. **/
+#define FLASH_LOG_BLOCK_MAX             1024
+#define FLASH_LOG_MAX_SECTORS           16
+/** @brief Budget that captures until the log is full. **/
+#define FLASH_LOG_CAPTURE_UNTIL_FULL    UINT32_MAX
+
+#define FLASH_LOG_STACK_SIZE            1024
+#define FLASH_LOG_PRIORITY              K_PRIO_PREEMPT(12)
+
+struct flash_log_stats {
+    uint32_t samples_logged;    // samples in blocks written to flash
+    uint32_t samples_dropped;   // lost while the writer was busy, or to a failed write
+    uint32_t capture_left;      // samples the armed capture still takes, 0 when stopped
+    uint32_t blocks_written;
+    uint32_t payload_bytes;     // block bytes handed to the FCB
+    uint32_t flash_bytes;       // bytes programmed, with FCB length, CRC and padding
+    uint32_t sectors_erased;    // by flash_log_erase()
+    uint32_t download_bytes;    // of the current or last download
+    uint32_t download_ms;       // duration of the last complete download
+};
+
+int flash_log_init(void);
+size_t flash_log_block_size(void);
+
+/* Arms capture for the next max_samples appended samples, or stops it
+ * when max_samples is 0. A stopped capture seals its last block. Arming
+ * fails with -ENOSPC once the log has filled up, until it is erased. */
+int flash_log_capture(uint32_t max_samples);
+
+/* Appends samples taken at the given rate code while capture is armed.
+ * Returns how many were kept. Never blocks on flash. */
+size_t flash_log_append(const struct sample_record *records, size_t count, uint8_t odr);
+
+/* Seals the partially filled block so it gets written out */
+void flash_log_flush(void);
+
+/* Bulk download. flash_log_download_start() flushes and rewinds to the
+ * oldest block; each flash_log_download_next() call copies the next piece
+ * of the backlog into buf and returns its length, 0 once the backlog is
+ * drained, or a negative error code. A block larger than size goes out in
+ * several pieces, so the download is a byte stream of whole blocks that
+ * the receiver splits by decoding the count samples of each. */
+int flash_log_download_start(void);
+int flash_log_download_next(uint8_t *buf, size_t size);
+
+int flash_log_erase(void);
+void flash_log_get_stats(struct flash_log_stats *stats);
+
+#endif
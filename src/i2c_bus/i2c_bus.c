@@ -0,0 +1,200 @@
+#include "i2c_bus.h"
+
+#include <sys/slist.h>
+
+static const struct device *bus_dev;
+static sys_slist_t queues[I2C_BUS_PRIO_COUNT];
+static struct k_spinlock queue_lock;
+static K_SEM_DEFINE(queued, 0, K_SEM_MAX_LIMIT);
+static K_MUTEX_DEFINE(bus_lock);
+
+static K_THREAD_STACK_DEFINE(i2c_bus_stack, I2C_BUS_STACK_SIZE);
+static struct k_thread i2c_bus_thread;
+static struct i2c_bus_stats stats;
+static uint32_t acquired_at;
+
+static struct i2c_bus_txn *next_txn(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&queue_lock);
+    sys_snode_t *node = NULL;
+
+    for (int prio = 0; prio < I2C_BUS_PRIO_COUNT && !node; prio++) {
+        node = sys_slist_get(&queues[prio]);
+    }
+    k_spin_unlock(&queue_lock, key);
+
+    return CONTAINER_OF(node, struct i2c_bus_txn, node);
+}
+
+static void i2c_bus_thread_fn(void *p1, void *p2, void *p3)
+{
+    struct i2c_bus_prio_stats *ps;
+    struct i2c_bus_txn *txn;
+    uint32_t start, wait;
+    int err;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1) {
+        k_sem_take(&queued, K_FOREVER);
+
+        /* Pick the transaction once the bus is ours, so one submitted
+         * while an i2c_bus_acquire() holder had it still goes first */
+        k_mutex_lock(&bus_lock, K_FOREVER);
+        txn = next_txn();
+        ps = &stats.prio[txn->prio];
+        start = k_cycle_get_32();
+        err = i2c_transfer(bus_dev, txn->msgs, txn->num_msgs, txn->addr);
+        k_mutex_unlock(&bus_lock);
+
+        wait = start - txn->submitted;
+        ps->transfers++;
+        ps->last_wait_cycles = wait;
+        ps->max_wait_cycles = MAX(ps->max_wait_cycles, wait);
+        ps->max_xfer_cycles = MAX(ps->max_xfer_cycles, k_cycle_get_32() - start);
+        if (err) {
+            ps->errors++;
+        }
+
+        k_poll_signal_raise(txn->done, err);
+    }
+}
+
+int i2c_bus_submit(struct i2c_bus_txn *txn)
+{
+    k_spinlock_key_t key;
+
+    if (!bus_dev) {
+        return -ENODEV;
+    }
+    if (txn->prio >= I2C_BUS_PRIO_COUNT || txn->done == NULL) {
+        return -EINVAL;
+    }
+
+    txn->submitted = k_cycle_get_32();
+    key = k_spin_lock(&queue_lock);
+    sys_slist_append(&queues[txn->prio], &txn->node);
+    k_spin_unlock(&queue_lock, key);
+
+    k_sem_give(&queued);
+    return 0;
+}
+
+int i2c_bus_transfer(const struct device *dev, struct i2c_msg *msgs, uint8_t num_msgs,
+                     uint16_t addr, enum i2c_bus_prio prio)
+{
+    struct k_poll_signal done;
+    struct k_poll_event event;
+    struct i2c_bus_txn txn = {
+        .msgs = msgs,
+        .num_msgs = num_msgs,
+        .prio = prio,
+        .addr = addr,
+        .done = &done,
+    };
+    unsigned int signaled;
+    int result, err;
+
+    if (dev != bus_dev) {
+        return i2c_transfer(dev, msgs, num_msgs, addr);
+    }
+
+    k_poll_signal_init(&done);
+    k_poll_event_init(&event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &done);
+
+    err = i2c_bus_submit(&txn);
+    if (err) {
+        return err;
+    }
+    k_poll(&event, 1, K_FOREVER);
+
+    k_poll_signal_check(&done, &signaled, &result);
+    return result;
+}
+
+int i2c_bus_write(const struct device *dev, const uint8_t *buf, uint32_t len,
+                  uint16_t addr, enum i2c_bus_prio prio)
+{
+    struct i2c_msg msg = {
+        .buf = (uint8_t *)buf,
+        .len = len,
+        .flags = I2C_MSG_WRITE | I2C_MSG_STOP,
+    };
+
+    return i2c_bus_transfer(dev, &msg, 1, addr, prio);
+}
+
+int i2c_bus_write_read(const struct device *dev, uint16_t addr, const void *write_buf,
+                       size_t num_write, void *read_buf, size_t num_read,
+                       enum i2c_bus_prio prio)
+{
+    struct i2c_msg msgs[2] = {
+        {
+            .buf = (uint8_t *)write_buf,
+            .len = num_write,
+            .flags = I2C_MSG_WRITE,
+        },
+        {
+            .buf = read_buf,
+            .len = num_read,
+            .flags = I2C_MSG_RESTART | I2C_MSG_READ | I2C_MSG_STOP,
+        },
+    };
+
+    return i2c_bus_transfer(dev, msgs, 2, addr, prio);
+}
+
+void i2c_bus_acquire(const struct device *dev)
+{
+    if (dev == bus_dev) {
+        k_mutex_lock(&bus_lock, K_FOREVER);
+        stats.acquires++;
+        acquired_at = k_cycle_get_32();
+    }
+}
+
+void i2c_bus_release(const struct device *dev)
+{
+    uint32_t hold;
+
+    if (dev == bus_dev) {
+        hold = k_cycle_get_32() - acquired_at;
+        stats.last_hold_cycles = hold;
+        stats.max_hold_cycles = MAX(stats.max_hold_cycles, hold);
+        k_mutex_unlock(&bus_lock);
+    }
+}
+
+void i2c_bus_get_stats(struct i2c_bus_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
+
+int i2c_bus_init(const struct device *dev)
+{
+    if (!device_is_ready(dev)) {
+        return -ENODEV;
+    }
+    if (bus_dev) {
+        return -EALREADY;
+    }
+
+    for (int prio = 0; prio < I2C_BUS_PRIO_COUNT; prio++) {
+        sys_slist_init(&queues[prio]);
+    }
+
+    k_thread_create(&i2c_bus_thread, i2c_bus_stack,
+                    K_THREAD_STACK_SIZEOF(i2c_bus_stack),
+                    i2c_bus_thread_fn, NULL, NULL, NULL,
+                    I2C_BUS_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&i2c_bus_thread, "i2c_bus");
+
+    /* Clients start queueing once this is set */
+    bus_dev = dev;
+    return 0;
+}
@@ -0,0 +1,80 @@
+#ifndef __i2c_bus_h__
+#define __i2c_bus_h__
+
+#include <zephyr.h>
+#include <drivers/i2c.h>
+
+/* Transaction queue for the sensor I2C bus.
+ *
+ * Clients submit transactions to per-priority queues and a bus thread
+ * runs them one at a time, highest priority first, raising each one's
+ * poll signal with the i2c_transfer() result. Submitting never blocks;
+ * i2c_bus_transfer() submits and sleeps until the result is in, so the
+ * caller sleeps during the transfer as well as while queued.
+ *
+ * Drivers outside the application, like the fuel gauge, take the bus
+ * with i2c_bus_acquire() instead. The bus lock is a mutex, so a low
+ * priority holder is boosted while the bus thread waits on it, and the
+ * bus thread always gets the lock ahead of lower priority waiters. How
+ * long holders keep the bus, and so how long a queued transfer may wait
+ * behind them, is recorded in the stats.
+ *
+ * Transfers on any other bus device go straight to the driver. */
+
+enum i2c_bus_prio {
+    I2C_BUS_PRIO_HIGH,      // accelerometer
+    I2C_BUS_PRIO_LOW,       // housekeeping, fuel gauge
+    I2C_BUS_PRIO_COUNT,
+};
+
+#define I2C_BUS_STACK_SIZE      1024
+/** @brief Above every client, so a queued transfer starts as soon as the
+ * bus is free. **/
+#define I2C_BUS_PRIORITY        K_PRIO_PREEMPT(1)
+
+struct i2c_bus_txn {
+    sys_snode_t node;
+    struct i2c_msg *msgs;
+    uint8_t num_msgs;
+    uint8_t prio;               // enum i2c_bus_prio
+    uint16_t addr;
+    struct k_poll_signal *done; // raised with the transfer result
+    uint32_t submitted;         // k_cycle_get_32() at submission
+};
+
+struct i2c_bus_prio_stats {
+    uint32_t transfers;
+    uint32_t errors;
+    uint32_t last_wait_cycles;  // submission to start of transfer
+    uint32_t max_wait_cycles;
+    uint32_t max_xfer_cycles;
+};
+
+struct i2c_bus_stats {
+    struct i2c_bus_prio_stats prio[I2C_BUS_PRIO_COUNT];
+    uint32_t acquires;
+    uint32_t last_hold_cycles;  // i2c_bus_acquire() to i2c_bus_release()
+    uint32_t max_hold_cycles;
+};
+
+int i2c_bus_init(const struct device *dev);
+
+/* Queues txn; it must stay valid until txn->done is raised */
+int i2c_bus_submit(struct i2c_bus_txn *txn);
+
+/* Blocking equivalents of the i2c_* calls, through the queue */
+int i2c_bus_transfer(const struct device *dev, struct i2c_msg *msgs, uint8_t num_msgs,
+                     uint16_t addr, enum i2c_bus_prio prio);
+int i2c_bus_write(const struct device *dev, const uint8_t *buf, uint32_t len,
+                  uint16_t addr, enum i2c_bus_prio prio);
+int i2c_bus_write_read(const struct device *dev, uint16_t addr, const void *write_buf,
+                       size_t num_write, void *read_buf, size_t num_read,
+                       enum i2c_bus_prio prio);
+
+/* Exclusive use of the bus for code that calls the driver itself */
+void i2c_bus_acquire(const struct device *dev);
+void i2c_bus_release(const struct device *dev);
+
+void i2c_bus_get_stats(struct i2c_bus_stats *stats);
+
+#endif
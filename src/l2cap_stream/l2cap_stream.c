@@ -0,0 +1,125 @@
+#include "l2cap_stream.h"
+
+#include <bluetooth/l2cap.h>
+#include <logging/log.h>
+
+#define LOG_MODULE_NAME l2cap_stream
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+NET_BUF_POOL_FIXED_DEFINE(sdu_pool, L2CAP_STREAM_TX_BUFS,
+                          BT_L2CAP_SDU_BUF_SIZE(L2CAP_STREAM_SDU_MAX), NULL);
+
+static struct bt_l2cap_le_chan stream_chan;
+static atomic_t chan_connected;
+static l2cap_stream_ready_t ready_cb;
+
+static void on_chan_connected(struct bt_l2cap_chan *chan)
+{
+    LOG_INF("L2CAP stream connected, TX MTU %u MPS %u",
+            stream_chan.tx.mtu, stream_chan.tx.mps);
+    atomic_set(&chan_connected, 1);
+    ready_cb();
+}
+
+static void on_chan_disconnected(struct bt_l2cap_chan *chan)
+{
+    LOG_INF("L2CAP stream disconnected");
+    atomic_set(&chan_connected, 0);
+}
+
+static int on_chan_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+    /* The stream is one-way, anything from the central is ignored */
+    return 0;
+}
+
+static void on_chan_sent(struct bt_l2cap_chan *chan)
+{
+    ready_cb();
+}
+
+static const struct bt_l2cap_chan_ops stream_chan_ops = {
+    .connected = on_chan_connected,
+    .disconnected = on_chan_disconnected,
+    .recv = on_chan_recv,
+    .sent = on_chan_sent,
+};
+
+static int on_accept(struct bt_conn *conn, struct bt_l2cap_chan **chan)
+{
+    if (stream_chan.chan.conn) {
+        return -ENOMEM;
+    }
+
+    memset(&stream_chan, 0, sizeof(stream_chan));
+    stream_chan.chan.ops = &stream_chan_ops;
+    *chan = &stream_chan.chan;
+    return 0;
+}
+
+static struct bt_l2cap_server stream_server = {
+    .psm = L2CAP_STREAM_PSM,
+    .sec_level = BT_SECURITY_L1,
+    .accept = on_accept,
+};
+
+int l2cap_stream_init(l2cap_stream_ready_t ready)
+{
+    int err;
+
+    if (ready == NULL) {
+        return -EINVAL;
+    }
+    ready_cb = ready;
+
+    err = bt_l2cap_server_register(&stream_server);
+    if (err) {
+        LOG_ERR("Couldn't register L2CAP server (err %d)", err);
+        return err;
+    }
+
+    LOG_INF("L2CAP stream on PSM 0x%04x", stream_server.psm);
+    return 0;
+}
+
+uint16_t l2cap_stream_psm(void)
+{
+    return stream_server.psm;
+}
+
+bool l2cap_stream_connected(void)
+{
+    return atomic_get(&chan_connected);
+}
+
+struct bt_conn *l2cap_stream_conn(void)
+{
+    return atomic_get(&chan_connected) ? stream_chan.chan.conn : NULL;
+}
+
+size_t l2cap_stream_max_sdu(void)
+{
+    return MIN(stream_chan.tx.mtu, L2CAP_STREAM_SDU_MAX);
+}
+
+struct net_buf *l2cap_stream_alloc(void)
+{
+    struct net_buf *buf = net_buf_alloc(&sdu_pool, K_NO_WAIT);
+
+    if (buf) {
+        net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+    }
+    return buf;
+}
+
+int l2cap_stream_send(struct net_buf *buf)
+{
+    int err;
+
+    err = bt_l2cap_chan_send(&stream_chan.chan, buf);
+    if (err < 0) {
+        net_buf_unref(buf);
+        return err;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef __l2cap_stream_h__
+#define __l2cap_stream_h__
+
+#include <zephyr.h>
+#include <net/buf.h>
+#include <bluetooth/conn.h>
+
+/* LE credit-based L2CAP channel carrying the accelerometer stream.
+ *
+ * The central reads the PSM from the remote service and opens the
+ * channel. While it is connected, that central gets its frames as L2CAP
+ * SDUs instead of GATT notifications. There is one channel, the other
+ * centrals stay on GATT. */
+
+/** @brief 0 lets the stack pick a dynamic PSM. **/
+#define L2CAP_STREAM_PSM        0
+
+/** @brief Largest SDU we send, segmented by the stack to the peer MPS. **/
+#define L2CAP_STREAM_SDU_MAX    1024
+#define L2CAP_STREAM_TX_BUFS    4
+
+/** @brief Called when the channel opens and after every SDU went out. **/
+typedef void (*l2cap_stream_ready_t)(void);
+
+int l2cap_stream_init(l2cap_stream_ready_t ready);
+uint16_t l2cap_stream_psm(void);
+bool l2cap_stream_connected(void);
+/* Connection the channel is open on, NULL while it is closed */
+struct bt_conn *l2cap_stream_conn(void);
+size_t l2cap_stream_max_sdu(void);
+
+/* Returns NULL when all SDU buffers are in flight */
+struct net_buf *l2cap_stream_alloc(void);
+int l2cap_stream_send(struct net_buf *buf);
+
+#endif
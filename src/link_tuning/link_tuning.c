@@ -0,0 +1,255 @@
+#include "link_tuning.h"
+
+#include <bluetooth/gatt.h>
+#include <logging/log.h>
+
+#define LOG_MODULE_NAME link_tuning
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+/* One per connection; every central gets its own parameters and profile */
+struct link {
+    struct bt_conn *conn;
+    struct link_info info;
+    enum link_profile profile;
+    struct k_work_delayable tune_work;
+    struct k_work profile_work;
+    struct bt_gatt_exchange_params exchange_params;
+};
+
+static struct link links[CONFIG_BT_MAX_CONN];
+
+static const struct bt_le_conn_param profile_params[] = {
+    [LINK_PROFILE_STREAMING] = {
+        .interval_min = LINK_STREAM_INTERVAL_MIN,
+        .interval_max = LINK_STREAM_INTERVAL_MAX,
+        .latency = LINK_STREAM_LATENCY,
+        .timeout = LINK_STREAM_TIMEOUT,
+    },
+    [LINK_PROFILE_LOW_POWER] = {
+        .interval_min = LINK_IDLE_INTERVAL_MIN,
+        .interval_max = LINK_IDLE_INTERVAL_MAX,
+        .latency = LINK_IDLE_LATENCY,
+        .timeout = LINK_IDLE_TIMEOUT,
+    },
+};
+
+static struct link *find_link(struct bt_conn *conn)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+        if (links[i].conn == conn) {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+static void exchange_func(struct bt_conn *conn, uint8_t att_err, struct bt_gatt_exchange_params *params)
+{
+    struct link *link = CONTAINER_OF(params, struct link, exchange_params);
+
+    if (att_err) {
+        LOG_WRN("MTU exchange failed (err %u)", att_err);
+        return;
+    }
+    link->info.mtu = bt_gatt_get_mtu(conn);
+}
+
+static void request_params(struct link *link, struct bt_conn *conn)
+{
+    int err;
+
+    err = bt_conn_le_param_update(conn, &profile_params[link->profile]);
+    if (err) {
+        LOG_WRN("Connection parameter update failed (err %d)", err);
+    }
+}
+
+/* Runs on the system workqueue, the HCI commands below wait for their
+ * completion events and must not run in the Bluetooth RX context. The
+ * link may disconnect meanwhile, so hold a reference of our own. */
+static void tune_link(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    struct link *link = CONTAINER_OF(dwork, struct link, tune_work);
+    struct bt_conn *conn;
+    int err;
+
+    if (!link->conn) {
+        return;
+    }
+    conn = bt_conn_ref(link->conn);
+
+    err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+    if (err) {
+        LOG_WRN("PHY update failed (err %d)", err);
+    }
+
+    err = bt_conn_le_data_len_update(conn, BT_CONN_LE_DATA_LEN_MAX);
+    if (err) {
+        LOG_WRN("Data length update failed (err %d)", err);
+    }
+
+    /* Gone, or the slot belongs to a new connection by now */
+    if (link->conn != conn) {
+        bt_conn_unref(conn);
+        return;
+    }
+
+    link->exchange_params.func = exchange_func;
+    err = bt_gatt_exchange_mtu(conn, &link->exchange_params);
+    if (err) {
+        LOG_WRN("MTU exchange failed (err %d)", err);
+    }
+
+    request_params(link, conn);
+    bt_conn_unref(conn);
+}
+
+static void profile_update(struct k_work *work)
+{
+    struct link *link = CONTAINER_OF(work, struct link, profile_work);
+    struct bt_conn *conn;
+
+    if (!link->conn) {
+        return;
+    }
+    conn = bt_conn_ref(link->conn);
+    request_params(link, conn);
+    bt_conn_unref(conn);
+}
+
+static void on_connected(struct bt_conn *conn, uint8_t err)
+{
+    struct bt_conn_info conn_info;
+    struct link *link;
+
+    if (err) {
+        return;
+    }
+    link = find_link(NULL);
+    if (!link) {
+        return;
+    }
+
+    link->conn = bt_conn_ref(conn);
+    link->profile = LINK_PROFILE_LOW_POWER;
+    link->info.connected = true;
+    link->info.mtu = bt_gatt_get_mtu(conn);
+    if (bt_conn_get_info(conn, &conn_info) == 0) {
+        link->info.interval = conn_info.le.interval;
+        link->info.latency = conn_info.le.latency;
+        link->info.timeout = conn_info.le.timeout;
+    }
+
+    k_work_schedule(&link->tune_work, K_MSEC(LINK_TUNING_DELAY_MS));
+}
+
+static void on_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    struct link *link = find_link(conn);
+
+    if (!link) {
+        return;
+    }
+
+    /* The work items check for the connection, so pending ones are harmless */
+    k_work_cancel_delayable(&link->tune_work);
+    bt_conn_unref(link->conn);
+    link->conn = NULL;
+    memset(&link->info, 0, sizeof(link->info));
+}
+
+static void on_le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    struct link *link = find_link(conn);
+
+    if (!link) {
+        return;
+    }
+    link->info.interval = interval;
+    link->info.latency = latency;
+    link->info.timeout = timeout;
+    LOG_INF("Connection %p interval %u.%02u ms, latency %u, timeout %u ms", (void *)conn,
+            interval * 5 / 4, (interval * 125) % 100, latency, timeout * 10);
+}
+
+static void on_le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+    struct link *link = find_link(conn);
+
+    if (!link) {
+        return;
+    }
+    link->info.tx_phy = param->tx_phy;
+    link->info.rx_phy = param->rx_phy;
+    LOG_INF("PHY updated, TX %u RX %u", param->tx_phy, param->rx_phy);
+}
+
+static void on_le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *param)
+{
+    struct link *link = find_link(conn);
+
+    if (!link) {
+        return;
+    }
+    link->info.tx_max_len = param->tx_max_len;
+    link->info.rx_max_len = param->rx_max_len;
+    LOG_INF("Data length updated, TX %u RX %u octets", param->tx_max_len, param->rx_max_len);
+}
+
+static void on_att_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+    struct link *link = find_link(conn);
+
+    if (!link) {
+        return;
+    }
+    link->info.mtu = bt_gatt_get_mtu(conn);
+    LOG_INF("ATT MTU updated to %u", link->info.mtu);
+}
+
+static struct bt_conn_cb link_conn_callbacks = {
+    .connected = on_connected,
+    .disconnected = on_disconnected,
+    .le_param_updated = on_le_param_updated,
+    .le_phy_updated = on_le_phy_updated,
+    .le_data_len_updated = on_le_data_len_updated,
+};
+
+static struct bt_gatt_cb link_gatt_callbacks = {
+    .att_mtu_updated = on_att_mtu_updated,
+};
+
+int link_tuning_init(void)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+        k_work_init_delayable(&links[i].tune_work, tune_link);
+        k_work_init(&links[i].profile_work, profile_update);
+    }
+    bt_conn_cb_register(&link_conn_callbacks);
+    bt_gatt_cb_register(&link_gatt_callbacks);
+    return 0;
+}
+
+void link_tuning_set_profile(struct bt_conn *conn, enum link_profile profile)
+{
+    struct link *link = find_link(conn);
+
+    if (!link || link->profile == profile) {
+        return;
+    }
+    link->profile = profile;
+    k_work_submit(&link->profile_work);
+}
+
+int link_tuning_get_info(struct bt_conn *conn, struct link_info *out)
+{
+    struct link *link = find_link(conn);
+
+    if (!link) {
+        memset(out, 0, sizeof(*out));
+        return -ENOTCONN;
+    }
+    *out = link->info;
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __link_tuning_h__
+#define __link_tuning_h__
+
+#include <zephyr.h>
+#include <bluetooth/conn.h>
+
+/* Connection parameters are in 1.25 ms units, timeout in 10 ms units */
+
+/** @brief Streaming profile: 15-30 ms interval, no slave latency. **/
+#define LINK_STREAM_INTERVAL_MIN    12
+#define LINK_STREAM_INTERVAL_MAX    24
+#define LINK_STREAM_LATENCY         0
+#define LINK_STREAM_TIMEOUT         400
+
+/** @brief Low-power profile: 100-200 ms interval, skip up to 4 events. **/
+#define LINK_IDLE_INTERVAL_MIN      80
+#define LINK_IDLE_INTERVAL_MAX      160
+#define LINK_IDLE_LATENCY           4
+#define LINK_IDLE_TIMEOUT           600
+
+/** @brief Delay after connecting before the link is renegotiated. **/
+#define LINK_TUNING_DELAY_MS        100
+
+enum link_profile {
+    LINK_PROFILE_STREAMING,
+    LINK_PROFILE_LOW_POWER,
+};
+
+/** @brief Currently negotiated link values. **/
+struct link_info {
+    bool connected;
+    uint16_t interval;      // 1.25 ms units
+    uint16_t latency;
+    uint16_t timeout;       // 10 ms units
+    uint8_t tx_phy;
+    uint8_t rx_phy;
+    uint16_t tx_max_len;    // LL payload octets
+    uint16_t rx_max_len;
+    uint16_t mtu;           // ATT MTU
+};
+
+/* Every connection is tuned on its own and starts out low power */
+int link_tuning_init(void);
+void link_tuning_set_profile(struct bt_conn *conn, enum link_profile profile);
+int link_tuning_get_info(struct bt_conn *conn, struct link_info *info);
+
+#endif
@@ -1,282 +1,110 @@
 #include <zephyr.h>
 
 #include <device.h>
-#include <drivers/display.h>
-#include <lvgl.h>
-#include <stdio.h>
-#include <string.h>
-
 #include <devicetree.h>
+#include <logging/log.h>
+#include <timing/timing.h>
 #include <dk_buttons_and_leds.h>
-#include <drivers/sensor.h>
 #if !DT_HAS_COMPAT_STATUS_OKAY(adi_adxl345)
 #error "No adi,adxl345 compatible node found in the device tree"
 #endif
 
-struct adxl345_data
-{
-    /* data */
-    int16_t x;
-    int16_t y;
-    int16_t z;
-};
+#include "adxl345.h"
+#include "app_sensor.h"
+#include "battery.h"
+#include "i2c_bus.h"
+#include "app_ble.h"
+#include "app_display.h"
 
-#include "remote.h"
+LOG_MODULE_REGISTER(app, LOG_LEVEL_INF);
 
 #define RUN_STATUS_LED DK_LED1
-#define CONN_STATUS_LED DK_LED2
 #define RUN_LED_BLINK_INTERVAL 250
 
-static struct bt_conn *current_conn;
-bool isNotify = false;
-bool isConnected = false;
-static int counter = 0;
-
-// static void repeating_timer_callback(struct k_work *dummy){
-// 	counter++;
-// 	printk("Timer counter %d\n", counter);
-// }
+/* Readings logged once per second when nothing else shows them */
+#define LOG_READING_TICKS (1000 / RUN_LED_BLINK_INTERVAL)
 
-// K_WORK_DEFINE(repeating_timer_work, repeating_timer_callback);
+static K_SEM_DEFINE(tick_sem, 0, 1);
 
 void repeating_timer_handler(struct k_timer *dummy)
 {
-    // k_work_submit(&repeating_timer_work);
-	counter++;
+	k_sem_give(&tick_sem);
 }
 
 K_TIMER_DEFINE(my_timer, repeating_timer_handler, NULL);
 
-/* Declarations */
-void on_connected(struct bt_conn *conn, uint8_t err);
-void on_disconnected(struct bt_conn *conn, uint8_t reason);
-void on_notif_changed(enum bt_button_notifications_enabled status);
-void on_data_received(struct bt_conn *conn, const uint8_t *const data, uint16_t len);
-
-struct bt_conn_cb bluetooth_callbacks = {
-	.connected 		= on_connected,
-	.disconnected 	= on_disconnected,
-};
-
-struct bt_remote_service_cb remote_service_callbacks = {
-	.notif_changed = on_notif_changed,
-	.data_received = on_data_received,
-};
-
-/* Callback */
-void on_connected(struct bt_conn *conn, uint8_t err)
+static const char *link_status(void)
 {
-	if(err) {
-		printk("connection err: %d\n", err);
-		return;
+	switch (app_ble_link()) {
+	case APP_BLE_STREAMING:
+		return "BLE: Notified";
+	case APP_BLE_CONNECTED:
+		return "BLE: Connected";
+	default:
+		return "BLE: Disconnected";
 	}
-	printk("Connected.\n");
-	current_conn = bt_conn_ref(conn);
-	dk_set_led_on(CONN_STATUS_LED);
-    isConnected = true;
-}
-
-void on_disconnected(struct bt_conn *conn, uint8_t reason)
-{
-	printk("Disconnected (reason: %d)\n", reason);
-	dk_set_led_off(CONN_STATUS_LED);
-	if(current_conn) {
-		bt_conn_unref(current_conn);
-		current_conn = NULL;
-	}	
-    isConnected = false;
-}
-
-void on_notif_changed(enum bt_button_notifications_enabled status)
-{
-    if (status == BT_BUTTON_NOTIFICATIONS_ENABLED) {
-		isNotify = true;
-        printk("Notifications enabled\n");
-    } else {
-		isNotify = false;
-        printk("Notifications disabled\n");
-    }
-}
-
-void on_data_received(struct bt_conn *conn, const uint8_t *const data, uint16_t len)
-{
-    uint8_t temp_str[len+1];
-    memcpy(temp_str, data, len);
-    temp_str[len] = 0x00;
-
-    printk("Received data on conn %p. Len: %d\n", (void *)conn, len);
-    printk("Data: %s\n", temp_str);
-}
-
-void button_handler(uint32_t button_state, uint32_t has_changed)
-{
-    int err;
-	int button_pressed = 0;
-	if (has_changed & button_state)
-	{
-		switch (has_changed)
-		{
-			case DK_BTN1_MSK:
-				button_pressed = 1;
-				break;
-			case DK_BTN2_MSK:
-				button_pressed = 2;
-				break;
-			case DK_BTN3_MSK:
-				button_pressed = 3;
-				break;
-			case DK_BTN4_MSK:
-				button_pressed = 4;
-				break;
-			default:
-				break;
-		}
-        printk("Button %d pressed.\n", button_pressed);       
-		set_button_value(button_pressed);
-		err = send_button_notification(current_conn, &button_pressed, 1);
-		if (err) {
-            printk("Couldn't send notificaton. (err: %d)\n", err);
-        }
-    }
-}
-
-/* Configurations */
-static void configure_dk_buttons_leds(void)
-{
-    int err;
-    err = dk_leds_init();
-    if (err) {
-        printk("Couldn't init LEDS (err %d)\n", err);
-    }
-    err = dk_buttons_init(button_handler);
-    if (err) {
-        printk("Couldn't init buttons (err %d)\n", err);
-    }
 }
 
 void main(void)
 {
 	int err;
-    int blink_status = 0;
-
-    uint32_t count = 0U;
-	char count_str[20] = {0};
-    char ble_status_str[20] = {0};
-    char battery_status_str[20] = {0};
-	const struct device *display_dev;
-	lv_obj_t *hello_world_label;
-    lv_obj_t *count_label;
-    lv_obj_t *ble_status_label;
-    lv_obj_t *battery_status_label;
-
+	int blink_status = 0;
 
-	struct sensor_value accel[3], voltage;
-	struct adxl345_data adxl345_data;
+	struct app_display_status status = {0};
+	timing_t loop_start, loop_end;
 
-	printk("Hello World! %s\n", CONFIG_BOARD);
+	LOG_INF("Hello World! %s", CONFIG_BOARD);
 
-	configure_dk_buttons_leds();
+	/* k_cycle_get_32() is the 32 kHz RTC on nRF, too coarse for the
+	 * status loop; the timing counter is the CPU cycle counter */
+	timing_init();
+	timing_start();
 
-	err = bluetooth_init(&bluetooth_callbacks, &remote_service_callbacks);
-    if (err) {
-        printk("Couldn't initialize Bluetooth. err: %d\n", err);
-		return;
-    }
-
-	const struct device *sensor = DEVICE_DT_GET(DT_INST(0, adi_adxl345));
-
-	if (sensor == NULL || !device_is_ready(sensor)) {
-		printk("Could not get %s device\n", DT_LABEL(DT_INST(0, adi_adxl345)));
-		// return;
+	err = dk_leds_init();
+	if (err) {
+		LOG_ERR("Couldn't init LEDS (err %d)", err);
 	}
 
-	const struct device *dev = DEVICE_DT_GET(DT_INST(0, ti_bq274xx));
-	
-
-	if (dev == NULL || !device_is_ready(dev)) {
-		printk("Could not get %s device\n", DT_LABEL(DT_INST(0, ti_bq274xx)));
-		// return;
+	/* Both sensors share this bus; accelerometer transfers go first */
+	err = i2c_bus_init(DEVICE_DT_GET(DT_BUS(DT_INST(0, adi_adxl345))));
+	if (err) {
+		LOG_ERR("Couldn't start the I2C bus manager (err %d)", err);
 	}
 
-    display_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_display));
-	if (!device_is_ready(display_dev)) {
-		printk("Device not ready, aborting test");
-		return;
+	/* Failures are logged; whatever did start keeps running without the
+	 * rest, and the status loop below never touches a device */
+	if (IS_ENABLED(CONFIG_APP_BLE)) {
+		app_ble_init();
+	}
+	app_sensor_init(IS_ENABLED(CONFIG_APP_BLE) ? app_ble_on_samples : NULL);
+	battery_init(IS_ENABLED(CONFIG_APP_BLE) ? app_ble_on_battery : NULL);
+	if (IS_ENABLED(CONFIG_APP_DISPLAY)) {
+		app_display_init();
 	}
 
-    hello_world_label = lv_label_create(lv_scr_act(), NULL);
-
-    lv_label_set_text(hello_world_label, "Hello world!");
-	lv_obj_align(hello_world_label, NULL, LV_ALIGN_CENTER, 0, 0);
-
-    battery_status_label = lv_label_create(lv_scr_act(), NULL);
-	lv_obj_align(battery_status_label, NULL, LV_ALIGN_IN_TOP_LEFT, 0, 20);
-
-    ble_status_label = lv_label_create(lv_scr_act(), NULL);
-	lv_obj_align(ble_status_label, NULL, LV_ALIGN_IN_TOP_LEFT, 0, 0);
-
-	count_label = lv_label_create(lv_scr_act(), NULL);
-	lv_obj_align(count_label, NULL, LV_ALIGN_IN_BOTTOM_LEFT, 0, 0);
-
-    display_blanking_off(display_dev);
-    lv_task_handler();
-
-
-	k_timer_init(&my_timer, repeating_timer_handler, NULL);
-	k_timer_start(&my_timer, K_NO_WAIT, K_MSEC(250));	
-
-	while (1) {		
-		if(counter > 0){
-			counter = 0;
-			dk_set_led(RUN_STATUS_LED, (blink_status++)%2);		
-
-			if (sensor_sample_fetch(sensor) < 0) {
-				printk("sensor_sample_fetch failed\n");
-			}		
-
-			sensor_channel_get(sensor, SENSOR_CHAN_ACCEL_XYZ, accel);
-
-			adxl345_data.x = (int16_t) sensor_value_to_double(&accel[0]);
-			adxl345_data.y = (int16_t) sensor_value_to_double(&accel[1]);
-			adxl345_data.z = (int16_t) sensor_value_to_double(&accel[2]);
-
-			err = sensor_sample_fetch_chan(dev,
-						  SENSOR_CHAN_GAUGE_VOLTAGE);
-			if (err < 0) {
-				printk("Unable to fetch the voltage\n");
-				return;
-			}
+	k_timer_start(&my_timer, K_NO_WAIT, K_MSEC(RUN_LED_BLINK_INTERVAL));
 
-			err = sensor_channel_get(dev, SENSOR_CHAN_GAUGE_VOLTAGE,
-							&voltage);
-			if (err < 0) {
-				printk("Unable to get the voltage value\n");
-				return;
-			}
+	while (1) {
+		k_sem_take(&tick_sem, K_FOREVER);
+		loop_start = timing_counter_get();
 
-			printk("Voltage: %d.%06dV\n", voltage.val1, voltage.val2);
-            sprintf(battery_status_str, "Voltage: %d.%06dV\n", voltage.val1, voltage.val2);
+		dk_set_led(RUN_STATUS_LED, (blink_status++)%2);
 
-			if(isConnected){
-                sprintf(ble_status_str, "BLE: Connected");
-            } else {
-                sprintf(ble_status_str, "BLE: Disconnected");
-            }
+		/* Both only copy out a cache, neither touches the bus */
+		battery_get(&status.battery);
+		app_sensor_latest_mg(&status.accel_mg);
 
-			if(isNotify){
-                sprintf(ble_status_str, "BLE: Notified");
-				err = send_adxl345_notification(current_conn, (uint8_t*)&adxl345_data, sizeof(adxl345_data));
-				if (err) {
-					printk("Couldn't send notificaton. (err: %d)\n", err);
-				}
-			}
-            lv_task_handler();
-            sprintf(count_str, "X:%d,Y:%d,Z:%d", adxl345_data.x, adxl345_data.y, adxl345_data.z);
-			lv_label_set_text(count_label, count_str);
-            lv_label_set_text(ble_status_label, ble_status_str);
-            lv_label_set_text(battery_status_label, battery_status_str);
-			printk("X:%d,Y:%d,Z:%d\r\n", adxl345_data.x, adxl345_data.y, adxl345_data.z); 
+		if (IS_ENABLED(CONFIG_APP_DISPLAY)) {
+			status.link = IS_ENABLED(CONFIG_APP_BLE) ? link_status() : NULL;
+			app_display_update(&status);
+		} else if (!IS_ENABLED(CONFIG_APP_BLE) && (blink_status % LOG_READING_TICKS) == 0) {
+			LOG_INF("X:%d,Y:%d,Z:%d mg, battery %u mV %u%%", status.accel_mg.x,
+				status.accel_mg.y, status.accel_mg.z, status.battery.voltage_mv,
+				status.battery.soc);
 		}
-		k_sleep(K_MSEC(1));		
-	}	
-}
\ No newline at end of file
+		LOG_DBG("X:%d,Y:%d,Z:%d mg", status.accel_mg.x, status.accel_mg.y, status.accel_mg.z);
+		loop_end = timing_counter_get();
+		LOG_DBG("Loop took %u ns",
+			(uint32_t)timing_cycles_to_ns(timing_cycles_get(&loop_start, &loop_end)));
+	}
+}
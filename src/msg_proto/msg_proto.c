@@ -0,0 +1,55 @@
+#include "msg_proto.h"
+
+#include <sys/byteorder.h>
+
+BUILD_ASSERT(MSG_STATUS_FITS(EBADMSG) && MSG_STATUS_FITS(ENOTSUP) && MSG_STATUS_FITS(EINVAL),
+             "dispatcher errno doesn't fit the reply status");
+
+static void reply_status(uint8_t *out, uint8_t type, int status, int len,
+                         msg_send_t send, void *ctx)
+{
+    __ASSERT(status >= INT16_MIN, "status %d of type 0x%02x doesn't fit", status, type);
+
+    out[0] = type | MSG_REPLY_FLAG;
+    out[1] = MSG_STATUS_LEN + len;
+    sys_put_le16((uint16_t)(int16_t)status, &out[MSG_HDR_LEN]);
+    send(out, MSG_HDR_LEN + MSG_STATUS_LEN + len, ctx);
+}
+
+int msg_dispatch(const struct msg_command *table, size_t count, const uint8_t *data,
+                 size_t len, msg_send_t send, void *ctx)
+{
+    /* Handlers write their reply right behind the header */
+    uint8_t out[MSG_REPLY_LEN_MAX];
+    const struct msg_command *cmd;
+    size_t pos = 0;
+    int handled = 0;
+    uint8_t type, value_len;
+    int ret;
+
+    while (pos < len) {
+        type = data[pos];
+
+        if (len - pos < MSG_HDR_LEN || len - pos - MSG_HDR_LEN < data[pos + 1]) {
+            reply_status(out, type, -EBADMSG, 0, send, ctx);
+            return -EBADMSG;
+        }
+        value_len = data[pos + 1];
+
+        cmd = type < count ? &table[type] : NULL;
+        if (cmd == NULL || cmd->handle == NULL) {
+            ret = -ENOTSUP;
+        } else if (value_len < cmd->min_len || value_len > cmd->max_len) {
+            ret = -EINVAL;
+        } else {
+            ret = cmd->handle(&data[pos + MSG_HDR_LEN], value_len, &out[MSG_HDR_LEN + MSG_STATUS_LEN], ctx);
+            __ASSERT(ret <= MSG_REPLY_MAX, "reply of type 0x%02x too long", type);
+        }
+
+        reply_status(out, type, MIN(ret, 0), MAX(ret, 0), send, ctx);
+        pos += MSG_HDR_LEN + value_len;
+        handled++;
+    }
+
+    return handled;
+}
@@ -0,0 +1,51 @@
+#ifndef __msg_proto_h__
+#define __msg_proto_h__
+
+#include <zephyr.h>
+
+/* Command records on the message characteristic.
+ *
+ * A write holds one or more TLV records: a type byte, a length byte and
+ * that many value bytes. Records are parsed in place in the write buffer
+ * and dispatched through a table indexed by type. Every record is answered
+ * with a reply record: its type with MSG_REPLY_FLAG set, a length byte, a
+ * little-endian int16 status (0 or a negative errno) and whatever the
+ * handler wrote.
+ *
+ * Unknown types are answered with -ENOTSUP and lengths outside the
+ * command's bounds with -EINVAL, without calling the handler. A record
+ * that runs past the end of the write is answered with -EBADMSG and ends
+ * the parse. */
+
+#define MSG_HDR_LEN         2
+#define MSG_REPLY_FLAG      0x80
+#define MSG_STATUS_LEN      2
+/** @brief Reply value bytes a handler may write, status excluded. **/
+#define MSG_REPLY_MAX       32
+#define MSG_REPLY_LEN_MAX   (MSG_HDR_LEN + MSG_STATUS_LEN + MSG_REPLY_MAX)
+
+/** @brief Whether the errno err goes out unchanged as a reply status.
+ * Tables check the errors of their handlers with it at build time. **/
+#define MSG_STATUS_FITS(err)    ((err) > 0 && (err) <= -INT16_MIN)
+
+/** @brief Handles the len value bytes of one record. Returns the number
+ * of bytes written to reply, at most MSG_REPLY_MAX, or a negative error
+ * code. **/
+typedef int (*msg_handler_t)(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx);
+
+/** @brief Sends one reply record. **/
+typedef void (*msg_send_t)(const uint8_t *reply, uint16_t len, void *ctx);
+
+struct msg_command {
+    msg_handler_t handle;
+    uint8_t min_len;
+    uint8_t max_len;
+};
+
+/* Dispatches the records in data through table, which has count entries
+ * indexed by type. ctx is passed to the handlers and send. Returns the
+ * number of records handled, or -EBADMSG if the write ended inside one. */
+int msg_dispatch(const struct msg_command *table, size_t count, const uint8_t *data,
+                 size_t len, msg_send_t send, void *ctx);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __adxl345_frame_h__
+#define __adxl345_frame_h__
+
+#include <zephyr.h>
+
+/* Frame layout shared by the stream and the flash log, kept apart from
+ * the Bluetooth service so the log builds without it. */
+
+/** @brief Header of a batched ADXL345 notification.
+ *
+ * Followed by count samples, oldest first, encoded as given by format:
+ * little-endian int16_t X/Y/Z triplets for ADXL345_FRAME_RAW, or one
+ * accel_codec block for ADXL345_FRAME_DELTA.
+ * All fields are little-endian. seq increments once per frame so the
+ * receiver can spot lost frames, timestamp is the capture time of the
+ * first sample in microseconds and odr is the BW_RATE rate code the
+ * samples were taken at. period is the spacing of the samples in 1/256
+ * us, measured against the device clock, so sample i was captured at
+ * timestamp + i * period / 256. **/
+struct adxl345_frame_header {
+	uint16_t seq;
+	uint32_t timestamp;
+	uint8_t count;
+	uint8_t odr;
+	uint8_t format;
+	uint32_t period;
+} __packed;
+
+enum adxl345_frame_format {
+	ADXL345_FRAME_RAW,
+	ADXL345_FRAME_DELTA,
+	ADXL345_FRAME_FORMAT_COUNT,
+};
+
+#endif
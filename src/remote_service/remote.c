@@ -1,16 +1,63 @@
 #include "remote.h"
+#include "link_tuning.h"
+#include "l2cap_stream.h"
+#include "sample_clock.h"
+#include <sys/byteorder.h>
 
-// #define LOG_MODULE_NAME remote
-// LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+#define LOG_MODULE_NAME remote
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_INF);
+
+/** @brief Minimum spacing of warnings from the streaming path. **/
+#define STREAM_LOG_INTERVAL_MS 1000
+/** @brief Rate changes queued ahead of the stream. **/
+#define STREAM_ODR_CHANGES 4
 
 static K_SEM_DEFINE(bt_init_ok, 0, 1);
 
 #define DEVICE_NAME CONFIG_BT_DEVICE_NAME
 #define DEVICE_NAME_LEN (sizeof(DEVICE_NAME)-1)
 
+/* Frames are encoded once per format, every subscriber of the format
+ * gets the same bytes */
+struct stream_group {
+    struct accel_codec_enc encoder;
+    uint16_t seq;
+};
+
+/* Rate the samples from a ring position on were taken at */
+struct odr_change {
+    uint32_t pos;
+    uint8_t odr;
+};
+
+/* Stream state of a connection */
+struct stream_sub {
+    struct bt_conn *conn;
+    atomic_t credits;           // frames it may still hand to the stack
+    enum adxl345_frame_format format;
+    bool enabled;               // stopped subscribers get no frames
+    bool resync;                // missed samples, wants a keyframe next
+};
+
 static uint8_t button_value = 0;
+static struct stream_group stream_groups[ADXL345_FRAME_FORMAT_COUNT];
+static struct stream_sub stream_subs[CONFIG_BT_MAX_CONN];
+static struct sample_ring *stream_ring;
+static uint8_t stream_odr = BW_RATE_DEFAULT;
+/* Rate changes the stream hasn't reached yet, oldest first, under irq_lock */
+static struct odr_change odr_changes[STREAM_ODR_CHANGES];
+static uint8_t odr_change_head;
+static uint8_t odr_change_count;
+static struct adxl345_tx_stats tx_stats;
+static adxl345_offline_sink_t offline_sink;
+static adxl345_backlog_read_t backlog_read;
+static bool features_notify;
+static bool events_notify;
+static int64_t last_stream_log;
+/* The last stream pass had somebody to send to. Both writers run on
+ * cooperative threads. */
+static bool stream_live;
 static struct bt_remote_service_cb remote_service_callbacks;
-enum bt_button_notifications_enabled notifications_enabled;
 
 static const struct bt_data ad[] = {
     BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
@@ -27,9 +74,15 @@ static const struct bt_data sd[] = {
 /* Declarations */
 static ssize_t read_button_characteristic_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 void button_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value);
-void adxl345_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value);
+static ssize_t adxl345_ccc_write(struct bt_conn *conn, const struct bt_gatt_attr *attr, uint16_t value);
+void features_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value);
+void events_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value);
+void message_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value);
 static ssize_t on_write(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+static ssize_t read_psm_characteristic_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 
+/* Written per connection, so each subscriber gets its own stream state */
+static struct _bt_gatt_ccc adxl345_ccc = BT_GATT_CCC_INITIALIZER(NULL, adxl345_ccc_write, NULL);
 
 BT_GATT_SERVICE_DEFINE(remote_srv,
 BT_GATT_PRIMARY_SERVICE(BT_UUID_REMOTE_SERVICE),
@@ -40,11 +93,22 @@ BT_GATT_PRIMARY_SERVICE(BT_UUID_REMOTE_SERVICE),
     BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
     BT_GATT_CHARACTERISTIC(BT_UUID_ADXL345_CHRC,
                     BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ, NULL, NULL, NULL),
-    BT_GATT_CCC(adxl345_chrc_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),  // notification CCC
+    BT_GATT_CCC_MANAGED(&adxl345_ccc, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),  // notification CCC
     BT_GATT_CHARACTERISTIC(BT_UUID_REMOTE_MESSAGE_CHRC, 
-                    BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+                    BT_GATT_CHRC_WRITE_WITHOUT_RESP | BT_GATT_CHRC_NOTIFY,
                     BT_GATT_PERM_WRITE,
                     NULL, on_write, NULL), 
+    BT_GATT_CCC(message_chrc_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_REMOTE_L2CAP_PSM_CHRC,
+                    BT_GATT_CHRC_READ,
+                    BT_GATT_PERM_READ,
+                    read_psm_characteristic_cb, NULL, NULL),
+    BT_GATT_CHARACTERISTIC(BT_UUID_REMOTE_FEATURES_CHRC,
+                    BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ, NULL, NULL, NULL),
+    BT_GATT_CCC(features_chrc_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_REMOTE_EVENTS_CHRC,
+                    BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ, NULL, NULL, NULL),
+    BT_GATT_CCC(events_chrc_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 );
 
 /* Callback */
@@ -52,7 +116,7 @@ BT_GATT_PRIMARY_SERVICE(BT_UUID_REMOTE_SERVICE),
 void bt_ready(int err)
 {
     if (err) {
-        printk("bt_ready returned %d\n", err);
+        LOG_ERR("bt_ready returned %d", err);
     }
 
     k_sem_give(&bt_init_ok);
@@ -66,6 +130,14 @@ static ssize_t read_button_characteristic_cb(struct bt_conn *conn, const struct
 				 sizeof(button_value));
 }
 
+static ssize_t read_psm_characteristic_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			 void *buf, uint16_t len, uint16_t offset)
+{
+	uint16_t psm = sys_cpu_to_le16(l2cap_stream_psm());
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &psm, sizeof(psm));
+}
+
 // notification callback
 // void button_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
 // {
@@ -78,21 +150,58 @@ static ssize_t read_button_characteristic_cb(struct bt_conn *conn, const struct
 //     }
 // }
 
-void adxl345_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+static struct stream_sub *find_sub(struct bt_conn *conn)
 {
+    for (size_t i = 0; i < ARRAY_SIZE(stream_subs); i++) {
+        if (stream_subs[i].conn == conn) {
+            return &stream_subs[i];
+        }
+    }
+    return NULL;
+}
+
+/* Called before the stack stores the value */
+static ssize_t adxl345_ccc_write(struct bt_conn *conn, const struct bt_gatt_attr *attr, uint16_t value)
+{
+    struct stream_sub *sub = find_sub(conn);
     bool notif_enabled = (value == BT_GATT_CCC_NOTIFY);
-    printk("Notifications %s\n", notif_enabled? "enabled":"disabled");
-    notifications_enabled = notif_enabled ? BT_BUTTON_NOTIFICATIONS_ENABLED:BT_BUTTON_NOTIFICATIONS_DISABLED;
+
+    LOG_INF("Notifications %s on %p", notif_enabled ? "enabled" : "disabled", (void *)conn);
+
+    /* A new subscriber has no history to apply deltas to */
+    if (sub && notif_enabled) {
+        sub->resync = true;
+        adxl345_stream_kick();
+    }
 
     if (remote_service_callbacks.notif_changed) {
-        remote_service_callbacks.notif_changed(notifications_enabled);
+        remote_service_callbacks.notif_changed(conn, notif_enabled ?
+            BT_BUTTON_NOTIFICATIONS_ENABLED : BT_BUTTON_NOTIFICATIONS_DISABLED);
     }
+    return sizeof(value);
+}
+
+void features_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    features_notify = (value == BT_GATT_CCC_NOTIFY);
+    LOG_INF("Feature notifications %s", features_notify ? "enabled" : "disabled");
+}
+
+void events_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    events_notify = (value == BT_GATT_CCC_NOTIFY);
+    LOG_INF("Event notifications %s", events_notify ? "enabled" : "disabled");
+}
+
+void message_chrc_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    LOG_INF("Message replies %s", value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
 }
 
 void on_sent(struct bt_conn *conn, void *user_data)
 {
     ARG_UNUSED(user_data);
-    printk("Notification sent on connection %p\n", (void *)conn);
+    LOG_DBG("Notification sent on connection %p", (void *)conn);
 }
 
 static ssize_t on_write(struct bt_conn *conn,
@@ -102,7 +211,7 @@ static ssize_t on_write(struct bt_conn *conn,
                         uint16_t offset,
                         uint8_t flags)
 {
-    printk("Received data, handle %d, conn %p\n",
+    LOG_DBG("Received data, handle %d, conn %p",
         attr->handle, (void *)conn);
 
     if (remote_service_callbacks.data_received) {
@@ -152,25 +261,715 @@ int send_adxl345_notification(struct bt_conn *conn, uint8_t *value, uint16_t len
     return err;
 }
 
+bool features_notifications_enabled(void)
+{
+    return features_notify;
+}
+
+/* Notifies every connection subscribed to attr. Returns 0 if any of them
+ * took it, else the last error or -ENOTCONN. */
+static int notify_subscribers(const struct bt_gatt_attr *attr, const void *data, uint16_t len)
+{
+    struct bt_conn *conn;
+    bool sent = false;
+    int err = -ENOTCONN;
+
+    for (size_t i = 0; i < ARRAY_SIZE(stream_subs); i++) {
+        conn = stream_subs[i].conn;
+        if (!conn || !bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY)) {
+            continue;
+        }
+        if (bt_gatt_get_mtu(conn) - 3 < len) {
+            err = -EMSGSIZE;
+            continue;
+        }
+
+        err = bt_gatt_notify(conn, attr, data, len);
+        sent |= (err == 0);
+    }
+
+    return sent ? 0 : err;
+}
+
+int send_features_notification(const struct accel_features_frame *frame)
+{
+    if (!features_notify) {
+        return -ENOTCONN;
+    }
+
+    return notify_subscribers(&remote_srv.attrs[12], frame, sizeof(*frame));
+}
+
+int send_event_notification(const struct accel_event *event)
+{
+    if (!events_notify) {
+        return -ENOTCONN;
+    }
+
+    return notify_subscribers(&remote_srv.attrs[15], event, sizeof(*event));
+}
+
+int send_message_notification(struct bt_conn *conn, const void *data, uint16_t len)
+{
+    if (!conn || !bt_gatt_is_subscribed(conn, &remote_srv.attrs[7], BT_GATT_CCC_NOTIFY)) {
+        return -ENOTCONN;
+    }
+    if (bt_gatt_get_mtu(conn) - 3 < len) {
+        return -EMSGSIZE;
+    }
+
+    return bt_gatt_notify(conn, &remote_srv.attrs[7], data, len);
+}
+
+static uint16_t adxl345_frame_payload(struct bt_conn *conn)
+{
+    /* ATT notification payload is MTU minus the 3-byte opcode/handle */
+    return MIN(bt_gatt_get_mtu(conn) - 3, ADXL345_FRAME_MAX_LEN);
+}
+
+BUILD_ASSERT(sizeof(struct adxl345_frame_header) + ADXL345_SAMPLE_SIZE <= ADXL345_FRAME_MIN_LEN,
+             "a raw frame must hold a sample at the default ATT MTU");
+
+uint16_t adxl345_frame_capacity(struct bt_conn *conn)
+{
+    uint16_t payload = adxl345_frame_payload(conn);
+
+    if (payload < sizeof(struct adxl345_frame_header) + ADXL345_SAMPLE_SIZE) {
+        return 0;
+    }
+    return (payload - sizeof(struct adxl345_frame_header)) / ADXL345_SAMPLE_SIZE;
+}
+
+static size_t pack_raw(const struct sample_record *records, size_t count, uint8_t *p, size_t space)
+{
+    size_t n = MIN(count, space / ADXL345_SAMPLE_SIZE);
+
+    for (size_t i = 0; i < n; i++) {
+        sys_put_le16(records[i].data.x, p);
+        sys_put_le16(records[i].data.y, p + 2);
+        sys_put_le16(records[i].data.z, p + 4);
+        p += ADXL345_SAMPLE_SIZE;
+    }
+    return n;
+}
+
+static size_t pack_delta(struct accel_codec_enc *enc, const struct sample_record *records, size_t count,
+                         uint8_t *p, size_t space, size_t *used)
+{
+    size_t n = 0;
+    size_t len;
+
+    if (space < ACCEL_CODEC_BLOCK_HEADER_LEN + ACCEL_CODEC_MAX_SAMPLE_LEN) {
+        *used = 0;
+        return 0;
+    }
+
+    len = accel_codec_begin_block(enc, p);
+    while (n < count && n < UINT8_MAX && len + ACCEL_CODEC_MAX_SAMPLE_LEN <= space) {
+        const int16_t xyz[3] = {records[n].data.x, records[n].data.y, records[n].data.z};
+
+        len += accel_codec_encode(enc, xyz, p + len);
+        n++;
+    }
+    *used = len;
+    return n;
+}
+
+/* Builds the group's next frame into the size bytes at frame and returns
+ * how many samples it holds. The encoder has advanced past them; callers
+ * restore it if the frame is not sent. */
+static int build_adxl345_frame(enum adxl345_frame_format format, const struct sample_record *records,
+                               size_t count, uint8_t odr, uint8_t *frame, size_t size, size_t *frame_len)
+{
+    struct stream_group *group = &stream_groups[format];
+    struct adxl345_frame_header *hdr = (struct adxl345_frame_header *)frame;
+    size_t space = size - sizeof(*hdr);
+    size_t n, len;
+
+    if (count == 0 || size <= sizeof(*hdr)) {
+        return -EMSGSIZE;
+    }
+
+    if (format == ADXL345_FRAME_DELTA) {
+        n = pack_delta(&group->encoder, records, count, frame + sizeof(*hdr), space, &len);
+    } else {
+        n = pack_raw(records, MIN(count, UINT8_MAX), frame + sizeof(*hdr), space);
+        len = n * ADXL345_SAMPLE_SIZE;
+    }
+    if (n == 0) {
+        return -EMSGSIZE;
+    }
+
+    hdr->seq = sys_cpu_to_le16(group->seq);
+    hdr->timestamp = sys_cpu_to_le32((uint32_t)sample_clock_to_us(records[0].timestamp));
+    hdr->count = n;
+    hdr->odr = odr;
+    hdr->format = format;
+    hdr->period = sys_cpu_to_le32(sample_clock_period_us_q8(odr));
+
+    *frame_len = sizeof(*hdr) + len;
+    return n;
+}
+
+/* Streaming to every subscribed connection with credit-based flow
+ * control. Each subscriber has credits for the frames it may have in
+ * flight, taken for every frame handed to the stack and returned from its
+ * TX-complete callback, so no central queues more than its share of the
+ * TX buffers. The central holding the L2CAP channel gets its frames there
+ * instead, gated by the SDU buffer pool.
+ *
+ * Frames are encoded once per format and the same bytes go to everyone
+ * that asked for it. Samples stay in the ring while no subscriber can take
+ * a frame; one that can't while others can skips the frame and gets a
+ * keyframe next. */
+
+static void stream_tx(struct k_work *work);
+
+static K_WORK_DEFINE(stream_work, stream_tx);
+
+/* Subscribers of one format that take the next frame */
+struct stream_fanout {
+    struct stream_sub *ready[CONFIG_BT_MAX_CONN];   // over GATT
+    size_t ready_count;
+    struct stream_sub *lagging[CONFIG_BT_MAX_CONN]; // out of credits or buffers
+    size_t lagging_count;
+    struct stream_sub *sdu_sub;     // the L2CAP subscriber, if it is one
+    struct net_buf *sdu;
+    size_t size;                    // frame size all of them take
+    bool resync;
+};
+
+static void on_frame_sent(struct bt_conn *conn, void *user_data)
+{
+    struct stream_sub *sub = user_data;
+
+    tx_stats.frames_completed++;
+    /* The slot may hold a newer connection by now */
+    if (sub->conn == conn && atomic_get(&sub->credits) < ADXL345_SUB_TX_CREDITS) {
+        atomic_inc(&sub->credits);
+    }
+    k_work_submit(&stream_work);
+}
+
+static bool sub_listening(const struct stream_sub *sub)
+{
+    if (!sub->conn || !sub->enabled) {
+        return false;
+    }
+    if (sub->conn == l2cap_stream_conn()) {
+        return true;
+    }
+    return bt_gatt_is_subscribed(sub->conn, &remote_srv.attrs[4], BT_GATT_CCC_NOTIFY);
+}
+
+/* Format of the subscriber's next frame. A delta frame can't hold one
+ * worst-case sample before the MTU exchange, or ever with centrals that
+ * keep the default MTU, so those get raw frames meanwhile. */
+static enum adxl345_frame_format sub_format(struct stream_sub *sub, struct bt_conn *l2cap_conn)
+{
+    if (sub->format == ADXL345_FRAME_DELTA && sub->conn != l2cap_conn &&
+        adxl345_frame_payload(sub->conn) < ADXL345_DELTA_MIN_LEN) {
+        /* It has no history to apply deltas to once they fit */
+        sub->resync = true;
+        return ADXL345_FRAME_RAW;
+    }
+    return sub->format;
+}
+
+static bool fanout_ready(const struct stream_fanout *fan)
+{
+    return fan->ready_count > 0 || fan->sdu;
+}
+
+static void stream_collect(enum adxl345_frame_format format, struct stream_fanout *fan, bool *listening)
+{
+    struct bt_conn *l2cap_conn = l2cap_stream_conn();
+    struct stream_sub *sub;
+
+    memset(fan, 0, sizeof(*fan));
+    fan->size = SIZE_MAX;
+
+    for (size_t i = 0; i < ARRAY_SIZE(stream_subs); i++) {
+        sub = &stream_subs[i];
+        if (!sub_listening(sub) || sub_format(sub, l2cap_conn) != format) {
+            continue;
+        }
+        *listening = true;
+
+        if (sub->conn == l2cap_conn) {
+            fan->sdu = l2cap_stream_alloc();
+            if (!fan->sdu) {
+                /* The ready callback resubmits once a buffer is free */
+                fan->lagging[fan->lagging_count++] = sub;
+                continue;
+            }
+            fan->sdu_sub = sub;
+            fan->size = MIN(fan->size, MIN(net_buf_tailroom(fan->sdu), l2cap_stream_max_sdu()));
+        } else if (atomic_get(&sub->credits) > 0) {
+            fan->ready[fan->ready_count++] = sub;
+            fan->size = MIN(fan->size, adxl345_frame_payload(sub->conn));
+        } else {
+            /* on_frame_sent() resubmits once a credit comes back */
+            fan->lagging[fan->lagging_count++] = sub;
+            continue;
+        }
+        fan->resync |= sub->resync;
+    }
+}
+
+static void stream_release(struct stream_fanout *fan)
+{
+    if (fan->sdu) {
+        net_buf_unref(fan->sdu);
+        fan->sdu = NULL;
+    }
+}
+
+/* Builds one frame of the format and sends it to the subscribers in fan.
+ * Returns the number of samples in it, or the last error if none of them
+ * took it. */
+static int stream_send_group(enum adxl345_frame_format format, struct stream_fanout *fan,
+                             const struct sample_record *records, size_t count)
+{
+    struct stream_group *group = &stream_groups[format];
+    struct accel_codec_enc saved = group->encoder;
+    struct bt_gatt_notify_params params = {0};
+    uint8_t stack_frame[ADXL345_FRAME_MAX_LEN];
+    uint8_t *frame = fan->sdu ? net_buf_tail(fan->sdu) : stack_frame;
+    struct stream_sub *sub;
+    size_t len, sent = 0;
+    int err = -ENOTCONN;
+    int n;
+
+    if (fan->resync) {
+        accel_codec_force_keyframe(&group->encoder);
+    }
+
+    n = build_adxl345_frame(format, records, count, stream_odr, frame, fan->size, &len);
+    if (n < 0) {
+        stream_release(fan);
+        group->encoder = saved;
+        return n;
+    }
+
+    params.attr = &remote_srv.attrs[4];
+    params.data = frame;
+    params.len = len;
+    params.func = on_frame_sent;
+
+    /* The stack copies the frame, so the SDU can still go out after */
+    for (size_t i = 0; i < fan->ready_count; i++) {
+        sub = fan->ready[i];
+        params.user_data = sub;
+
+        atomic_dec(&sub->credits);
+        err = bt_gatt_notify_cb(sub->conn, &params);
+        if (err) {
+            atomic_inc(&sub->credits);
+            sub->resync = true;
+            continue;
+        }
+        /* Only a delta frame brings it back in sync */
+        if (format == ADXL345_FRAME_DELTA) {
+            sub->resync = false;
+        }
+        tx_stats.frames_sent++;
+        tx_stats.bytes_sent += len;
+        sent++;
+    }
+
+    if (fan->sdu) {
+        net_buf_add(fan->sdu, len);
+        err = l2cap_stream_send(fan->sdu);
+        fan->sdu = NULL;
+        if (err) {
+            fan->sdu_sub->resync = true;
+        } else {
+            if (format == ADXL345_FRAME_DELTA) {
+                fan->sdu_sub->resync = false;
+            }
+            tx_stats.frames_sent++;
+            tx_stats.l2cap_frames++;
+            tx_stats.bytes_sent += len;
+            sent++;
+        }
+    }
+
+    if (sent == 0) {
+        /* The samples stay queued, so encode them again next time */
+        group->encoder = saved;
+        return err;
+    }
+
+    group->seq++;
+    tx_stats.frames_encoded++;
+    return n;
+}
+
+/* Marks the subscribers of fan that miss samples another group consumed.
+ * They get a keyframe next, and if none of them got the frame the group's
+ * seq moves on so the receivers see the gap. */
+static void stream_skip(enum adxl345_frame_format format, struct stream_fanout *fan, bool sent)
+{
+    size_t missed = fan->lagging_count;
+
+    for (size_t i = 0; i < fan->lagging_count; i++) {
+        fan->lagging[i]->resync = true;
+    }
+    if (!sent) {
+        /* Ready, but the frame didn't go out to them */
+        for (size_t i = 0; i < fan->ready_count; i++) {
+            fan->ready[i]->resync = true;
+        }
+        if (fan->sdu_sub) {
+            fan->sdu_sub->resync = true;
+        }
+        missed += fan->ready_count + (fan->sdu_sub != NULL);
+        if (missed > 0) {
+            stream_groups[format].seq++;
+        }
+    }
+    tx_stats.skipped += missed;
+}
+
+/* Sends the next frame to every subscriber that can take one. Frames of
+ * both formats hold the same samples, so the raw frame size limits the
+ * delta frame. Returns the number of samples sent, -ENOTCONN if nobody is
+ * listening, -EAGAIN if no subscriber can take a frame or another error
+ * if sending failed. */
+static int stream_fan_out(const struct sample_record *records, size_t count)
+{
+    struct stream_fanout raw, delta;
+    bool listening = false;
+    bool delta_sent = false;
+    int sent = -EAGAIN;
+    int err = -EAGAIN;
+
+    stream_collect(ADXL345_FRAME_RAW, &raw, &listening);
+    stream_collect(ADXL345_FRAME_DELTA, &delta, &listening);
+    if (!listening) {
+        return -ENOTCONN;
+    }
+
+    if (fanout_ready(&delta)) {
+        if (fanout_ready(&raw) && raw.size > sizeof(struct adxl345_frame_header)) {
+            count = MIN(count, MIN((raw.size - sizeof(struct adxl345_frame_header)) / ADXL345_SAMPLE_SIZE,
+                                   UINT8_MAX));
+        }
+        sent = stream_send_group(ADXL345_FRAME_DELTA, &delta, records, count);
+        if (sent < 0) {
+            stream_release(&raw);
+            return sent;
+        }
+        count = sent;
+        delta_sent = true;
+    }
+
+    if (fanout_ready(&raw)) {
+        err = stream_send_group(ADXL345_FRAME_RAW, &raw, records, count);
+        if (sent < 0) {
+            sent = err;
+        }
+    }
+    if (sent < 0) {
+        /* No subscriber took the samples */
+        return sent;
+    }
+
+    /* The samples are gone for every subscriber of either format that
+     * didn't get them */
+    stream_skip(ADXL345_FRAME_DELTA, &delta, delta_sent);
+    stream_skip(ADXL345_FRAME_RAW, &raw, err >= 0);
+    return sent;
+}
+
+/* Sends backlog blocks until they run out or the SDU buffers do. Returns
+ * true while the backlog has more to send. */
+static bool stream_backlog(void)
+{
+    struct net_buf *buf;
+    int len, err;
+
+    while (backlog_read) {
+        if (!l2cap_stream_connected()) {
+            backlog_read = NULL;
+            break;
+        }
+
+        buf = l2cap_stream_alloc();
+        if (!buf) {
+            /* The ready callback resubmits once a buffer is free */
+            return true;
+        }
+
+        len = backlog_read(net_buf_tail(buf),
+                           MIN(net_buf_tailroom(buf), l2cap_stream_max_sdu()));
+        if (len <= 0) {
+            if (len < 0) {
+                LOG_WRN("Backlog download stopped (err %d)", len);
+            }
+            net_buf_unref(buf);
+            backlog_read = NULL;
+            break;
+        }
+        net_buf_add(buf, len);
+
+        err = l2cap_stream_send(buf);
+        if (err) {
+            LOG_WRN("Couldn't send backlog block (err %d)", err);
+            backlog_read = NULL;
+            break;
+        }
+        tx_stats.bytes_sent += len;
+        tx_stats.backlog_frames++;
+    }
+
+    return false;
+}
+
+/* Length of the run at the start of a claim of n that was taken at
+ * stream_odr, switching to each queued rate once it is reached */
+static size_t stream_odr_run(size_t n)
+{
+    unsigned int key = irq_lock();
+    uint32_t read_pos = sample_ring_read_pos(stream_ring);
+
+    while (odr_change_count > 0) {
+        const struct odr_change *next = &odr_changes[odr_change_head];
+        uint32_t before = next->pos - read_pos;
+
+        if (before > 0) {
+            n = MIN(n, before);
+            break;
+        }
+        stream_odr = next->odr;
+        odr_change_head = (odr_change_head + 1) % STREAM_ODR_CHANGES;
+        odr_change_count--;
+    }
+    irq_unlock(key);
+
+    return n;
+}
+
+static void stream_tx(struct k_work *work)
+{
+    struct sample_record *records;
+    size_t n;
+    int err;
+
+    /* The backlog goes first so live frames keep their order behind it */
+    if (stream_backlog()) {
+        return;
+    }
+
+    if (!stream_ring) {
+        return;
+    }
+
+    while ((n = sample_ring_get_claim(stream_ring, &records)) > 0) {
+        /* Frames and log blocks carry a single rate */
+        n = stream_odr_run(n);
+        err = stream_fan_out(records, n);
+
+        if (err == -ENOTCONN) {
+            /* Nobody is listening, keep the samples offline if we can and
+             * don't let the ring overrun */
+            if (stream_live) {
+                stream_live = false;
+                if (remote_service_callbacks.stream_lost) {
+                    remote_service_callbacks.stream_lost();
+                }
+            }
+            if (offline_sink) {
+                offline_sink(records, n, stream_odr);
+            }
+            sample_ring_get_finish(stream_ring, n);
+            continue;
+        }
+        if (err == -EAGAIN || err == -ENOMEM) {
+            /* Out of credits or buffers, retried from the TX-complete
+             * callbacks or the next kick */
+            tx_stats.retries++;
+            break;
+        }
+        if (err < 0) {
+            tx_stats.dropped += n;
+            if (k_uptime_get() - last_stream_log >= STREAM_LOG_INTERVAL_MS) {
+                last_stream_log = k_uptime_get();
+                LOG_WRN("Couldn't send frame (err: %d), %u samples dropped so far",
+                        err, tx_stats.dropped);
+            }
+            sample_ring_get_finish(stream_ring, n);
+            continue;
+        }
+
+        stream_live = true;
+        tx_stats.samples_sent += err;
+        sample_ring_get_finish(stream_ring, err);
+    }
+}
+
+int set_adxl345_stream_mode(struct bt_conn *conn, bool enabled, enum adxl345_frame_format format)
+{
+    struct stream_sub *sub = conn ? find_sub(conn) : NULL;
+
+    if (!sub) {
+        return -ENOTCONN;
+    }
+    if (format >= ADXL345_FRAME_FORMAT_COUNT) {
+        return -EINVAL;
+    }
+
+    /* The receiver missed the samples in between, or switches encoders */
+    if ((enabled && !sub->enabled) || format != sub->format) {
+        sub->resync = true;
+    }
+    sub->enabled = enabled;
+    sub->format = format;
+    if (!enabled && adxl345_stream_subscribers() == 0) {
+        /* Stopped on purpose, not lost */
+        stream_live = false;
+    }
+    adxl345_stream_kick();
+    return 0;
+}
+
+size_t adxl345_stream_subscribers(void)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(stream_subs); i++) {
+        if (sub_listening(&stream_subs[i])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void set_adxl345_stream_source(struct sample_ring *ring, uint8_t odr)
+{
+    unsigned int key = irq_lock();
+
+    stream_ring = ring;
+    stream_odr = odr;
+    odr_change_count = 0;
+    irq_unlock(key);
+}
+
+void set_adxl345_stream_odr(uint8_t odr)
+{
+    unsigned int key = irq_lock();
+    uint32_t pos = sample_ring_write_pos(stream_ring);
+    struct odr_change *last = NULL;
+
+    if (odr_change_count > 0) {
+        last = &odr_changes[(odr_change_head + odr_change_count - 1) % STREAM_ODR_CHANGES];
+    }
+
+    /* Samples already in the ring were taken at the rates before. A
+     * change at the same position as the last one replaces it, since no
+     * sample was taken in between; so does one that finds the queue full,
+     * which can only mislabel the few samples between the two. */
+    if (last && (last->pos == pos || odr_change_count == STREAM_ODR_CHANGES)) {
+        last->pos = pos;
+        last->odr = odr;
+    } else {
+        odr_changes[(odr_change_head + odr_change_count) % STREAM_ODR_CHANGES] =
+            (struct odr_change){ .pos = pos, .odr = odr };
+        odr_change_count++;
+    }
+    irq_unlock(key);
+
+    adxl345_stream_kick();
+}
+
+void adxl345_stream_kick(void)
+{
+    k_work_submit(&stream_work);
+}
+
+void set_adxl345_offline_sink(adxl345_offline_sink_t sink)
+{
+    offline_sink = sink;
+}
+
+int adxl345_backlog_download(adxl345_backlog_read_t read)
+{
+    if (!l2cap_stream_connected()) {
+        return -ENOTCONN;
+    }
+
+    backlog_read = read;
+    k_work_submit(&stream_work);
+    return 0;
+}
+
+void get_adxl345_tx_stats(struct adxl345_tx_stats *stats)
+{
+    *stats = tx_stats;
+}
+
+static void stream_connected(struct bt_conn *conn, uint8_t err)
+{
+    struct stream_sub *sub;
+
+    if (err) {
+        return;
+    }
+    sub = find_sub(NULL);
+    if (!sub) {
+        return;
+    }
+
+    sub->conn = bt_conn_ref(conn);
+    /* Completions of the slot's previous link may never arrive */
+    atomic_set(&sub->credits, ADXL345_SUB_TX_CREDITS);
+    sub->format = ADXL345_FRAME_DELTA;
+    sub->enabled = true;
+    sub->resync = true;
+}
+
+static void stream_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    struct stream_sub *sub = find_sub(conn);
+
+    if (sub) {
+        bt_conn_unref(sub->conn);
+        sub->conn = NULL;
+    }
+}
+
+static struct bt_conn_cb stream_conn_callbacks = {
+    .connected = stream_connected,
+    .disconnected = stream_disconnected,
+};
+
 int bluetooth_init(struct bt_conn_cb *bt_cb, struct bt_remote_service_cb *remote_cb)
 {
     int err;
-    printk("Initializing bluetooth\n");
+    LOG_INF("Initializing bluetooth");
 
     if (bt_cb == NULL || remote_cb == NULL) {
         return NRFX_ERROR_NULL;
     }
     bt_conn_cb_register(bt_cb);
-    printk("build time: " __DATE__ " " __TIME__ "\n");
+    LOG_INF("build time: " __DATE__ " " __TIME__);
     os_mgmt_register_group();
     img_mgmt_register_group();
     smp_bt_register();
     remote_service_callbacks.notif_changed = remote_cb->notif_changed;
     remote_service_callbacks.data_received = remote_cb->data_received;
+    remote_service_callbacks.stream_lost = remote_cb->stream_lost;
+    for (size_t i = 0; i < ARRAY_SIZE(stream_groups); i++) {
+        accel_codec_enc_init(&stream_groups[i].encoder, ACCEL_CODEC_KEYFRAME_INTERVAL);
+    }
+    bt_conn_cb_register(&stream_conn_callbacks);
+    l2cap_stream_init(adxl345_stream_kick);
+    link_tuning_init();
 
     err = bt_enable(bt_ready);
     if (err) {
-        printk("bt_enable returned %d\n", err);
+        LOG_ERR("bt_enable returned %d", err);
         return err;
     }
 
@@ -178,7 +977,7 @@ int bluetooth_init(struct bt_conn_cb *bt_cb, struct bt_remote_service_cb *remote
 
     err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
     if (err){
-        printk("couldn't start advertising (err = %d\n", err);
+        LOG_ERR("couldn't start advertising (err = %d)", err);
         return err;
     }
 
@@ -1,6 +1,6 @@
 
 #include <zephyr.h>
-// #include <logging/log.h>
+#include <logging/log.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/uuid.h>
@@ -11,6 +11,12 @@
 #include <os_mgmt/os_mgmt.h>
 #include <img_mgmt/img_mgmt.h>
 
+#include "sample_ring.h"
+#include "accel_codec.h"
+#include "accel_features.h"
+#include "accel_events.h"
+#include "adxl345_frame.h"
+
 /** @brief UUID of the Remote Service. **/
 #define BT_UUID_REMOTE_SERV_VAL \
 	BT_UUID_128_ENCODE(0xe9ea0001, 0xe19b, 0x482d, 0x9293, 0xc7907585fc48)
@@ -27,11 +33,71 @@
 #define BT_UUID_REMOTE_MESSAGE_CHRC_VAL \
 	BT_UUID_128_ENCODE(0xe9ea0004, 0xe19b, 0x482d, 0x9293, 0xc7907585fc48)
 
+/** @brief UUID of the L2CAP PSM Characteristic. **/
+#define BT_UUID_REMOTE_L2CAP_PSM_CHRC_VAL \
+	BT_UUID_128_ENCODE(0xe9ea0005, 0xe19b, 0x482d, 0x9293, 0xc7907585fc48)
+
+/** @brief UUID of the Features Characteristic. **/
+#define BT_UUID_REMOTE_FEATURES_CHRC_VAL \
+	BT_UUID_128_ENCODE(0xe9ea0006, 0xe19b, 0x482d, 0x9293, 0xc7907585fc48)
+
+/** @brief UUID of the Events Characteristic. **/
+#define BT_UUID_REMOTE_EVENTS_CHRC_VAL \
+	BT_UUID_128_ENCODE(0xe9ea0007, 0xe19b, 0x482d, 0x9293, 0xc7907585fc48)
+
 #define BT_UUID_REMOTE_SERVICE          BT_UUID_DECLARE_128(BT_UUID_REMOTE_SERV_VAL)
 #define BT_UUID_REMOTE_BUTTON_CHRC 	    BT_UUID_DECLARE_128(BT_UUID_REMOTE_BUTTON_CHRC_VAL)
 #define BT_UUID_ADXL345_CHRC 	    	BT_UUID_DECLARE_128(BT_UUID_ADXL345_CHRC_VAL)
 #define BT_UUID_REMOTE_MESSAGE_CHRC 	BT_UUID_DECLARE_128(BT_UUID_REMOTE_MESSAGE_CHRC_VAL)
+#define BT_UUID_REMOTE_L2CAP_PSM_CHRC 	BT_UUID_DECLARE_128(BT_UUID_REMOTE_L2CAP_PSM_CHRC_VAL)
+#define BT_UUID_REMOTE_FEATURES_CHRC 	BT_UUID_DECLARE_128(BT_UUID_REMOTE_FEATURES_CHRC_VAL)
+#define BT_UUID_REMOTE_EVENTS_CHRC 	BT_UUID_DECLARE_128(BT_UUID_REMOTE_EVENTS_CHRC_VAL)
+
+
+/** @brief Notification payload at the default ATT MTU of 23, before the
+ * central exchanges a larger one. **/
+#define ADXL345_FRAME_MIN_LEN	20
+/** @brief Payload a delta frame needs for one worst-case sample. Below
+ * it subscribers get raw frames. **/
+#define ADXL345_DELTA_MIN_LEN \
+	(sizeof(struct adxl345_frame_header) + ACCEL_CODEC_BLOCK_HEADER_LEN + ACCEL_CODEC_MAX_SAMPLE_LEN)
+
+/** @brief Largest frame that fits the configured L2CAP TX MTU. **/
+#define ADXL345_FRAME_MAX_LEN \
+	(CONFIG_BT_L2CAP_TX_MTU - 3)
+#define ADXL345_FRAME_MAX_SAMPLES \
+	((ADXL345_FRAME_MAX_LEN - sizeof(struct adxl345_frame_header)) / ADXL345_SAMPLE_SIZE)
+
+/** @brief Frames allowed in flight. One TX buffer is left over for the
+ * button characteristic and mcumgr. **/
+#define ADXL345_TX_CREDITS \
+	MAX(MIN(CONFIG_BT_L2CAP_TX_BUF_COUNT, CONFIG_BT_BUF_ACL_TX_COUNT) - 1, 1)
+/** @brief Frames each connection may have in flight, its share of the
+ * credits. **/
+#define ADXL345_SUB_TX_CREDITS \
+	MAX(ADXL345_TX_CREDITS / CONFIG_BT_MAX_CONN, 1)
+
+struct adxl345_tx_stats {
+	uint32_t frames_encoded;	// frames built, each sent to all subscribers of its format
+	uint32_t frames_sent;		// notifications and SDUs accepted by the stack
+	uint32_t frames_completed;	// notifications handed to the controller
+	uint32_t samples_sent;
+	uint32_t bytes_sent;		// frame bytes over GATT and L2CAP
+	uint32_t l2cap_frames;		// frames sent as L2CAP SDUs
+	uint32_t retries;		// TX passes deferred for lack of credits or buffers
+	uint32_t dropped;		// samples discarded after a send error
+	uint32_t skipped;		// frames a subscriber missed for lack of credits or buffers
+	uint32_t backlog_frames;	// logged blocks sent by a backlog download
+};
+
+/** @brief Takes samples the stream couldn't send because nobody was
+ * listening. Returns how many it kept. **/
+typedef size_t (*adxl345_offline_sink_t)(const struct sample_record *records, size_t count,
+					 uint8_t odr);
 
+/** @brief Copies the next backlog frame into buf. Returns its length, 0
+ * when the backlog is drained, or a negative error code. **/
+typedef int (*adxl345_backlog_read_t)(uint8_t *buf, size_t size);
 
 enum bt_button_notifications_enabled {
 	BT_BUTTON_NOTIFICATIONS_ENABLED,
@@ -39,11 +105,32 @@ enum bt_button_notifications_enabled {
 };
 
 struct bt_remote_service_cb {
-	void (*notif_changed)(enum bt_button_notifications_enabled status);
+	void (*notif_changed)(struct bt_conn *conn, enum bt_button_notifications_enabled status);
     void (*data_received)(struct bt_conn *conn, const uint8_t *const data, uint16_t len);
+    /* The stream had subscribers and lost the last one without a stop */
+    void (*stream_lost)(void);
 };
 
 int send_button_notification(struct bt_conn *conn, uint8_t *value, uint16_t length);
 int send_adxl345_notification(struct bt_conn *conn, uint8_t *value, uint16_t length);
+uint16_t adxl345_frame_capacity(struct bt_conn *conn);
+void set_adxl345_stream_source(struct sample_ring *ring, uint8_t odr);
+/* Rate of the samples put into the ring from now on, best called from its
+ * producer. Changes are queued and take effect in order as the stream
+ * reaches them. */
+void set_adxl345_stream_odr(uint8_t odr);
+/* Stream state of one connection. Samples nobody takes go to the offline
+ * sink as if nobody was listening. */
+int set_adxl345_stream_mode(struct bt_conn *conn, bool enabled, enum adxl345_frame_format format);
+/* Connections the stream is going to */
+size_t adxl345_stream_subscribers(void);
+void adxl345_stream_kick(void);
+void set_adxl345_offline_sink(adxl345_offline_sink_t sink);
+int adxl345_backlog_download(adxl345_backlog_read_t read);
+bool features_notifications_enabled(void);
+int send_features_notification(const struct accel_features_frame *frame);
+int send_event_notification(const struct accel_event *event);
+int send_message_notification(struct bt_conn *conn, const void *data, uint16_t len);
+void get_adxl345_tx_stats(struct adxl345_tx_stats *stats);
 void set_button_value(uint8_t btn_value);
 int bluetooth_init(struct bt_conn_cb *bt_cb, struct bt_remote_service_cb *remote_cb);
\ No newline at end of file
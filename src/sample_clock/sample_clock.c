@@ -0,0 +1,178 @@
+#include "sample_clock.h"
+#include "adxl345.h"
+
+#include <stdlib.h>
+
+/* Times are cycles in Q32. Their integer part wraps with
+ * k_cycle_get_32(), so differences stay valid across the wrap. */
+static uint8_t clock_odr = BW_RATE_DEFAULT;
+static uint64_t nominal;        // cycles per sample at clock_odr, Q32
+static uint64_t period;         // drift corrected
+static bool locked;             // the line has a base
+static uint64_t base_time;      // time of sample base_idx on the line
+static uint32_t base_idx;
+static uint32_t next_idx;       // next sample to be stamped
+static uint32_t ref_cycles;     // anchor the next period measurement spans from
+static uint32_t ref_idx;
+static uint8_t rejects;         // consecutive anchors off the line
+static struct sample_clock_stats stats;
+
+static uint64_t nominal_period(uint8_t odr)
+{
+    return ((uint64_t)sys_clock_hw_cycles_per_sec() * 1000U << 32) / adxl345_odr_mhz(odr);
+}
+
+static uint64_t line_at(uint32_t idx)
+{
+    return base_time + (int64_t)(int32_t)(idx - base_idx) * (int64_t)period;
+}
+
+static void restart(uint32_t cycles, uint32_t idx)
+{
+    base_time = (uint64_t)cycles << 32;
+    base_idx = idx;
+    ref_cycles = cycles;
+    ref_idx = idx;
+    rejects = 0;
+    locked = true;
+    stats.resyncs++;
+}
+
+static void measure_period(uint32_t cycles, uint32_t idx)
+{
+    uint32_t span = idx - ref_idx;
+    uint64_t measured;
+    int64_t error;
+    unsigned int key;
+
+    if (span < SAMPLE_CLOCK_MIN_SPAN) {
+        return;
+    }
+
+    measured = ((uint64_t)(cycles - ref_cycles) << 32) / span;
+    ref_cycles = cycles;
+    ref_idx = idx;
+
+    error = (int64_t)(measured - nominal);
+    if (llabs(error) > (int64_t)(nominal / 1000000U) * SAMPLE_CLOCK_MAX_DRIFT_PPM) {
+        return;
+    }
+
+    key = irq_lock();
+    if (stats.measurements == 0) {
+        /* Far better than the nominal rate, which may be off by percents */
+        period = measured;
+    } else {
+        period += (int64_t)(measured - period) / (1 << SAMPLE_CLOCK_PERIOD_SHIFT);
+    }
+    stats.drift_ppm = (int64_t)(period - nominal) / (int64_t)(nominal / 1000000U);
+    stats.measurements++;
+    irq_unlock(key);
+}
+
+void sample_clock_reset(uint8_t odr)
+{
+    unsigned int key = irq_lock();
+
+    /* Same oscillator, and each ODR code halves the rate of the next one
+     * up, so the measured period carries over */
+    if (nominal == 0) {
+        period = nominal_period(odr);
+    } else if (odr < clock_odr) {
+        period <<= clock_odr - odr;
+    } else {
+        period >>= odr - clock_odr;
+    }
+    nominal = nominal_period(odr);
+    clock_odr = odr;
+    locked = false;
+    irq_unlock(key);
+}
+
+void sample_clock_anchor(uint32_t cycles, uint32_t ahead)
+{
+    uint32_t idx = next_idx + ahead;
+    uint32_t limit = (period >> 32) * SAMPLE_CLOCK_MAX_RESIDUAL;
+    uint64_t on_line;
+    int32_t residual;
+
+    if (nominal == 0) {
+        sample_clock_reset(clock_odr);
+    }
+    if (!locked) {
+        restart(cycles, idx);
+        return;
+    }
+
+    on_line = line_at(idx);
+    residual = (int32_t)(cycles - (uint32_t)(on_line >> 32));
+    stats.last_residual = residual;
+
+    if ((uint32_t)abs(residual) > limit) {
+        /* Lost samples or a stale edge; a few in a row move the line */
+        stats.rejected++;
+        if (++rejects >= SAMPLE_CLOCK_MAX_REJECTS) {
+            restart(cycles, idx);
+        }
+        return;
+    }
+
+    rejects = 0;
+    stats.anchors++;
+    stats.max_residual = MAX(stats.max_residual, (uint32_t)abs(residual));
+
+    /* Multiplied, left shifts of negative values are undefined */
+    base_time = on_line + (int64_t)residual * (INT64_C(1) << (32 - SAMPLE_CLOCK_PHASE_SHIFT));
+    base_idx = idx;
+    measure_period(cycles, idx);
+}
+
+void sample_clock_stamp(size_t count, struct sample_time *time)
+{
+    if (count == 0) {
+        return;
+    }
+    if (!locked) {
+        sample_clock_anchor(k_cycle_get_32(), count - 1);
+    }
+
+    time->first = line_at(next_idx) >> 32;
+    time->period = period;
+    next_idx += count;
+}
+
+uint64_t sample_clock_to_us(uint32_t cycles)
+{
+    /* The 64-bit uptime counts cycles as well while the rates match */
+    uint64_t now = k_ticks_to_cyc_floor64(k_uptime_ticks());
+
+    return k_cyc_to_us_floor64(now + (int32_t)(cycles - (uint32_t)now));
+}
+
+uint32_t sample_clock_period_us_q8(uint8_t odr)
+{
+    uint64_t cycles, us_q8;
+    uint8_t at_odr;
+    unsigned int key;
+
+    key = irq_lock();
+    cycles = period ? period : nominal_period(odr);
+    at_odr = period ? clock_odr : odr;
+    irq_unlock(key);
+
+    us_q8 = ((cycles >> 16) * (USEC_PER_SEC << 8) / sys_clock_hw_cycles_per_sec()) >> 16;
+    if (odr < at_odr) {
+        us_q8 <<= at_odr - odr;
+    } else {
+        us_q8 >>= odr - at_odr;
+    }
+    return MIN(us_q8, UINT32_MAX);
+}
+
+void sample_clock_get_stats(struct sample_clock_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
@@ -0,0 +1,79 @@
+#ifndef __sample_clock_h__
+#define __sample_clock_h__
+
+#include <zephyr.h>
+
+/* Capture times of accelerometer samples.
+ *
+ * The ADXL345 samples on its own oscillator, so the time of a sample is
+ * only observed when the FIFO crosses the watermark: the interrupt edge
+ * marks the completion of one known sample. Acquisition reports those
+ * edges as anchors and the clock places every sample on a line through
+ * them, sample index times the estimated period. On nRF the cycle counter
+ * is the 32 kHz RTC, so the estimate is the accelerometer rate measured
+ * against the RTC crystal.
+ *
+ * Each anchor pulls the phase of the line part of the way towards it, and
+ * anchors at least SAMPLE_CLOCK_MIN_SPAN samples apart measure the period,
+ * which is averaged into the estimate. An anchor far off the line means
+ * samples were lost; after SAMPLE_CLOCK_MAX_REJECTS of them in a row the
+ * line restarts from the latest one.
+ *
+ * Acquisition calls everything but the getters from its thread. */
+
+/** @brief Samples between two period measurements. **/
+#define SAMPLE_CLOCK_MIN_SPAN       256
+/** @brief Weight of a new period measurement, 1/2^n. **/
+#define SAMPLE_CLOCK_PERIOD_SHIFT   3
+/** @brief Share of the phase error corrected per anchor, 1/2^n. **/
+#define SAMPLE_CLOCK_PHASE_SHIFT    2
+/** @brief Period measurements further off the nominal rate are ignored. **/
+#define SAMPLE_CLOCK_MAX_DRIFT_PPM  50000
+/** @brief Anchors further off the line than this many periods are rejected. **/
+#define SAMPLE_CLOCK_MAX_RESIDUAL   2
+#define SAMPLE_CLOCK_MAX_REJECTS    3
+
+/** @brief Times of a batch of consecutive samples. **/
+struct sample_time {
+    uint32_t first;         // k_cycle_get_32() time of the first sample
+    uint64_t period;        // sample spacing in cycles, Q32
+};
+
+struct sample_clock_stats {
+    uint32_t anchors;       // anchors on the line
+    uint32_t rejected;      // anchors off the line
+    uint32_t resyncs;       // restarts after rejected anchors or a reset
+    uint32_t measurements;  // period measurements averaged in
+    int32_t drift_ppm;      // accelerometer rate error against the cycle counter
+    int32_t last_residual;  // cycles between the last anchor and the line
+    uint32_t max_residual;
+};
+
+static inline uint32_t sample_time_at(const struct sample_time *time, size_t i)
+{
+    return time->first + (uint32_t)((time->period * i) >> 32);
+}
+
+/* Starts over at a new ODR, e.g. after the FIFO was reconfigured or
+ * overran. The drift estimate is kept, it belongs to the oscillator. */
+void sample_clock_reset(uint8_t odr);
+
+/* The sample ahead samples past the next one to be stamped completed at
+ * cycles */
+void sample_clock_anchor(uint32_t cycles, uint32_t ahead);
+
+/* Times of the next count samples. Without an anchor the last of them is
+ * taken to have completed now. */
+void sample_clock_stamp(size_t count, struct sample_time *time);
+
+/* Device time in microseconds of a k_cycle_get_32() stamp less than half
+ * a cycle counter wrap from now. Frame timestamps are its low 32 bits, so
+ * they stay on time_sync_device_us() after the counter wraps. */
+uint64_t sample_clock_to_us(uint32_t cycles);
+
+/* Drift corrected sample spacing at an ODR code in 1/256 us */
+uint32_t sample_clock_period_us_q8(uint8_t odr);
+
+void sample_clock_get_stats(struct sample_clock_stats *stats);
+
+#endif
@@ -0,0 +1,120 @@
+#include "sample_ring.h"
+
+static inline uint32_t ring_capacity(const struct sample_ring *ring)
+{
+    return ring->mask + 1;
+}
+
+size_t sample_ring_put(struct sample_ring *ring, const struct adxl345_data *samples,
+                       size_t count, uint32_t timestamp)
+{
+    uint32_t head = (uint32_t)atomic_get(&ring->head);
+    uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+    uint32_t space = ring_capacity(ring) - (head - tail);
+    size_t n = MIN(count, space);
+
+    for (size_t i = 0; i < n; i++) {
+        struct sample_record *rec = &ring->buf[(head + i) & ring->mask];
+
+        rec->timestamp = timestamp;
+        rec->data = samples[i];
+    }
+
+    if (n < count) {
+        atomic_add(&ring->overruns, count - n);
+    }
+
+    /* Publish the records only after they are written */
+    atomic_set(&ring->head, (atomic_val_t)(head + n));
+
+    return n;
+}
+
+size_t sample_ring_put_claim(struct sample_ring *ring, struct sample_record **records)
+{
+    uint32_t head = (uint32_t)atomic_get(&ring->head);
+    uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+    uint32_t idx = head & ring->mask;
+    uint32_t n = MIN(ring_capacity(ring) - (head - tail), ring_capacity(ring) - idx);
+
+    *records = &ring->buf[idx];
+    return n;
+}
+
+void sample_ring_put_finish(struct sample_ring *ring, size_t count)
+{
+    uint32_t head = (uint32_t)atomic_get(&ring->head);
+
+    __ASSERT_NO_MSG(count <= ring_capacity(ring) - sample_ring_count(ring));
+
+    /* Publish the records only after they are written */
+    atomic_set(&ring->head, (atomic_val_t)(head + count));
+}
+
+void sample_ring_put_overrun(struct sample_ring *ring, size_t count)
+{
+    atomic_add(&ring->overruns, count);
+}
+
+size_t sample_ring_get_claim(struct sample_ring *ring, struct sample_record **records)
+{
+    uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+    uint32_t head = (uint32_t)atomic_get(&ring->head);
+    uint32_t idx = tail & ring->mask;
+    uint32_t n = MIN(head - tail, ring_capacity(ring) - idx);
+
+    *records = &ring->buf[idx];
+    return n;
+}
+
+void sample_ring_get_finish(struct sample_ring *ring, size_t count)
+{
+    uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+
+    __ASSERT_NO_MSG(count <= sample_ring_count(ring));
+
+    /* Hand the slots back to the producer only after they are read */
+    atomic_set(&ring->tail, (atomic_val_t)(tail + count));
+}
+
+size_t sample_ring_get(struct sample_ring *ring, struct sample_record *out, size_t max)
+{
+    struct sample_record *records;
+    size_t total = 0;
+
+    /* At most two claims: up to the wrap point, then from the start */
+    while (total < max) {
+        size_t n = MIN(sample_ring_get_claim(ring, &records), max - total);
+
+        if (n == 0) {
+            break;
+        }
+        memcpy(&out[total], records, n * sizeof(*records));
+        sample_ring_get_finish(ring, n);
+        total += n;
+    }
+
+    return total;
+}
+
+size_t sample_ring_count(struct sample_ring *ring)
+{
+    return (uint32_t)atomic_get(&ring->head) - (uint32_t)atomic_get(&ring->tail);
+}
+
+uint32_t sample_ring_write_pos(struct sample_ring *ring)
+{
+    return (uint32_t)atomic_get(&ring->head);
+}
+
+uint32_t sample_ring_read_pos(struct sample_ring *ring)
+{
+    return (uint32_t)atomic_get(&ring->tail);
+}
+
+void sample_ring_get_stats(struct sample_ring *ring, struct sample_ring_stats *stats)
+{
+    stats->written = (uint32_t)atomic_get(&ring->head);
+    stats->read = (uint32_t)atomic_get(&ring->tail);
+    stats->overruns = (uint32_t)atomic_get(&ring->overruns);
+}
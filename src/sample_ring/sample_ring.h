@@ -0,0 +1,73 @@
+#ifndef __sample_ring_h__
+#define __sample_ring_h__
+
+#include <zephyr.h>
+#include <sys/atomic.h>
+#include "adxl345.h"
+
+/* Single-producer/single-consumer ring of timestamped samples.
+ *
+ * The acquisition thread is the only writer of head and the transmit
+ * side the only writer of tail, so neither side takes a lock and the
+ * producer never waits: when the ring is full new samples are dropped
+ * and counted as overruns. Capacity must be a power of two. */
+
+/** @brief Samples held by the application ring. **/
+#define SAMPLE_RING_CAPACITY 256
+
+struct sample_record {
+    uint32_t timestamp;     // k_cycle_get_32() at capture
+    struct adxl345_data data;
+};
+
+struct sample_ring_stats {
+    uint32_t written;       // samples accepted
+    uint32_t read;          // samples consumed
+    uint32_t overruns;      // samples dropped because the ring was full
+};
+
+struct sample_ring {
+    atomic_t head;          // free running, written by the producer only
+    atomic_t tail;          // free running, written by the consumer only
+    atomic_t overruns;
+    uint32_t mask;
+    struct sample_record *buf;
+};
+
+#define SAMPLE_RING_DEFINE(name, capacity)                                  \
+    BUILD_ASSERT(IS_POWER_OF_TWO(capacity),                                 \
+                 "sample ring capacity must be a power of two");            \
+    static struct sample_record _sample_ring_buf_##name[capacity];          \
+    struct sample_ring name = {                                             \
+        .mask = (capacity) - 1,                                             \
+        .buf = _sample_ring_buf_##name,                                     \
+    }
+
+/* Producer side */
+size_t sample_ring_put(struct sample_ring *ring, const struct adxl345_data *samples,
+                       size_t count, uint32_t timestamp);
+
+/* In-place producer side. sample_ring_put_claim() hands out the free
+ * contiguous run at the head (it stops at the wrap point); fill the records
+ * and publish the first count of them with sample_ring_put_finish().
+ * Samples the caller had to throw away go to sample_ring_put_overrun(). */
+size_t sample_ring_put_claim(struct sample_ring *ring, struct sample_record **records);
+void sample_ring_put_finish(struct sample_ring *ring, size_t count);
+void sample_ring_put_overrun(struct sample_ring *ring, size_t count);
+
+/* Consumer side. sample_ring_get_claim() hands out the oldest contiguous
+ * run of records in place (it stops at the wrap point); release them with
+ * sample_ring_get_finish() once they are no longer needed. */
+size_t sample_ring_get_claim(struct sample_ring *ring, struct sample_record **records);
+void sample_ring_get_finish(struct sample_ring *ring, size_t count);
+size_t sample_ring_get(struct sample_ring *ring, struct sample_record *out, size_t max);
+
+size_t sample_ring_count(struct sample_ring *ring);
+
+/* Free running counts of the samples published and consumed. Both sides
+ * can use them to mark a point in the stream. */
+uint32_t sample_ring_write_pos(struct sample_ring *ring);
+uint32_t sample_ring_read_pos(struct sample_ring *ring);
+void sample_ring_get_stats(struct sample_ring *ring, struct sample_ring_stats *stats);
+
+#endif
@@ -0,0 +1,154 @@
+#include "time_sync.h"
+
+#include <stdlib.h>
+
+struct sync_point {
+    uint64_t device_us;     // midway between t2 and t3
+    int64_t offset_us;
+    uint32_t delay_us;
+};
+
+/* Exchanges come in on the Bluetooth thread, which is the only writer.
+ * The model is copied out under irq_lock. */
+static struct sync_point filter[TIME_SYNC_FILTER_LEN];
+static uint8_t filter_len;
+static uint8_t filter_next;
+static struct sync_point skew_ref;  // offset the next skew measurement spans from
+static bool skew_ref_valid;
+static struct time_sync_model model;
+static struct time_sync_stats stats;
+
+static const struct sync_point *best_point(void)
+{
+    const struct sync_point *best = &filter[0];
+
+    for (uint8_t i = 1; i < filter_len; i++) {
+        if (filter[i].delay_us < best->delay_us) {
+            best = &filter[i];
+        }
+    }
+    return best;
+}
+
+static int32_t measure_skew(const struct sync_point *point)
+{
+    int64_t span, measured;
+
+    if (!skew_ref_valid) {
+        skew_ref = *point;
+        skew_ref_valid = true;
+        return model.skew_ppb;
+    }
+
+    span = (int64_t)(point->device_us - skew_ref.device_us);
+    if (span < TIME_SYNC_MIN_SPAN_US) {
+        return model.skew_ppb;
+    }
+
+    measured = (point->offset_us - skew_ref.offset_us) * NSEC_PER_SEC / span;
+    skew_ref = *point;
+    if (llabs(measured) > TIME_SYNC_MAX_SKEW_PPB) {
+        return model.skew_ppb;
+    }
+
+    /* The first measurement replaces the initial guess of no skew */
+    if (stats.skew_updates++ == 0) {
+        return measured;
+    }
+    return model.skew_ppb + (measured - model.skew_ppb) / (1 << TIME_SYNC_SKEW_SHIFT);
+}
+
+uint64_t time_sync_device_us(void)
+{
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+int time_sync_add(const struct time_sync_exchange *x)
+{
+    const struct sync_point *best;
+    struct sync_point point;
+    int64_t delay;
+    int32_t skew;
+    unsigned int key;
+
+    delay = (int64_t)(x->t4 - x->t1) - (int64_t)(x->t3 - x->t2);
+    if (delay < 0 || delay > TIME_SYNC_MAX_DELAY_US) {
+        stats.rejected++;
+        return -EINVAL;
+    }
+
+    point.device_us = x->t2 + (x->t3 - x->t2) / 2;
+    point.offset_us = ((int64_t)(x->t1 - x->t2) + (int64_t)(x->t4 - x->t3)) / 2;
+    point.delay_us = delay;
+
+    filter[filter_next] = point;
+    filter_next = (filter_next + 1) % TIME_SYNC_FILTER_LEN;
+    filter_len = MIN(filter_len + 1, TIME_SYNC_FILTER_LEN);
+
+    stats.exchanges++;
+    stats.last_delay_us = point.delay_us;
+    stats.min_delay_us = stats.exchanges == 1 ? point.delay_us :
+                         MIN(stats.min_delay_us, point.delay_us);
+
+    best = best_point();
+    if (model.synced && best->device_us == model.ref_us) {
+        /* Still the same best exchange */
+        return 0;
+    }
+
+    skew = measure_skew(best);
+
+    key = irq_lock();
+    model.synced = true;
+    model.offset_us = best->offset_us;
+    model.ref_us = best->device_us;
+    model.skew_ppb = skew;
+    model.delay_us = best->delay_us;
+    irq_unlock(key);
+
+    stats.updates++;
+    return 0;
+}
+
+int time_sync_to_host(uint64_t device_us, uint64_t *host_us)
+{
+    struct time_sync_model m;
+
+    time_sync_get_model(&m);
+    if (!m.synced) {
+        return -EAGAIN;
+    }
+
+    *host_us = device_us + m.offset_us +
+               (int64_t)(device_us - m.ref_us) * m.skew_ppb / (int64_t)NSEC_PER_SEC;
+    return 0;
+}
+
+void time_sync_get_model(struct time_sync_model *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = model;
+    irq_unlock(key);
+}
+
+void time_sync_reset(void)
+{
+    unsigned int key = irq_lock();
+
+    memset(&model, 0, sizeof(model));
+    irq_unlock(key);
+
+    filter_len = 0;
+    filter_next = 0;
+    skew_ref_valid = false;
+    stats.skew_updates = 0;
+}
+
+void time_sync_get_stats(struct time_sync_stats *out)
+{
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
@@ -0,0 +1,83 @@
+#ifndef __time_sync_h__
+#define __time_sync_h__
+
+#include <zephyr.h>
+
+/* Mapping of the device clock to the host's epoch.
+ *
+ * The host drives NTP-style exchanges: it stamps a request when sending
+ * it (t1), the device when receiving it (t2) and when sending the reply
+ * (t3), and the host when the reply comes in (t4). Each completed exchange
+ * gives the offset of the host clock,
+ *
+ *     offset = ((t1 - t2) + (t4 - t3)) / 2
+ *
+ * which is exact when both directions take equally long, and the round
+ * trip delay (t4 - t1) - (t3 - t2), which bounds its error.
+ *
+ * Connection events make BLE delays vary by up to a connection interval,
+ * so like NTP's clock filter the model only uses the exchange with the
+ * smallest delay among the last TIME_SYNC_FILTER_LEN. Its offset becomes
+ * the model's offset, and offsets at least TIME_SYNC_MIN_SPAN_US apart
+ * measure the skew between the clocks, which is averaged.
+ *
+ *     host_us = device_us + offset_us + (device_us - ref_us) * skew_ppb / 10^9
+ *
+ * Device time is the microsecond uptime. Stream, log, features and event
+ * timestamps are its low 32 bits while the tick and cycle rates match, as
+ * on nRF: sample_clock_to_us() extends their cycle stamps to 64 bits before
+ * converting, so they don't jump when the cycle counter wraps. */
+
+#define TIME_SYNC_FILTER_LEN        8
+/** @brief Exchanges that took longer are too imprecise to use. **/
+#define TIME_SYNC_MAX_DELAY_US      200000
+/** @brief Device time between two skew measurements. **/
+#define TIME_SYNC_MIN_SPAN_US       (10 * USEC_PER_SEC)
+/** @brief Weight of a new skew measurement, 1/2^n. **/
+#define TIME_SYNC_SKEW_SHIFT        2
+/** @brief Skew measurements beyond this are taken for clock steps. **/
+#define TIME_SYNC_MAX_SKEW_PPB      1000000
+
+/** @brief One request/reply exchange, all times in microseconds. **/
+struct time_sync_exchange {
+    uint64_t t1;        // host sent the request
+    uint64_t t2;        // device received it
+    uint64_t t3;        // device sent the reply
+    uint64_t t4;        // host received the reply
+};
+
+struct time_sync_model {
+    bool synced;
+    int64_t offset_us;  // host minus device time at ref_us
+    uint64_t ref_us;    // device time the offset was measured at
+    int32_t skew_ppb;   // host clock rate relative to the device clock
+    uint32_t delay_us;  // round trip of the exchange the offset comes from
+};
+
+struct time_sync_stats {
+    uint32_t exchanges;     // exchanges taken into the filter
+    uint32_t rejected;      // exchanges with a negative or excessive delay
+    uint32_t updates;       // model updates from a new best exchange
+    uint32_t skew_updates;  // skew measurements averaged in
+    uint32_t last_delay_us;
+    uint32_t min_delay_us;
+};
+
+/* Device time in microseconds */
+uint64_t time_sync_device_us(void);
+
+/* Adds a completed exchange. Returns -EINVAL if its delay is negative or
+ * over TIME_SYNC_MAX_DELAY_US. */
+int time_sync_add(const struct time_sync_exchange *exchange);
+
+/* Host time of a device time. Returns -EAGAIN until the first exchange. */
+int time_sync_to_host(uint64_t device_us, uint64_t *host_us);
+
+void time_sync_get_model(struct time_sync_model *model);
+
+/* Forgets the model, e.g. when another host starts syncing */
+void time_sync_reset(void);
+
+void time_sync_get_stats(struct time_sync_stats *stats);
+
+#endif
@@ -0,0 +1,222 @@
+#include <ztest.h>
+#include <errno.h>
+#include "accel_codec.h"
+
+#define BLOCK_MAX_SAMPLES   32
+#define BLOCK_MAX_LEN       (ACCEL_CODEC_BLOCK_HEADER_LEN + BLOCK_MAX_SAMPLES * ACCEL_CODEC_MAX_SAMPLE_LEN)
+#define ROUNDTRIP_SAMPLES   20000
+#define TEST_KEY_INTERVAL   50
+
+static uint32_t next_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/* Encodes count samples as one block and returns its length */
+static size_t encode_block(struct accel_codec_enc *enc, int16_t (*xyz)[3], size_t count,
+                           uint8_t *out)
+{
+    size_t len = accel_codec_begin_block(enc, out);
+
+    for (size_t i = 0; i < count; i++) {
+        size_t n = accel_codec_encode(enc, xyz[i], out + len);
+
+        zassert_true(n <= ACCEL_CODEC_MAX_SAMPLE_LEN, "sample %u took %u bytes", i, n);
+        len += n;
+    }
+    return len;
+}
+
+static void check_block(struct accel_codec_dec *dec, const uint8_t *block, size_t len,
+                        int16_t (*want)[3], size_t count)
+{
+    int16_t out[BLOCK_MAX_SAMPLES][3];
+    int ret;
+
+    ret = accel_codec_decode_block(dec, block, len, true, out, ARRAY_SIZE(out));
+    zassert_equal(ret, count, "decoded %d of %u samples", ret, count);
+    zassert_mem_equal(out, want, count * sizeof(want[0]), NULL);
+}
+
+/* A random walk with occasional jumps, the way a real stream looks, cut
+ * into blocks of random size */
+static void test_roundtrip(void)
+{
+    struct accel_codec_enc enc;
+    struct accel_codec_dec dec;
+    int16_t xyz[BLOCK_MAX_SAMPLES][3];
+    int16_t pos[3] = {0, 0, 256};
+    uint8_t block[BLOCK_MAX_LEN];
+    uint32_t state = 0xdeadbeef;
+    size_t raw = 0, encoded = 0;
+
+    accel_codec_enc_init(&enc, TEST_KEY_INTERVAL);
+    accel_codec_dec_init(&dec);
+
+    for (size_t done = 0; done < ROUNDTRIP_SAMPLES; ) {
+        size_t count = 1 + next_rand(&state) % BLOCK_MAX_SAMPLES;
+        size_t len;
+
+        for (size_t i = 0; i < count; i++) {
+            for (int a = 0; a < 3; a++) {
+                uint32_t r = next_rand(&state);
+
+                pos[a] += (r % 64 == 0) ? (int16_t)r : (int16_t)(r % 17) - 8;
+                xyz[i][a] = pos[a];
+            }
+        }
+
+        len = encode_block(&enc, xyz, count, block);
+        check_block(&dec, block, len, xyz, count);
+
+        raw += count * 3 * sizeof(int16_t);
+        encoded += len;
+        done += count;
+    }
+
+    /* Small steps must compress */
+    zassert_true(encoded < raw * 3 / 4, "%u bytes for %u raw", encoded, raw);
+}
+
+/* Absolute values and deltas at the ends of the int16 range, where the
+ * deltas wrap */
+static void test_extremes(void)
+{
+    static int16_t xyz[][3] = {
+        {INT16_MIN, INT16_MAX, 0},
+        {INT16_MAX, INT16_MIN, -1},
+        {INT16_MIN, INT16_MIN, INT16_MAX},
+        {0, -1, INT16_MIN},
+        {INT16_MAX, INT16_MAX, INT16_MAX},
+        {-1, 1, 0},
+    };
+    struct accel_codec_enc enc;
+    struct accel_codec_dec dec;
+    uint8_t block[BLOCK_MAX_LEN];
+    size_t len;
+
+    accel_codec_enc_init(&enc, ACCEL_CODEC_KEYFRAME_INTERVAL);
+    accel_codec_dec_init(&dec);
+
+    /* Once as a keyframe, once as deltas only */
+    for (int pass = 0; pass < 2; pass++) {
+        len = encode_block(&enc, xyz, ARRAY_SIZE(xyz), block);
+        zassert_equal(block[0] & ACCEL_CODEC_FLAG_KEYFRAME, pass == 0, NULL);
+        check_block(&dec, block, len, xyz, ARRAY_SIZE(xyz));
+    }
+}
+
+static void test_keyframe_placement(void)
+{
+    static int16_t xyz[4][3] = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}, {10, 11, 12}};
+    struct accel_codec_enc enc;
+    uint8_t block[BLOCK_MAX_LEN];
+
+    accel_codec_enc_init(&enc, 6);
+
+    /* The first block, then the first one after the interval went by */
+    encode_block(&enc, xyz, 4, block);
+    zassert_true(block[0] & ACCEL_CODEC_FLAG_KEYFRAME, NULL);
+    encode_block(&enc, xyz, 4, block);
+    zassert_false(block[0] & ACCEL_CODEC_FLAG_KEYFRAME, NULL);
+    encode_block(&enc, xyz, 4, block);
+    zassert_true(block[0] & ACCEL_CODEC_FLAG_KEYFRAME, NULL);
+
+    /* and whenever one is asked for */
+    accel_codec_force_keyframe(&enc);
+    encode_block(&enc, xyz, 1, block);
+    zassert_true(block[0] & ACCEL_CODEC_FLAG_KEYFRAME, NULL);
+    encode_block(&enc, xyz, 1, block);
+    zassert_false(block[0] & ACCEL_CODEC_FLAG_KEYFRAME, NULL);
+}
+
+/* A decoder that missed a block waits for the next keyframe and then
+ * decodes exactly what was sent */
+static void test_resync_after_loss(void)
+{
+    static int16_t a[2][3] = {{100, 200, 300}, {101, 199, 302}};
+    static int16_t b[2][3] = {{90, 210, 280}, {95, 205, 290}};
+    static int16_t c[2][3] = {{-5, 0, 5}, {-6, 1, 4}};
+    struct accel_codec_enc enc;
+    struct accel_codec_dec dec;
+    int16_t out[BLOCK_MAX_SAMPLES][3];
+    uint8_t block[BLOCK_MAX_LEN];
+    size_t len;
+
+    accel_codec_enc_init(&enc, ACCEL_CODEC_KEYFRAME_INTERVAL);
+    accel_codec_dec_init(&dec);
+
+    len = encode_block(&enc, a, 2, block);
+    check_block(&dec, block, len, a, 2);
+
+    /* Block b is lost; the block after it is deltas against b */
+    encode_block(&enc, b, 2, block);
+    len = encode_block(&enc, c, 2, block);
+    zassert_equal(accel_codec_decode_block(&dec, block, len, false, out, ARRAY_SIZE(out)),
+                  -EAGAIN, NULL);
+
+    accel_codec_force_keyframe(&enc);
+    len = encode_block(&enc, c, 2, block);
+    zassert_equal(accel_codec_decode_block(&dec, block, len, false, out, ARRAY_SIZE(out)),
+                  2, NULL);
+    zassert_mem_equal(out, c, sizeof(c), NULL);
+}
+
+static void test_malformed(void)
+{
+    static int16_t xyz[1][3] = {{1, 2, 3}};
+    static int16_t xyz2[2][3] = {{4, 5, 6}, {7, 8, 9}};
+    /* Continuation bit on the last byte */
+    static const uint8_t truncated[] = {ACCEL_CODEC_FLAG_KEYFRAME, 0x02, 0x04, 0x86};
+    /* Three-byte varint above UINT16_MAX */
+    static const uint8_t overlong[] = {ACCEL_CODEC_FLAG_KEYFRAME, 0xff, 0xff, 0x7f, 0x00, 0x00};
+    struct accel_codec_enc enc;
+    struct accel_codec_dec dec;
+    int16_t out[BLOCK_MAX_SAMPLES][3];
+    uint8_t block[BLOCK_MAX_LEN];
+    size_t len;
+
+    accel_codec_enc_init(&enc, ACCEL_CODEC_KEYFRAME_INTERVAL);
+    accel_codec_dec_init(&dec);
+
+    len = encode_block(&enc, xyz, 1, block);
+    check_block(&dec, block, len, xyz, 1);
+
+    /* More samples than the caller has room for loses sync, since the
+     * deltas after the block would build on a sample part way in */
+    len = encode_block(&enc, xyz2, 2, block);
+    zassert_equal(accel_codec_decode_block(&dec, block, len, true, out, 1), -EBADMSG, NULL);
+    len = encode_block(&enc, xyz, 1, block);
+    zassert_false(block[0] & ACCEL_CODEC_FLAG_KEYFRAME, NULL);
+    zassert_equal(accel_codec_decode_block(&dec, block, len, true, out, ARRAY_SIZE(out)),
+                  -EAGAIN, NULL);
+
+    zassert_equal(accel_codec_decode_block(&dec, block, 0, true, out, ARRAY_SIZE(out)),
+                  -EBADMSG, NULL);
+    zassert_equal(accel_codec_decode_block(&dec, overlong, sizeof(overlong), true, out,
+                                           ARRAY_SIZE(out)), -EBADMSG, NULL);
+
+    /* A varint that runs out loses sync as well, until a keyframe */
+    accel_codec_force_keyframe(&enc);
+    len = encode_block(&enc, xyz, 1, block);
+    check_block(&dec, block, len, xyz, 1);
+    zassert_equal(accel_codec_decode_block(&dec, truncated, sizeof(truncated), true, out,
+                                           ARRAY_SIZE(out)), -EBADMSG, NULL);
+    len = encode_block(&enc, xyz, 1, block);
+    zassert_equal(accel_codec_decode_block(&dec, block, len, true, out, ARRAY_SIZE(out)),
+                  -EAGAIN, NULL);
+}
+
+void test_main(void)
+{
+    ztest_test_suite(accel_codec,
+                     ztest_unit_test(test_roundtrip),
+                     ztest_unit_test(test_extremes),
+                     ztest_unit_test(test_keyframe_placement),
+                     ztest_unit_test(test_resync_after_loss),
+                     ztest_unit_test(test_malformed));
+    ztest_run_test_suite(accel_codec);
+}
@@ -0,0 +1,117 @@
+#include <ztest.h>
+#include <math.h>
+#include "accel_conv.h"
+
+/* Reference readings further than this from a rounding tie must come out
+ * exact; the Q32 factor is good to about one part in a million */
+#define TIE_MARGIN_MG       0.01
+#define TEST_VALUES         20000
+
+static uint32_t next_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static int32_t ref_counts_to_mg(int16_t counts, int32_t scale_q8)
+{
+    double mg = floor(counts * (scale_q8 / 256.0) + 0.5);
+
+    return CLAMP(mg, INT16_MIN, INT16_MAX);
+}
+
+static void test_factor(void)
+{
+    zassert_equal(ACCEL_CONV_UMS2_TO_MG_Q32, 437965, NULL);
+    zassert_true(fabs(ACCEL_CONV_UMS2_TO_MG_Q32 - ldexp(1000.0, 32) / SENSOR_G) <= 0.5, NULL);
+}
+
+/* Every count of every range, negative ones rounded to nearest rather
+ * than floored by the shift */
+static void test_counts_rounding(void)
+{
+    for (uint8_t range = ADXL345_RANGE_2G; range <= ADXL345_RANGE_16G; range++) {
+        const int32_t scale_q8 = ACCEL_CONV_SCALE_Q8(range);
+
+        for (int32_t counts = -4096; counts < 4096; counts++) {
+            zassert_equal(accel_counts_to_mg(counts, scale_q8), ref_counts_to_mg(counts, scale_q8),
+                          "range %u, %d counts", range, counts);
+        }
+    }
+
+    /* 3.90625 mg/LSB: the shift alone takes -7 counts (-27.3 mg) to -28,
+     * and -16 counts are a tie at -62.5 mg */
+    zassert_equal(accel_counts_to_mg(-7, ACCEL_CONV_SCALE_Q8(0)), -27, NULL);
+    zassert_equal(accel_counts_to_mg(7, ACCEL_CONV_SCALE_Q8(0)), 27, NULL);
+    zassert_equal(accel_counts_to_mg(-16, ACCEL_CONV_SCALE_Q8(0)), -62, NULL);
+    zassert_equal(accel_counts_to_mg(16, ACCEL_CONV_SCALE_Q8(0)), 63, NULL);
+}
+
+static void test_counts_saturate(void)
+{
+    const int32_t scale_q8 = ACCEL_CONV_SCALE_Q8(ADXL345_RANGE_16G);
+
+    zassert_equal(accel_counts_to_mg(INT16_MAX, scale_q8), INT16_MAX, NULL);
+    zassert_equal(accel_counts_to_mg(INT16_MIN, scale_q8), INT16_MIN, NULL);
+    /* The last count in range at 16 g, 10-bit */
+    zassert_equal(accel_counts_to_mg(1023, scale_q8), ref_counts_to_mg(1023, scale_q8), NULL);
+}
+
+static void test_q15(void)
+{
+    zassert_equal(accel_counts_to_q15(-512, 10), INT16_MIN, NULL);
+    zassert_equal(accel_counts_to_q15(511, 10), 511 * 64, NULL);
+    zassert_equal(accel_counts_to_q15(-4096, 13), INT16_MIN, NULL);
+}
+
+/* Random readings over +-20 g against a double computation, including
+ * negative values with a negative val2 as sensor drivers report them */
+static void test_sensor_value(void)
+{
+    uint32_t state = 0x0ddba11;
+    int exact = 0;
+
+    for (int i = 0; i < TEST_VALUES; i++) {
+        int32_t micro = (int32_t)(next_rand(&state) % 400000001U) - 200000000;
+        const struct sensor_value val = {
+            .val1 = micro / 1000000,
+            .val2 = micro % 1000000,
+        };
+        double ref = micro * 1000.0 / SENSOR_G;
+        double frac = ref - floor(ref);
+        int16_t mg = accel_sensor_value_to_mg(&val);
+
+        if (fabs(frac - 0.5) > TIE_MARGIN_MG) {
+            zassert_equal(mg, (int32_t)floor(ref + 0.5), "%d um/s^2: %d mg, want %.3f",
+                          micro, mg, ref);
+            exact++;
+        } else {
+            zassert_within(mg, ref, 1, "%d um/s^2: %d mg, want %.3f", micro, mg, ref);
+        }
+    }
+    zassert_true(exact > TEST_VALUES * 9 / 10, NULL);
+
+    /* One g either way */
+    zassert_equal(accel_sensor_value_to_mg(&(struct sensor_value){ 9, 806650 }), 1000, NULL);
+    zassert_equal(accel_sensor_value_to_mg(&(struct sensor_value){ -9, -806650 }), -1000, NULL);
+}
+
+static void test_sensor_value_saturate(void)
+{
+    zassert_equal(accel_sensor_value_to_mg(&(struct sensor_value){ 2000, 0 }), INT16_MAX, NULL);
+    zassert_equal(accel_sensor_value_to_mg(&(struct sensor_value){ -2000, 0 }), INT16_MIN, NULL);
+}
+
+void test_main(void)
+{
+    ztest_test_suite(accel_conv,
+                     ztest_unit_test(test_factor),
+                     ztest_unit_test(test_counts_rounding),
+                     ztest_unit_test(test_counts_saturate),
+                     ztest_unit_test(test_q15),
+                     ztest_unit_test(test_sensor_value),
+                     ztest_unit_test(test_sensor_value_saturate));
+    ztest_run_test_suite(accel_conv);
+}
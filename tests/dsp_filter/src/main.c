@@ -0,0 +1,226 @@
+#include <ztest.h>
+#include <stdlib.h>
+#include "dsp_filter.h"
+
+#define TEST_ODR_MHZ        100000      /* 100 Hz */
+#define TEST_SAMPLES        1024
+/* Samples after which the 4th order sections have settled */
+#define SETTLE_SAMPLES      512
+#define TEST_PERIOD         100         /* cycles between input samples */
+
+SAMPLE_RING_DEFINE(test_ring, 256);
+
+static struct sample_record records[TEST_SAMPLES];
+
+static uint32_t next_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void configure(uint32_t lowpass_mhz, uint32_t highpass_mhz, uint8_t decimation_log2)
+{
+    const struct dsp_filter_config cfg = {
+        .lowpass_mhz = lowpass_mhz,
+        .highpass_mhz = highpass_mhz,
+        .decimation_log2 = decimation_log2,
+    };
+
+    zassert_equal(dsp_filter_configure(&cfg, TEST_ODR_MHZ), 0, NULL);
+}
+
+static void fill_dc(const struct adxl345_data *value, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        records[i].timestamp = i * TEST_PERIOD;
+        records[i].data = *value;
+    }
+}
+
+/* Runs records through the filter in uneven chunks, the way FIFO drains
+ * come in, and returns the number of outputs at the front of records */
+static size_t process_chunked(size_t count, uint32_t seed)
+{
+    size_t in = 0, out = 0;
+
+    while (in < count) {
+        size_t n = 1 + next_rand(&seed) % ADXL345_FIFO_DEPTH;
+        size_t m;
+
+        n = MIN(n, count - in);
+
+        memmove(&records[out], &records[in], n * sizeof(records[0]));
+        m = dsp_filter_process(&records[out], n);
+        zassert_true(m <= n, NULL);
+        in += n;
+        out += m;
+    }
+    return out;
+}
+
+static void test_check_config(void)
+{
+    struct dsp_filter_config cfg = DSP_FILTER_CONFIG_BYPASS;
+
+    zassert_equal(dsp_filter_check_config(&cfg, TEST_ODR_MHZ), 0, NULL);
+
+    cfg.lowpass_mhz = TEST_ODR_MHZ / 2;
+    zassert_equal(dsp_filter_check_config(&cfg, TEST_ODR_MHZ), -EINVAL, NULL);
+    cfg.lowpass_mhz = TEST_ODR_MHZ / DSP_FILTER_MIN_CUTOFF_DIV - 1;
+    zassert_equal(dsp_filter_check_config(&cfg, TEST_ODR_MHZ), -EINVAL, NULL);
+    cfg.lowpass_mhz = 0;
+    cfg.decimation_log2 = DSP_FILTER_MAX_DECIM_LOG2 + 1;
+    zassert_equal(dsp_filter_check_config(&cfg, TEST_ODR_MHZ), -EINVAL, NULL);
+}
+
+static void test_bypass_bit_exact(void)
+{
+    static struct sample_record want[TEST_SAMPLES];
+    uint32_t state = 0xfeedface;
+
+    for (size_t i = 0; i < ARRAY_SIZE(records); i++) {
+        records[i].timestamp = next_rand(&state);
+        records[i].data.x = (int16_t)next_rand(&state);
+        records[i].data.y = (int16_t)next_rand(&state);
+        records[i].data.z = (int16_t)next_rand(&state);
+    }
+    memcpy(want, records, sizeof(want));
+
+    configure(0, 0, 0);
+    zassert_equal(process_chunked(ARRAY_SIZE(records), 1), ARRAY_SIZE(records), NULL);
+    zassert_mem_equal(records, want, sizeof(want), NULL);
+    zassert_equal(dsp_filter_output_odr(ADXL345_ODR_100HZ), ADXL345_ODR_100HZ, NULL);
+}
+
+/* Largest distance from where a DC input should settle, over all three
+ * axes and the 13-bit range */
+static int dc_error(uint32_t lowpass_mhz, uint32_t highpass_mhz)
+{
+    int worst = 0;
+
+    for (int v = -4096; v < 4096; v += 7) {
+        const struct adxl345_data dc = { .x = v, .y = -v, .z = v / 2 };
+
+        configure(lowpass_mhz, highpass_mhz, 0);
+        fill_dc(&dc, TEST_SAMPLES);
+        zassert_equal(process_chunked(TEST_SAMPLES, v), TEST_SAMPLES, NULL);
+
+        for (size_t i = SETTLE_SAMPLES; i < TEST_SAMPLES; i++) {
+            const struct adxl345_data *want = highpass_mhz ? &(struct adxl345_data){ 0 } : &dc;
+
+            worst = MAX(worst, abs(records[i].data.x - want->x));
+            worst = MAX(worst, abs(records[i].data.y - want->y));
+            worst = MAX(worst, abs(records[i].data.z - want->z));
+        }
+    }
+    return worst;
+}
+
+static void test_lowpass_passes_dc(void)
+{
+    int error = dc_error(TEST_ODR_MHZ / 8, 0);
+
+    zassert_true(error <= 1, "DC off by %d", error);
+}
+
+static void test_highpass_rejects_dc(void)
+{
+    int error = dc_error(0, TEST_ODR_MHZ / 8);
+
+    zassert_true(error <= 1, "DC left at %d", error);
+}
+
+/* Truncation in the sections leaves a dead band around the DC level,
+ * widest at the lowest cutoff */
+static void test_min_cutoff_dead_band(void)
+{
+    const uint32_t cutoff = TEST_ODR_MHZ / DSP_FILTER_MIN_CUTOFF_DIV;
+    int error;
+
+    error = dc_error(cutoff, 0);
+    zassert_true(error <= DSP_FILTER_DC_DEAD_BAND_LP, "low-pass DC off by %d", error);
+    error = dc_error(0, cutoff);
+    zassert_true(error <= DSP_FILTER_DC_DEAD_BAND_HP, "high-pass DC left at %d", error);
+}
+
+/* Every factor keeps one in 2^n samples whatever the chunking, at unity
+ * DC gain */
+static void test_decimation_count(void)
+{
+    const struct adxl345_data dc = { .x = -700, .y = 0, .z = 2048 };
+
+    for (uint8_t log2 = 1; log2 <= DSP_FILTER_MAX_DECIM_LOG2; log2++) {
+        size_t n;
+
+        configure(0, 0, log2);
+        fill_dc(&dc, TEST_SAMPLES - 3);
+        n = process_chunked(TEST_SAMPLES - 3, log2);
+        zassert_equal(n, (TEST_SAMPLES - 3) >> log2, "factor %u", 1 << log2);
+        zassert_equal(dsp_filter_output_odr(ADXL345_ODR_100HZ), ADXL345_ODR_100HZ - log2, NULL);
+
+        for (size_t j = SETTLE_SAMPLES >> log2; j < n; j++) {
+            zassert_within(records[j].data.x, dc.x, 1, "factor %u, x[%u]", 1 << log2, j);
+            zassert_within(records[j].data.z, dc.z, 1, "factor %u, z[%u]", 1 << log2, j);
+        }
+    }
+}
+
+/* Through dsp_filter_put() outputs are stamped at the centre of their FIR
+ * window, so a step shows up half way at the time it happened */
+static void test_decimation_delay(void)
+{
+    static struct adxl345_data samples[TEST_SAMPLES];
+    struct sample_record out[TEST_SAMPLES / 4];
+    const struct sample_time time = {
+        .first = 5000,
+        .period = (uint64_t)TEST_PERIOD << 32,
+    };
+    const size_t step_at = 301;
+    const uint32_t step_time = time.first + step_at * TEST_PERIOD;
+    size_t n, half = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(samples); i++) {
+        samples[i].x = i < step_at ? 0 : 4000;
+    }
+
+    configure(0, 0, 2);
+    atomic_set(&test_ring.head, 0);
+    atomic_set(&test_ring.tail, 0);
+
+    n = dsp_filter_put(&test_ring, samples, 200, &time);
+    zassert_equal(n, 50, NULL);
+    zassert_equal(sample_ring_get(&test_ring, out, ARRAY_SIZE(out)), 50, NULL);
+    for (size_t j = 0; j < n; j++) {
+        /* The newest input of output j is 4j + 3, centred 31 / 2 back */
+        zassert_equal(out[j].timestamp, time.first + (4 * j + 3) * TEST_PERIOD - 31 * TEST_PERIOD / 2,
+                      "output %u at %u", j, out[j].timestamp);
+    }
+
+    /* The rest of the batch, across the step */
+    n = dsp_filter_put(&test_ring, &samples[200], 200,
+                       &(const struct sample_time){ sample_time_at(&time, 200), time.period });
+    zassert_equal(sample_ring_get(&test_ring, out, ARRAY_SIZE(out)), n, NULL);
+
+    while (half < n && out[half].data.x < 2000) {
+        half++;
+    }
+    zassert_true(half < n, "step never came through");
+    zassert_true(out[half].timestamp >= step_time - TEST_PERIOD &&
+                 out[half].timestamp < step_time + 4 * TEST_PERIOD,
+                 "step at %u, half way at %u", step_time, out[half].timestamp);
+}
+
+void test_main(void)
+{
+    ztest_test_suite(dsp_filter,
+                     ztest_unit_test(test_check_config),
+                     ztest_unit_test(test_bypass_bit_exact),
+                     ztest_unit_test(test_lowpass_passes_dc),
+                     ztest_unit_test(test_highpass_rejects_dc),
+                     ztest_unit_test(test_min_cutoff_dead_band),
+                     ztest_unit_test(test_decimation_count),
+                     ztest_unit_test(test_decimation_delay));
+    ztest_run_test_suite(dsp_filter);
+}
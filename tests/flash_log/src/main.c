@@ -0,0 +1,279 @@
+#include <ztest.h>
+#include <storage/flash_map.h>
+#include <sys/byteorder.h>
+#include "flash_log.h"
+#include "adxl345_frame.h"
+#include "accel_codec.h"
+#include "sample_clock.h"
+
+#define TEST_ODR            ADXL345_ODR_400HZ
+#define TEST_PERIOD         82          /* cycles between samples */
+#define TEST_CHUNK          25          /* samples per append, a FIFO drain */
+#define TEST_BUDGET         1000
+/* Download pieces, smaller than any block */
+#define TEST_PIECE          100
+#define TEST_TIMEOUT_MS     1000
+
+static struct sample_record records[FLASH_LOG_MAX_SECTORS * FLASH_LOG_BLOCKS_PER_SECTOR * UINT8_MAX];
+static uint8_t download[FLASH_LOG_MAX_SECTORS * FLASH_LOG_BLOCKS_PER_SECTOR * FLASH_LOG_BLOCK_MAX];
+static int16_t decoded[UINT8_MAX][3];
+
+/* Sample clock dependency, the rate codes of the real driver */
+uint32_t adxl345_odr_mhz(uint8_t odr)
+{
+    return 3200000U >> (ADXL345_ODR_3200HZ - (odr & BW_RATE_RATE_MASK));
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/* A random walk over the 13-bit range with steps large enough that
+ * blocks fill up by length rather than by sample count */
+static void fill_records(uint32_t seed)
+{
+    int16_t xyz[3] = { 30, -120, 256 };
+
+    for (size_t i = 0; i < ARRAY_SIZE(records); i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            xyz[axis] = CLAMP(xyz[axis] + (int)(next_rand(&seed) % 201) - 100, -4096, 4095);
+        }
+        records[i].timestamp = 1000 + i * TEST_PERIOD;
+        records[i].data.x = xyz[0];
+        records[i].data.y = xyz[1];
+        records[i].data.z = xyz[2];
+    }
+}
+
+/* Lets the writer thread catch up with the sealed blocks */
+static void wait_writer(void)
+{
+    struct flash_log_stats stats;
+    uint32_t blocks;
+    int64_t deadline = k_uptime_get() + TEST_TIMEOUT_MS;
+
+    flash_log_get_stats(&stats);
+    do {
+        blocks = stats.blocks_written;
+        k_sleep(K_MSEC(1));
+        flash_log_get_stats(&stats);
+    } while (stats.blocks_written != blocks && k_uptime_get() < deadline);
+}
+
+/* Appends records from first on in FIFO sized chunks, as long as capture
+ * keeps taking them, and returns how many it took */
+static size_t append_all(size_t first, size_t count)
+{
+    size_t done = 0;
+
+    while (done < count) {
+        size_t n = MIN(TEST_CHUNK, count - done);
+        size_t kept = flash_log_append(&records[first + done], n, TEST_ODR);
+
+        done += kept;
+        k_sleep(K_MSEC(1));
+        if (kept < n) {
+            break;
+        }
+    }
+    wait_writer();
+    return done;
+}
+
+static uint32_t storage_sectors(void)
+{
+    static struct flash_sector sectors[FLASH_LOG_MAX_SECTORS];
+    uint32_t count = ARRAY_SIZE(sectors);
+
+    zassert_equal(flash_area_get_sectors(FLASH_AREA_ID(storage), &count, sectors), 0, NULL);
+    return count;
+}
+
+/* Length of the codec block at p: a flags byte and count X/Y/Z varints */
+static size_t codec_block_len(const uint8_t *p, size_t avail, uint8_t count)
+{
+    size_t len = ACCEL_CODEC_BLOCK_HEADER_LEN;
+
+    for (size_t varints = 0; varints < 3U * count; varints++) {
+        while (len < avail && (p[len] & 0x80)) {
+            len++;
+        }
+        len++;
+    }
+    zassert_true(len <= avail, "block runs past the download");
+    return len;
+}
+
+/* Splits a download into its blocks and checks them against records from
+ * first on. Returns the number of samples it held. */
+static size_t check_download(const uint8_t *buf, size_t len, size_t first)
+{
+    size_t off = 0, samples = 0;
+    uint16_t seq = 0;
+
+    while (off < len) {
+        const struct adxl345_frame_header *hdr = (const void *)&buf[off];
+        struct accel_codec_dec dec;
+        size_t block_len;
+        int n;
+
+        zassert_true(len - off > sizeof(*hdr), NULL);
+        zassert_equal(hdr->format, ADXL345_FRAME_DELTA, NULL);
+        zassert_equal(hdr->odr, TEST_ODR, NULL);
+        zassert_equal(sys_le32_to_cpu(hdr->period), sample_clock_period_us_q8(TEST_ODR), NULL);
+        zassert_equal(sys_le32_to_cpu(hdr->timestamp),
+                      (uint32_t)sample_clock_to_us(records[first + samples].timestamp), NULL);
+        if (off > 0) {
+            zassert_equal(sys_le16_to_cpu(hdr->seq), (uint16_t)(seq + 1), NULL);
+        }
+        seq = sys_le16_to_cpu(hdr->seq);
+        off += sizeof(*hdr);
+
+        /* Each block decodes on its own */
+        block_len = codec_block_len(&buf[off], len - off, hdr->count);
+        zassert_true(sizeof(*hdr) + block_len <= flash_log_block_size(), NULL);
+        accel_codec_dec_init(&dec);
+        n = accel_codec_decode_block(&dec, &buf[off], block_len, false, decoded, ARRAY_SIZE(decoded));
+        zassert_equal(n, hdr->count, "block at %u", off);
+
+        for (int i = 0; i < n; i++) {
+            const struct adxl345_data *want = &records[first + samples + i].data;
+
+            zassert_equal(decoded[i][0], want->x, "sample %u", samples + i);
+            zassert_equal(decoded[i][1], want->y, "sample %u", samples + i);
+            zassert_equal(decoded[i][2], want->z, "sample %u", samples + i);
+        }
+        samples += n;
+        off += block_len;
+    }
+    return samples;
+}
+
+/* Downloads the whole backlog in pieces of at most piece bytes */
+static size_t download_all(size_t piece)
+{
+    size_t len = 0;
+    int n;
+
+    zassert_equal(flash_log_download_start(), 0, NULL);
+    do {
+        zassert_true(len + piece <= sizeof(download), NULL);
+        n = flash_log_download_next(&download[len], piece);
+        zassert_true(n >= 0, "err %d", n);
+        zassert_true(n <= piece, NULL);
+        len += n;
+    } while (n > 0);
+    return len;
+}
+
+static void test_init(void)
+{
+    fill_records(0x5eed5eed);
+    zassert_equal(flash_log_init(), 0, NULL);
+    zassert_true(flash_log_block_size() > TEST_PIECE, NULL);
+    zassert_true(flash_log_block_size() <= FLASH_LOG_BLOCK_MAX, NULL);
+    zassert_equal(flash_log_erase(), 0, NULL);
+}
+
+static void test_capture_off(void)
+{
+    struct flash_log_stats stats;
+
+    zassert_equal(flash_log_append(records, TEST_CHUNK, TEST_ODR), 0, NULL);
+    flash_log_get_stats(&stats);
+    zassert_equal(stats.capture_left, 0, NULL);
+}
+
+/* The budget is taken to the sample, then capture stops on its own and
+ * the download reproduces every sample of it */
+static void test_append_download_in_pieces(void)
+{
+    struct flash_log_stats before, after;
+    size_t len;
+
+    zassert_equal(flash_log_erase(), 0, NULL);
+    flash_log_get_stats(&before);
+
+    zassert_equal(flash_log_capture(TEST_BUDGET), 0, NULL);
+    zassert_equal(append_all(0, TEST_BUDGET + 3 * TEST_CHUNK), TEST_BUDGET, NULL);
+
+    flash_log_get_stats(&after);
+    zassert_equal(after.capture_left, 0, NULL);
+    zassert_equal(after.samples_dropped, before.samples_dropped, NULL);
+    zassert_equal(after.samples_logged - before.samples_logged, TEST_BUDGET, NULL);
+    zassert_true(after.blocks_written - before.blocks_written > 1, NULL);
+
+    len = download_all(TEST_PIECE);
+    flash_log_get_stats(&after);
+    zassert_equal(after.download_bytes, len, NULL);
+    zassert_equal(len, after.payload_bytes - before.payload_bytes, NULL);
+    zassert_equal(check_download(download, len, 0), TEST_BUDGET, NULL);
+
+    /* Drained, until the next start */
+    zassert_equal(flash_log_download_next(download, TEST_PIECE), 0, NULL);
+}
+
+/* Nothing is rotated out: the writer gets -ENOSPC past the last sector,
+ * stops the capture and refuses to arm again until an erase */
+static void test_full(void)
+{
+    const uint32_t blocks = storage_sectors() * FLASH_LOG_BLOCKS_PER_SECTOR;
+    struct flash_log_stats before, after;
+    size_t taken, len;
+
+    zassert_equal(flash_log_erase(), 0, NULL);
+    flash_log_get_stats(&before);
+
+    zassert_equal(flash_log_capture(FLASH_LOG_CAPTURE_UNTIL_FULL), 0, NULL);
+    taken = append_all(0, ARRAY_SIZE(records));
+    zassert_true(taken < ARRAY_SIZE(records), "log never filled up");
+
+    flash_log_get_stats(&after);
+    zassert_equal(after.capture_left, 0, NULL);
+    zassert_equal(after.blocks_written - before.blocks_written, blocks, NULL);
+    /* Lost are the block that didn't fit and the one being filled */
+    zassert_true(after.samples_dropped > before.samples_dropped, NULL);
+    zassert_equal(after.samples_logged - before.samples_logged +
+                  after.samples_dropped - before.samples_dropped, taken, NULL);
+
+    zassert_equal(flash_log_capture(FLASH_LOG_CAPTURE_UNTIL_FULL), -ENOSPC, NULL);
+    zassert_equal(flash_log_append(records, TEST_CHUNK, TEST_ODR), 0, NULL);
+
+    len = download_all(TEST_PIECE);
+    zassert_equal(check_download(download, len, 0), after.samples_logged - before.samples_logged, NULL);
+}
+
+static void test_erase(void)
+{
+    struct flash_log_stats before, after;
+    size_t len;
+
+    flash_log_get_stats(&before);
+    zassert_equal(flash_log_erase(), 0, NULL);
+    flash_log_get_stats(&after);
+    zassert_equal(after.sectors_erased - before.sectors_erased, storage_sectors(), NULL);
+
+    len = download_all(TEST_PIECE);
+    zassert_equal(len, 0, NULL);
+
+    /* Room again */
+    zassert_equal(flash_log_capture(TEST_CHUNK), 0, NULL);
+    zassert_equal(append_all(0, TEST_CHUNK), TEST_CHUNK, NULL);
+    len = download_all(TEST_PIECE);
+    zassert_equal(check_download(download, len, 0), TEST_CHUNK, NULL);
+}
+
+void test_main(void)
+{
+    ztest_test_suite(flash_log,
+                     ztest_unit_test(test_init),
+                     ztest_unit_test(test_capture_off),
+                     ztest_unit_test(test_append_download_in_pieces),
+                     ztest_unit_test(test_full),
+                     ztest_unit_test(test_erase));
+    ztest_run_test_suite(flash_log);
+}
@@ -0,0 +1,222 @@
+#include <ztest.h>
+#include <drivers/emul.h>
+#include <drivers/i2c_emul.h>
+#include <sys/byteorder.h>
+#include "i2c_bus.h"
+#include "adxl345.h"
+
+#define TEST_TXNS           4
+#define TEST_HOLD_MS        20
+#define TEST_TIMEOUT        K_MSEC(1000)
+#define TEST_SAMPLES        20
+/* Address byte, register and re-address bytes, six data bytes */
+#define TEST_BYTES_PER_SAMPLE   9
+
+static const struct device *bus = DEVICE_DT_GET(DT_NODELABEL(i2c0));
+
+/* An ADXL345 on the emulated bus: a write sets the register pointer, a
+ * read of DATAX0 pops the next sample of a known sequence. Every
+ * transfer is logged by the register it started with. */
+static struct {
+    struct i2c_emul emul;
+    uint8_t reg;
+    int16_t next;
+    uint32_t transfers;
+    uint32_t msgs;
+    uint32_t bytes;             // on the wire, one address byte per message
+    uint8_t order[TEST_TXNS];
+    size_t order_len;
+} target;
+
+static int target_transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs, int addr)
+{
+    ARG_UNUSED(emul);
+    ARG_UNUSED(addr);
+
+    target.transfers++;
+    if (target.order_len < ARRAY_SIZE(target.order) && !(msgs[0].flags & I2C_MSG_READ)) {
+        target.order[target.order_len++] = msgs[0].buf[0];
+    }
+
+    for (int i = 0; i < num_msgs; i++) {
+        struct i2c_msg *msg = &msgs[i];
+
+        target.msgs++;
+        target.bytes += 1 + msg->len;
+
+        if (!(msg->flags & I2C_MSG_READ)) {
+            target.reg = msg->buf[0];
+        } else if (target.reg == DATAX0 && msg->len == ADXL345_SAMPLE_SIZE) {
+            int16_t v = target.next++;
+
+            sys_put_le16(v, &msg->buf[0]);
+            sys_put_le16(-v, &msg->buf[2]);
+            sys_put_le16(v + 1000, &msg->buf[4]);
+        } else {
+            memset(msg->buf, 0, msg->len);
+        }
+    }
+    return 0;
+}
+
+static const struct i2c_emul_api target_api = {
+    .transfer = target_transfer,
+};
+
+static void reset_target(void)
+{
+    target.transfers = 0;
+    target.msgs = 0;
+    target.bytes = 0;
+    target.order_len = 0;
+}
+
+static void init_txn(struct i2c_bus_txn *txn, struct i2c_msg *msg, uint8_t *tag,
+                     enum i2c_bus_prio prio, struct k_poll_signal *done)
+{
+    msg->buf = tag;
+    msg->len = 1;
+    msg->flags = I2C_MSG_WRITE | I2C_MSG_STOP;
+
+    memset(txn, 0, sizeof(*txn));
+    txn->msgs = msg;
+    txn->num_msgs = 1;
+    txn->prio = prio;
+    txn->addr = ADXL345_ADDR;
+    txn->done = done;
+    k_poll_signal_init(done);
+}
+
+static void wait_done(struct k_poll_signal *done)
+{
+    struct k_poll_event event;
+    unsigned int signaled;
+    int result;
+
+    k_poll_event_init(&event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, done);
+    zassert_equal(k_poll(&event, 1, TEST_TIMEOUT), 0, "transfer never completed");
+    k_poll_signal_check(done, &signaled, &result);
+    zassert_equal(result, 0, NULL);
+}
+
+static void test_init(void)
+{
+    target.emul.api = &target_api;
+    target.emul.addr = ADXL345_ADDR;
+
+    zassert_true(device_is_ready(bus), NULL);
+    zassert_equal(i2c_emul_register(bus, "adxl345", &target.emul), 0, NULL);
+    zassert_equal(i2c_bus_init(bus), 0, NULL);
+    zassert_equal(i2c_bus_init(bus), -EALREADY, NULL);
+}
+
+/* A HIGH transfer queued behind LOW ones while the bus was taken goes
+ * out first, the LOW ones after it in submission order */
+static void test_priority_order(void)
+{
+    static const enum i2c_bus_prio prios[TEST_TXNS] = {
+        I2C_BUS_PRIO_LOW, I2C_BUS_PRIO_LOW, I2C_BUS_PRIO_LOW, I2C_BUS_PRIO_HIGH,
+    };
+    static const uint8_t want[TEST_TXNS] = { 0x13, 0x10, 0x11, 0x12 };
+    struct i2c_bus_txn txns[TEST_TXNS];
+    struct i2c_msg msgs[TEST_TXNS];
+    struct k_poll_signal done[TEST_TXNS];
+    uint8_t tags[TEST_TXNS];
+
+    reset_target();
+
+    i2c_bus_acquire(bus);
+    for (int i = 0; i < TEST_TXNS; i++) {
+        tags[i] = 0x10 + i;
+        init_txn(&txns[i], &msgs[i], &tags[i], prios[i], &done[i]);
+        zassert_equal(i2c_bus_submit(&txns[i]), 0, NULL);
+    }
+    /* The bus thread wakes up and waits for the lock */
+    k_sleep(K_MSEC(1));
+    zassert_equal(target.transfers, 0, NULL);
+    i2c_bus_release(bus);
+
+    for (int i = 0; i < TEST_TXNS; i++) {
+        wait_done(&done[i]);
+    }
+    zassert_equal(target.order_len, TEST_TXNS, NULL);
+    zassert_mem_equal(target.order, want, sizeof(want), NULL);
+}
+
+/* A holder keeps the bus thread off the bus for as long as it holds it,
+ * and the stats show the hold and the wait it caused */
+static void test_acquire_delays_bus(void)
+{
+    const uint32_t hold_cycles = k_ms_to_cyc_floor32(TEST_HOLD_MS);
+    struct i2c_bus_stats before, after;
+    struct i2c_bus_txn txn;
+    struct i2c_msg msg;
+    struct k_poll_signal done;
+    uint8_t tag = 0x20;
+    unsigned int signaled;
+    int result;
+
+    reset_target();
+    i2c_bus_get_stats(&before);
+
+    i2c_bus_acquire(bus);
+    init_txn(&txn, &msg, &tag, I2C_BUS_PRIO_HIGH, &done);
+    zassert_equal(i2c_bus_submit(&txn), 0, NULL);
+    k_sleep(K_MSEC(TEST_HOLD_MS));
+
+    k_poll_signal_check(&done, &signaled, &result);
+    zassert_false(signaled, "transfer ran while the bus was held");
+    zassert_equal(target.transfers, 0, NULL);
+    i2c_bus_release(bus);
+
+    wait_done(&done);
+    zassert_equal(target.transfers, 1, NULL);
+
+    i2c_bus_get_stats(&after);
+    zassert_equal(after.acquires, before.acquires + 1, NULL);
+    zassert_true(after.last_hold_cycles >= hold_cycles, "held %u cycles", after.last_hold_cycles);
+    zassert_true(after.max_hold_cycles >= after.last_hold_cycles, NULL);
+    zassert_equal(after.prio[I2C_BUS_PRIO_HIGH].transfers,
+                  before.prio[I2C_BUS_PRIO_HIGH].transfers + 1, NULL);
+    zassert_true(after.prio[I2C_BUS_PRIO_HIGH].last_wait_cycles >= hold_cycles,
+                 "waited %u cycles", after.prio[I2C_BUS_PRIO_HIGH].last_wait_cycles);
+}
+
+/* Burst reads go out ADXL345_READ_CHUNK samples per transfer, at
+ * TEST_BYTES_PER_SAMPLE bytes on the wire each */
+static void test_burst_read(void)
+{
+    struct adxl345_data samples[TEST_SAMPLES];
+
+    reset_target();
+    target.next = -5;
+
+    zassert_equal(adxl345_read_samples(bus, samples, TEST_SAMPLES), 0, NULL);
+    zassert_equal(target.transfers, DIV_ROUND_UP(TEST_SAMPLES, ADXL345_READ_CHUNK), NULL);
+    zassert_equal(target.msgs, 2 * TEST_SAMPLES, NULL);
+    zassert_equal(target.bytes, TEST_BYTES_PER_SAMPLE * TEST_SAMPLES, NULL);
+    /* With their ACK bits they fit the budget the ODR check assumes */
+    zassert_true(9 * target.bytes <= ADXL345_BUS_BITS_PER_SAMPLE * TEST_SAMPLES, NULL);
+
+    for (int i = 0; i < TEST_SAMPLES; i++) {
+        zassert_equal(samples[i].x, i - 5, "sample %d", i);
+        zassert_equal(samples[i].y, 5 - i, "sample %d", i);
+        zassert_equal(samples[i].z, i - 5 + 1000, "sample %d", i);
+    }
+
+    /* A single sample is one transfer as well */
+    reset_target();
+    zassert_equal(readXYZ(bus, samples), 0, NULL);
+    zassert_equal(target.transfers, 1, NULL);
+    zassert_equal(target.bytes, TEST_BYTES_PER_SAMPLE, NULL);
+}
+
+void test_main(void)
+{
+    ztest_test_suite(i2c_bus,
+                     ztest_unit_test(test_init),
+                     ztest_unit_test(test_priority_order),
+                     ztest_unit_test(test_acquire_delays_bus),
+                     ztest_unit_test(test_burst_read));
+    ztest_run_test_suite(i2c_bus);
+}
@@ -0,0 +1,246 @@
+#include <ztest.h>
+#include <sys/byteorder.h>
+#include "msg_proto.h"
+
+#define CMD_ECHO        0x01    /* 1..4 bytes, replied back */
+#define CMD_FAIL        0x02    /* replies with the negated value byte as errno */
+#define CMD_GAP         0x03    /* no handler */
+#define CMD_FIXED       0x04    /* exactly 2 bytes, replies the full MSG_REPLY_MAX */
+#define CMD_COUNT       5
+
+#define FUZZ_ROUNDS     20000
+#define FUZZ_MAX_LEN    64
+/* Every record of the longest write empty, or all but a broken last one */
+#define MAX_REPLIES     (FUZZ_MAX_LEN / MSG_HDR_LEN + 1)
+
+struct reply {
+    uint8_t data[MSG_REPLY_LEN_MAX];
+    uint16_t len;
+};
+
+static struct reply replies[MAX_REPLIES];
+static size_t reply_count;
+static size_t handler_calls;
+
+static int cmd_echo(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    handler_calls++;
+    memcpy(reply, value, len);
+    return len;
+}
+
+static int cmd_fail(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    handler_calls++;
+    return -(int)value[0];
+}
+
+static int cmd_fixed(const uint8_t *value, uint8_t len, uint8_t *reply, void *ctx)
+{
+    handler_calls++;
+    memset(reply, value[0], MSG_REPLY_MAX);
+    return MSG_REPLY_MAX;
+}
+
+static const struct msg_command commands[CMD_COUNT] = {
+    [CMD_ECHO] = { cmd_echo, 1, 4 },
+    [CMD_FAIL] = { cmd_fail, 1, 1 },
+    [CMD_FIXED] = { cmd_fixed, 2, 2 },
+};
+
+static void record_reply(const uint8_t *reply, uint16_t len, void *ctx)
+{
+    zassert_equal(ctx, &replies, "ctx not passed through");
+    zassert_true(len <= MSG_REPLY_LEN_MAX, "reply of %u bytes", len);
+    zassert_true(reply_count < MAX_REPLIES, "too many replies");
+
+    memcpy(replies[reply_count].data, reply, len);
+    replies[reply_count].len = len;
+    reply_count++;
+}
+
+static int dispatch(const uint8_t *data, size_t len)
+{
+    reply_count = 0;
+    handler_calls = 0;
+    return msg_dispatch(commands, ARRAY_SIZE(commands), data, len, record_reply, &replies);
+}
+
+static int16_t reply_status(const struct reply *r)
+{
+    return (int16_t)sys_get_le16(&r->data[MSG_HDR_LEN]);
+}
+
+static void check_reply(size_t idx, uint8_t type, int status, size_t value_len)
+{
+    const struct reply *r = &replies[idx];
+
+    zassert_true(idx < reply_count, "reply %u missing", idx);
+    zassert_equal(r->data[0], type | MSG_REPLY_FLAG, NULL);
+    zassert_equal(r->data[1], MSG_STATUS_LEN + value_len, NULL);
+    zassert_equal(r->len, MSG_HDR_LEN + MSG_STATUS_LEN + value_len, NULL);
+    zassert_equal(reply_status(r), status, "status %d, expected %d", reply_status(r), status);
+}
+
+static void test_empty_write(void)
+{
+    zassert_equal(dispatch(NULL, 0), 0, NULL);
+    zassert_equal(reply_count, 0, NULL);
+}
+
+static void test_records_in_one_write(void)
+{
+    const uint8_t data[] = {
+        CMD_ECHO, 3, 'a', 'b', 'c',
+        CMD_FIXED, 2, 0x5a, 0x00,
+        CMD_ECHO, 1, 'z',
+    };
+
+    zassert_equal(dispatch(data, sizeof(data)), 3, NULL);
+    zassert_equal(handler_calls, 3, NULL);
+
+    check_reply(0, CMD_ECHO, 0, 3);
+    zassert_mem_equal(&replies[0].data[MSG_HDR_LEN + MSG_STATUS_LEN], "abc", 3, NULL);
+    check_reply(1, CMD_FIXED, 0, MSG_REPLY_MAX);
+    zassert_equal(replies[1].data[MSG_REPLY_LEN_MAX - 1], 0x5a, NULL);
+    check_reply(2, CMD_ECHO, 0, 1);
+    zassert_equal(replies[2].data[MSG_HDR_LEN + MSG_STATUS_LEN], 'z', NULL);
+}
+
+static void test_unknown_type(void)
+{
+    const uint8_t data[] = {
+        CMD_GAP, 0,
+        CMD_COUNT, 1, 0xff,
+        0x7f, 0,
+    };
+
+    zassert_equal(dispatch(data, sizeof(data)), 3, NULL);
+    zassert_equal(handler_calls, 0, NULL);
+
+    /* ENOTSUP is 134 in Zephyr's libc, which a status byte turned into
+     * a positive +122 */
+    check_reply(0, CMD_GAP, -ENOTSUP, 0);
+    check_reply(1, CMD_COUNT, -ENOTSUP, 0);
+    check_reply(2, 0x7f, -ENOTSUP, 0);
+}
+
+static void test_length_bounds(void)
+{
+    const uint8_t data[] = {
+        CMD_ECHO, 0,
+        CMD_ECHO, 5, 1, 2, 3, 4, 5,
+        CMD_FIXED, 1, 0,
+        CMD_FIXED, 3, 0, 0, 0,
+    };
+
+    zassert_equal(dispatch(data, sizeof(data)), 4, NULL);
+    zassert_equal(handler_calls, 0, NULL);
+
+    check_reply(0, CMD_ECHO, -EINVAL, 0);
+    check_reply(1, CMD_ECHO, -EINVAL, 0);
+    check_reply(2, CMD_FIXED, -EINVAL, 0);
+    check_reply(3, CMD_FIXED, -EINVAL, 0);
+}
+
+static void test_handler_errors(void)
+{
+    const uint8_t data[] = {
+        CMD_FAIL, 1, ENOTSUP,
+        CMD_FAIL, 1, EINVAL,
+        CMD_FAIL, 1, 0,
+    };
+
+    zassert_equal(dispatch(data, sizeof(data)), 3, NULL);
+    zassert_equal(handler_calls, 3, NULL);
+
+    check_reply(0, CMD_FAIL, -ENOTSUP, 0);
+    check_reply(1, CMD_FAIL, -EINVAL, 0);
+    check_reply(2, CMD_FAIL, 0, 0);
+}
+
+static void test_truncated_record(void)
+{
+    const uint8_t lone_type[] = { CMD_ECHO };
+    const uint8_t short_value[] = { CMD_ECHO, 1, 'a', CMD_ECHO, 4, 'b', 'c' };
+
+    zassert_equal(dispatch(lone_type, sizeof(lone_type)), -EBADMSG, NULL);
+    zassert_equal(reply_count, 1, NULL);
+    check_reply(0, CMD_ECHO, -EBADMSG, 0);
+
+    /* Records before the broken one are still handled */
+    zassert_equal(dispatch(short_value, sizeof(short_value)), -EBADMSG, NULL);
+    zassert_equal(handler_calls, 1, NULL);
+    zassert_equal(reply_count, 2, NULL);
+    check_reply(0, CMD_ECHO, 0, 1);
+    check_reply(1, CMD_ECHO, -EBADMSG, 0);
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/* Random writes, biased towards the known types and short lengths so
+ * most of them parse a few records before going wrong */
+static void test_fuzz(void)
+{
+    uint8_t data[FUZZ_MAX_LEN];
+    uint32_t state = 0x1badb002;
+
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        size_t len = next_rand(&state) % (sizeof(data) + 1);
+        size_t pos = 0;
+        size_t records = 0;
+        bool broken = false;
+        int ret;
+
+        for (size_t i = 0; i < len; i++) {
+            uint32_t r = next_rand(&state);
+
+            data[i] = (r & 0x100) ? (uint8_t)r : (uint8_t)(r % (CMD_COUNT + 1));
+        }
+
+        /* Walk the records the way the dispatcher should */
+        while (pos < len) {
+            if (len - pos < MSG_HDR_LEN || len - pos - MSG_HDR_LEN < data[pos + 1]) {
+                broken = true;
+                break;
+            }
+            pos += MSG_HDR_LEN + data[pos + 1];
+            records++;
+        }
+
+        ret = dispatch(data, len);
+        if (broken) {
+            zassert_equal(ret, -EBADMSG, "round %d", round);
+            zassert_equal(reply_count, records + 1, "round %d", round);
+        } else {
+            zassert_equal(ret, records, "round %d", round);
+            zassert_equal(reply_count, records, "round %d", round);
+        }
+        zassert_true(handler_calls <= records, "round %d", round);
+
+        for (size_t i = 0; i < reply_count; i++) {
+            zassert_true(replies[i].data[0] & MSG_REPLY_FLAG, "round %d", round);
+            zassert_equal(replies[i].data[1] + MSG_HDR_LEN, replies[i].len, "round %d", round);
+            zassert_true(reply_status(&replies[i]) <= 0, "round %d", round);
+        }
+    }
+}
+
+void test_main(void)
+{
+    ztest_test_suite(msg_proto,
+                     ztest_unit_test(test_empty_write),
+                     ztest_unit_test(test_records_in_one_write),
+                     ztest_unit_test(test_unknown_type),
+                     ztest_unit_test(test_length_bounds),
+                     ztest_unit_test(test_handler_errors),
+                     ztest_unit_test(test_truncated_record),
+                     ztest_unit_test(test_fuzz));
+    ztest_run_test_suite(msg_proto);
+}
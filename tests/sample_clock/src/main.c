@@ -0,0 +1,231 @@
+#include <ztest.h>
+#include <stdlib.h>
+#include "sample_clock.h"
+#include "adxl345.h"
+
+#define TEST_ODR            ADXL345_ODR_100HZ
+#define TEST_WATERMARK      16
+#define TEST_DRIFT_PPM      (-2500)
+/* Measurements are averaged, so a few ppm of the edge jitter stay */
+#define TEST_DRIFT_TOL_PPM  10
+/* Rounds of TEST_WATERMARK samples, about 30 period measurements */
+#define TEST_ROUNDS         500
+#define SETTLE_ROUNDS       50
+
+/* An accelerometer whose oscillator is drift_ppm off its nominal rate.
+ * Sample k completes at t0 + k * period; the watermark edge that marks
+ * it is seen up to jitter cycles late. */
+struct accel_sim {
+    double t0;
+    double period;
+    uint32_t k;             // next sample to be drained
+    uint32_t jitter;
+    uint32_t state;
+};
+
+/* Sample clock dependency, the rate codes of the real driver */
+uint32_t adxl345_odr_mhz(uint8_t odr)
+{
+    return 3200000U >> (ADXL345_ODR_3200HZ - (odr & BW_RATE_RATE_MASK));
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static double nominal_cycles(uint8_t odr)
+{
+    return sys_clock_hw_cycles_per_sec() * 1000.0 / adxl345_odr_mhz(odr);
+}
+
+static void sim_init(struct accel_sim *sim, uint8_t odr, int32_t drift_ppm, double t0)
+{
+    sim->t0 = t0;
+    sim->period = nominal_cycles(odr) * (1.0 + drift_ppm / 1e6);
+    sim->k = 0;
+    /* 10 us of interrupt latency, at least a cycle */
+    sim->jitter = MAX(1U, sys_clock_hw_cycles_per_sec() / 100000U);
+    sim->state = 0x1234567;
+}
+
+/* k_cycle_get_32() value at which sample k completed */
+static uint32_t sim_cycles(const struct accel_sim *sim, uint32_t k)
+{
+    return (uint32_t)(uint64_t)(sim->t0 + k * sim->period);
+}
+
+/* One watermark interrupt and drain the way acquisition does it. Returns
+ * how far the first stamp is from the true time of its sample. */
+static int32_t sim_round(struct accel_sim *sim, struct sample_time *time)
+{
+    uint32_t newest = sim->k + TEST_WATERMARK - 1;
+    uint32_t edge = sim_cycles(sim, newest) + next_rand(&sim->state) % (sim->jitter + 1);
+    int32_t error;
+
+    sample_clock_anchor(edge, TEST_WATERMARK - 1);
+    sample_clock_stamp(TEST_WATERMARK, time);
+    error = (int32_t)(time->first - sim_cycles(sim, sim->k));
+    sim->k += TEST_WATERMARK;
+    return error;
+}
+
+/* Runs rounds and checks every stamp after the first settle ones */
+static void sim_run(struct accel_sim *sim, int rounds, int settle)
+{
+    const int32_t tol = 2 * sim->jitter + 2;
+    struct sample_time time;
+
+    for (int i = 0; i < rounds; i++) {
+        int32_t error = sim_round(sim, &time);
+
+        if (i >= settle) {
+            zassert_true(abs(error) <= tol, "round %d: stamp %d cycles off", i, error);
+            /* The last sample of the batch as well */
+            error = (int32_t)(sample_time_at(&time, TEST_WATERMARK - 1) -
+                              sim_cycles(sim, sim->k - 1));
+            zassert_true(abs(error) <= tol, "round %d: last stamp %d cycles off", i, error);
+        }
+    }
+}
+
+static void test_drift_converges(void)
+{
+    struct accel_sim sim;
+    struct sample_clock_stats before, after;
+
+    sample_clock_reset(TEST_ODR);
+    sample_clock_get_stats(&before);
+    sim_init(&sim, TEST_ODR, TEST_DRIFT_PPM, 1000);
+    sim_run(&sim, TEST_ROUNDS, SETTLE_ROUNDS);
+
+    sample_clock_get_stats(&after);
+    zassert_true(after.measurements - before.measurements >=
+                 TEST_ROUNDS * TEST_WATERMARK / SAMPLE_CLOCK_MIN_SPAN - 1, NULL);
+    zassert_within(after.drift_ppm, TEST_DRIFT_PPM, TEST_DRIFT_TOL_PPM,
+                   "drift %d ppm", after.drift_ppm);
+    zassert_equal(after.rejected, before.rejected, NULL);
+    zassert_equal(after.resyncs, before.resyncs + 1, NULL);
+}
+
+/* The cycle counter wraps a few rounds in; stamps, period measurements
+ * and the residual check all work on differences and carry on */
+static void test_cycle_wrap(void)
+{
+    struct accel_sim sim;
+    struct sample_clock_stats before, after;
+
+    sample_clock_reset(TEST_ODR);
+    sample_clock_get_stats(&before);
+    sim_init(&sim, TEST_ODR, TEST_DRIFT_PPM, 4294967296.0 - 10 * TEST_WATERMARK * nominal_cycles(TEST_ODR));
+    sim_run(&sim, TEST_ROUNDS, 0);
+
+    sample_clock_get_stats(&after);
+    zassert_true(sim_cycles(&sim, sim.k) < sim_cycles(&sim, 0), "never wrapped");
+    zassert_equal(after.rejected, before.rejected, NULL);
+    zassert_equal(after.resyncs, before.resyncs + 1, NULL);
+    zassert_true(after.measurements > before.measurements, NULL);
+    zassert_within(after.drift_ppm, TEST_DRIFT_PPM, TEST_DRIFT_TOL_PPM,
+                   "drift %d ppm", after.drift_ppm);
+}
+
+/* One edge far off the line is ignored; SAMPLE_CLOCK_MAX_REJECTS in a
+ * row, as after lost samples, restart the line from the latest */
+static void test_resync_after_rejects(void)
+{
+    struct accel_sim sim;
+    struct sample_clock_stats before, after;
+    struct sample_time time;
+
+    sample_clock_reset(TEST_ODR);
+    sim_init(&sim, TEST_ODR, TEST_DRIFT_PPM, 5000);
+    sim_run(&sim, SETTLE_ROUNDS, SETTLE_ROUNDS);
+    sample_clock_get_stats(&before);
+
+    /* A stale edge, and the next one is accepted again */
+    sample_clock_anchor(sim_cycles(&sim, sim.k) + 10 * (uint32_t)sim.period, TEST_WATERMARK - 1);
+    sample_clock_get_stats(&after);
+    zassert_equal(after.rejected, before.rejected + 1, NULL);
+    sim_run(&sim, 1, 0);
+    sample_clock_get_stats(&after);
+    zassert_equal(after.resyncs, before.resyncs, NULL);
+    zassert_equal(after.anchors, before.anchors + 1, NULL);
+
+    /* Samples lost where the clock couldn't see it, so every edge now
+     * comes in late */
+    sample_clock_get_stats(&before);
+    sim.k += 5 * SAMPLE_CLOCK_MAX_RESIDUAL;
+    for (int i = 0; i < SAMPLE_CLOCK_MAX_REJECTS - 1; i++) {
+        sim_round(&sim, &time);
+    }
+    sample_clock_get_stats(&after);
+    zassert_equal(after.rejected, before.rejected + SAMPLE_CLOCK_MAX_REJECTS - 1, NULL);
+    zassert_equal(after.resyncs, before.resyncs, NULL);
+
+    zassert_within(sim_round(&sim, &time), 0, sim.jitter + 1, NULL);
+    sample_clock_get_stats(&after);
+    zassert_equal(after.rejected, before.rejected + SAMPLE_CLOCK_MAX_REJECTS, NULL);
+    zassert_equal(after.resyncs, before.resyncs + 1, NULL);
+
+    /* Back on the line, the drift estimate unharmed */
+    sim_run(&sim, SETTLE_ROUNDS, 1);
+    sample_clock_get_stats(&after);
+    zassert_within(after.drift_ppm, TEST_DRIFT_PPM, TEST_DRIFT_TOL_PPM, NULL);
+}
+
+/* An ODR change keeps the measured period, scaled by the rate ratio, so
+ * the first stamps at the new rate already have the drift taken out */
+static void test_reset_carries_period(void)
+{
+    static const uint8_t odrs[] = {
+        ADXL345_ODR_400HZ, ADXL345_ODR_3200HZ, ADXL345_ODR_25HZ, TEST_ODR,
+    };
+    struct accel_sim sim;
+    struct sample_time time;
+    struct sample_clock_stats stats;
+    uint64_t period;
+    double t0 = 1e6;
+
+    sample_clock_reset(TEST_ODR);
+    sim_init(&sim, TEST_ODR, TEST_DRIFT_PPM, t0);
+    sim_run(&sim, TEST_ROUNDS, SETTLE_ROUNDS);
+    sim_round(&sim, &time);
+    period = time.period;
+
+    for (size_t i = 0; i < ARRAY_SIZE(odrs); i++) {
+        uint8_t odr = odrs[i];
+        uint64_t want = odr > TEST_ODR ? period >> (odr - TEST_ODR) : period << (TEST_ODR - odr);
+        uint32_t us_q8;
+        double want_us = nominal_cycles(odr) * (1.0 + TEST_DRIFT_PPM / 1e6) *
+                         USEC_PER_SEC / sys_clock_hw_cycles_per_sec();
+
+        t0 = sim_cycles(&sim, sim.k) + 1e5;
+        sample_clock_reset(odr);
+        sim_init(&sim, odr, TEST_DRIFT_PPM, t0);
+        us_q8 = sample_clock_period_us_q8(odr);
+
+        /* Before any new measurement */
+        sim_round(&sim, &time);
+        zassert_within(time.period >> 16, want >> 16, (want >> 16) / 100000,
+                       "ODR code %u", odr);
+        zassert_within(us_q8, want_us * 256, want_us * 256 / 100000 + 1,
+                       "ODR code %u: %u us/256", odr, us_q8);
+        sim_run(&sim, 2, 0);
+
+        sample_clock_get_stats(&stats);
+        zassert_within(stats.drift_ppm, TEST_DRIFT_PPM, TEST_DRIFT_TOL_PPM, NULL);
+    }
+}
+
+void test_main(void)
+{
+    ztest_test_suite(sample_clock,
+                     ztest_unit_test(test_drift_converges),
+                     ztest_unit_test(test_cycle_wrap),
+                     ztest_unit_test(test_resync_after_rejects),
+                     ztest_unit_test(test_reset_carries_period));
+    ztest_run_test_suite(sample_clock);
+}
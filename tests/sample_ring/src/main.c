@@ -0,0 +1,277 @@
+#include <ztest.h>
+#include "sample_ring.h"
+
+#define TEST_RING_CAPACITY  8
+
+/* Samples the stress case pushes through the ring */
+#define STRESS_SAMPLES      200000
+#define STRESS_STACK_SIZE   1024
+#define STRESS_MAX_BATCH    (ADXL345_FIFO_DEPTH)
+
+SAMPLE_RING_DEFINE(test_ring, TEST_RING_CAPACITY);
+SAMPLE_RING_DEFINE(stress_ring, SAMPLE_RING_CAPACITY);
+
+static K_THREAD_STACK_DEFINE(producer_stack, STRESS_STACK_SIZE);
+static struct k_thread producer_thread;
+
+/* Every sample carries its sequence number, so the consumer can check
+ * that nothing was lost, duplicated or reordered */
+static struct adxl345_data seq_sample(uint32_t seq)
+{
+    return (struct adxl345_data){
+        .x = (int16_t)seq,
+        .y = (int16_t)(seq >> 16),
+        .z = (int16_t)~seq,
+    };
+}
+
+static void check_record(const struct sample_record *rec, uint32_t seq)
+{
+    const struct adxl345_data want = seq_sample(seq);
+
+    zassert_equal(rec->timestamp, seq, "record %u out of order (got %u)", seq, rec->timestamp);
+    zassert_equal(rec->data.x, want.x, "record %u corrupt", seq);
+    zassert_equal(rec->data.y, want.y, "record %u corrupt", seq);
+    zassert_equal(rec->data.z, want.z, "record %u corrupt", seq);
+}
+
+/* Small xorshift for batch sizes and yield points, seeded per case so a
+ * failure reproduces */
+static uint32_t next_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void ring_reset(struct sample_ring *ring, uint32_t pos)
+{
+    atomic_set(&ring->head, (atomic_val_t)pos);
+    atomic_set(&ring->tail, (atomic_val_t)pos);
+    atomic_set(&ring->overruns, 0);
+}
+
+static size_t put_seq(struct sample_ring *ring, uint32_t first, size_t count)
+{
+    struct sample_record *records;
+    size_t done = 0;
+
+    while (done < count) {
+        /* MIN() evaluates its arguments twice */
+        size_t n = sample_ring_put_claim(ring, &records);
+
+        n = MIN(n, count - done);
+
+        if (n == 0) {
+            break;
+        }
+        for (size_t i = 0; i < n; i++) {
+            records[i].timestamp = first + done + i;
+            records[i].data = seq_sample(first + done + i);
+        }
+        sample_ring_put_finish(ring, n);
+        done += n;
+    }
+    return done;
+}
+
+static void test_empty(void)
+{
+    struct sample_record *records;
+    struct sample_record out;
+
+    ring_reset(&test_ring, 0);
+
+    zassert_equal(sample_ring_count(&test_ring), 0, NULL);
+    zassert_equal(sample_ring_get_claim(&test_ring, &records), 0, NULL);
+    zassert_equal(sample_ring_get(&test_ring, &out, 1), 0, NULL);
+    zassert_equal(sample_ring_put_claim(&test_ring, &records), TEST_RING_CAPACITY, NULL);
+}
+
+static void test_full(void)
+{
+    struct adxl345_data samples[TEST_RING_CAPACITY + 3] = {0};
+    struct sample_ring_stats stats;
+    struct sample_record *records;
+
+    ring_reset(&test_ring, 0);
+
+    /* The ring takes what fits and counts the rest */
+    zassert_equal(sample_ring_put(&test_ring, samples, ARRAY_SIZE(samples), 0),
+                  TEST_RING_CAPACITY, NULL);
+    zassert_equal(sample_ring_count(&test_ring), TEST_RING_CAPACITY, NULL);
+    zassert_equal(sample_ring_put_claim(&test_ring, &records), 0, NULL);
+    zassert_equal(sample_ring_put(&test_ring, samples, 1, 0), 0, NULL);
+
+    sample_ring_get_stats(&test_ring, &stats);
+    zassert_equal(stats.written, TEST_RING_CAPACITY, NULL);
+    zassert_equal(stats.read, 0, NULL);
+    zassert_equal(stats.overruns, 4, NULL);
+
+    /* One slot freed is one slot to write */
+    sample_ring_get_finish(&test_ring, 1);
+    zassert_equal(sample_ring_put_claim(&test_ring, &records), 1, NULL);
+}
+
+static void test_claims_stop_at_wrap(void)
+{
+    struct sample_record out[TEST_RING_CAPACITY];
+    struct sample_record *records;
+
+    ring_reset(&test_ring, 0);
+
+    zassert_equal(put_seq(&test_ring, 0, 6), 6, NULL);
+    zassert_equal(sample_ring_get(&test_ring, out, 5), 5, NULL);
+
+    /* Two slots to the end of the buffer, then five from the start */
+    zassert_equal(sample_ring_put_claim(&test_ring, &records), 2, NULL);
+    zassert_equal(records, &test_ring.buf[6], NULL);
+    zassert_equal(put_seq(&test_ring, 6, 7), 7, NULL);
+    zassert_equal(sample_ring_count(&test_ring), 8, NULL);
+
+    zassert_equal(sample_ring_get_claim(&test_ring, &records), 3, NULL);
+    zassert_equal(records, &test_ring.buf[5], NULL);
+
+    /* sample_ring_get() takes both runs in one call */
+    zassert_equal(sample_ring_get(&test_ring, out, ARRAY_SIZE(out)), 8, NULL);
+    for (uint32_t i = 0; i < 8; i++) {
+        check_record(&out[i], 5 + i);
+    }
+}
+
+static void test_partial_finish(void)
+{
+    struct sample_record *records;
+
+    ring_reset(&test_ring, 0);
+
+    /* Only the published part of a claim becomes visible */
+    zassert_equal(sample_ring_put_claim(&test_ring, &records), TEST_RING_CAPACITY, NULL);
+    records[0].timestamp = 0;
+    records[0].data = seq_sample(0);
+    sample_ring_put_finish(&test_ring, 1);
+    zassert_equal(sample_ring_count(&test_ring), 1, NULL);
+
+    /* and only the released part of a read claim is freed */
+    zassert_equal(put_seq(&test_ring, 1, 3), 3, NULL);
+    zassert_equal(sample_ring_get_claim(&test_ring, &records), 4, NULL);
+    sample_ring_get_finish(&test_ring, 2);
+    zassert_equal(sample_ring_get_claim(&test_ring, &records), 2, NULL);
+    check_record(&records[0], 2);
+}
+
+static void test_counter_wraparound(void)
+{
+    struct sample_record out[3];
+    uint32_t state = 1;
+    uint32_t written = 0, read = 0;
+    size_t n;
+
+    /* head and tail are free running, so their difference must survive
+     * the 32-bit wrap */
+    ring_reset(&test_ring, UINT32_MAX - 20);
+
+    while (read < 64) {
+        written += put_seq(&test_ring, written, next_rand(&state) % (TEST_RING_CAPACITY + 1));
+        zassert_true(sample_ring_count(&test_ring) <= TEST_RING_CAPACITY, NULL);
+
+        n = sample_ring_get(&test_ring, out, next_rand(&state) % (ARRAY_SIZE(out) + 1));
+        for (size_t i = 0; i < n; i++) {
+            check_record(&out[i], read++);
+        }
+        zassert_equal(sample_ring_count(&test_ring), written - read, NULL);
+    }
+
+    zassert_equal(sample_ring_write_pos(&test_ring), UINT32_MAX - 20 + written, NULL);
+    zassert_equal(sample_ring_read_pos(&test_ring), UINT32_MAX - 20 + read, NULL);
+}
+
+/* Publishes STRESS_SAMPLES sequence numbered samples in batches the size of
+ * FIFO drains, waiting whenever the ring is full */
+static void producer_fn(void *p1, void *p2, void *p3)
+{
+    uint32_t state = 0x2545f491;
+    uint32_t seq = 0;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (seq < STRESS_SAMPLES) {
+        size_t batch = 1 + next_rand(&state) % STRESS_MAX_BATCH;
+        size_t n;
+
+        batch = MIN(batch, STRESS_SAMPLES - seq);
+        n = put_seq(&stress_ring, seq, batch);
+
+        /* The consumer may run cooperatively, so always let it in while
+         * the ring is full */
+        seq += n;
+        if (n < batch || next_rand(&state) % 4 == 0) {
+            k_yield();
+        }
+    }
+}
+
+static void test_spsc_stress(void)
+{
+    struct sample_record out[STRESS_MAX_BATCH];
+    struct sample_record *records;
+    struct sample_ring_stats stats;
+    uint32_t state = 0x9e3779b9;
+    uint32_t seq = 0;
+    int64_t deadline;
+
+    ring_reset(&stress_ring, UINT32_MAX - SAMPLE_RING_CAPACITY / 2);
+
+    k_thread_create(&producer_thread, producer_stack, K_THREAD_STACK_SIZEOF(producer_stack),
+                    producer_fn, NULL, NULL, NULL,
+                    k_thread_priority_get(k_current_get()), 0, K_NO_WAIT);
+
+    deadline = k_uptime_get() + 60 * MSEC_PER_SEC;
+    while (seq < STRESS_SAMPLES) {
+        size_t max = 1 + next_rand(&state) % STRESS_MAX_BATCH;
+        size_t n;
+
+        /* Alternate between the two consumer paths */
+        if (next_rand(&state) & 1) {
+            n = sample_ring_get(&stress_ring, out, max);
+            for (size_t i = 0; i < n; i++) {
+                check_record(&out[i], seq++);
+            }
+        } else {
+            n = sample_ring_get_claim(&stress_ring, &records);
+            n = MIN(n, max);
+            for (size_t i = 0; i < n; i++) {
+                check_record(&records[i], seq++);
+            }
+            sample_ring_get_finish(&stress_ring, n);
+        }
+
+        zassert_true(sample_ring_count(&stress_ring) <= SAMPLE_RING_CAPACITY, NULL);
+        if (n == 0 || next_rand(&state) % 4 == 0) {
+            k_yield();
+        }
+        zassert_true(k_uptime_get() < deadline, "stalled at sample %u", seq);
+    }
+
+    k_thread_join(&producer_thread, K_FOREVER);
+
+    sample_ring_get_stats(&stress_ring, &stats);
+    zassert_equal(stats.written - stats.read, 0, NULL);
+    zassert_equal(stats.overruns, 0, NULL);
+    zassert_equal(sample_ring_count(&stress_ring), 0, NULL);
+}
+
+void test_main(void)
+{
+    ztest_test_suite(sample_ring,
+                     ztest_unit_test(test_empty),
+                     ztest_unit_test(test_full),
+                     ztest_unit_test(test_claims_stop_at_wrap),
+                     ztest_unit_test(test_partial_finish),
+                     ztest_unit_test(test_counter_wraparound),
+                     ztest_unit_test(test_spsc_stress));
+    ztest_run_test_suite(sample_ring);
+}
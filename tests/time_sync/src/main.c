@@ -0,0 +1,244 @@
+#include <ztest.h>
+#include <stdlib.h>
+#include "time_sync.h"
+
+/* Unix time in microseconds, late 2023 */
+#define HOST_EPOCH_US       INT64_C(1700000000000000)
+#define DEVICE_START_US     (5 * USEC_PER_SEC)
+#define PROCESSING_US       300
+#define EXCHANGE_PERIOD_US  (2 * USEC_PER_SEC)
+
+/* A host clock running skew_ppb fast against the device, and a link whose
+ * two directions each take a fixed time plus up to jitter_us more */
+struct link_sim {
+    int64_t offset_us;      // host minus device time at device time 0
+    int32_t skew_ppb;
+    uint32_t up_us;         // host to device
+    uint32_t down_us;
+    uint32_t jitter_us;
+    uint32_t state;
+};
+
+static uint32_t next_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static uint64_t host_at(const struct link_sim *sim, uint64_t device_us)
+{
+    return device_us + sim->offset_us + (int64_t)device_us * sim->skew_ppb / (int64_t)NSEC_PER_SEC;
+}
+
+static uint32_t link_delay(struct link_sim *sim, uint32_t fixed_us)
+{
+    return fixed_us + (sim->jitter_us ? next_rand(&sim->state) % (sim->jitter_us + 1) : 0);
+}
+
+/* One exchange with the host sending its request at device time device_us */
+static struct time_sync_exchange exchange_at(struct link_sim *sim, uint64_t device_us)
+{
+    struct time_sync_exchange x;
+
+    x.t1 = host_at(sim, device_us);
+    x.t2 = device_us + link_delay(sim, sim->up_us);
+    x.t3 = x.t2 + PROCESSING_US;
+    x.t4 = host_at(sim, x.t3 + link_delay(sim, sim->down_us));
+    return x;
+}
+
+static uint32_t exchange_delay(const struct time_sync_exchange *x)
+{
+    return (x->t4 - x->t1) - (x->t3 - x->t2);
+}
+
+/* Model minus true host time at a device time */
+static int64_t host_error(const struct link_sim *sim, uint64_t device_us)
+{
+    uint64_t host_us;
+
+    zassert_equal(time_sync_to_host(device_us, &host_us), 0, NULL);
+    return (int64_t)(host_us - host_at(sim, device_us));
+}
+
+static void test_unsynced(void)
+{
+    uint64_t host_us;
+
+    time_sync_reset();
+    zassert_equal(time_sync_to_host(DEVICE_START_US, &host_us), -EAGAIN, NULL);
+}
+
+static void test_symmetric_delay(void)
+{
+    struct link_sim sim = {
+        .offset_us = HOST_EPOCH_US,
+        .up_us = 10000,
+        .down_us = 10000,
+    };
+    struct time_sync_exchange x = exchange_at(&sim, DEVICE_START_US);
+    struct time_sync_model model;
+
+    time_sync_reset();
+    zassert_equal(time_sync_add(&x), 0, NULL);
+
+    time_sync_get_model(&model);
+    zassert_true(model.synced, NULL);
+    zassert_equal(model.delay_us, 20000, NULL);
+    zassert_equal(host_error(&sim, DEVICE_START_US), 0, NULL);
+    zassert_equal(host_error(&sim, DEVICE_START_US + 60 * USEC_PER_SEC), 0, NULL);
+}
+
+/* The offset is off by half the difference between the directions, which
+ * the round trip delay bounds */
+static void test_asymmetric_delay(void)
+{
+    struct link_sim sim = {
+        .offset_us = HOST_EPOCH_US,
+        .up_us = 30000,
+        .down_us = 7500,
+    };
+    struct time_sync_exchange x = exchange_at(&sim, DEVICE_START_US);
+    int64_t error;
+
+    time_sync_reset();
+    zassert_equal(time_sync_add(&x), 0, NULL);
+
+    error = host_error(&sim, DEVICE_START_US);
+    zassert_equal(error, -(30000 - 7500) / 2, "error %lld", error);
+    zassert_true(llabs(error) <= exchange_delay(&x) / 2, NULL);
+}
+
+/* Only the quickest of the last TIME_SYNC_FILTER_LEN exchanges counts */
+static void test_filter_takes_min_delay(void)
+{
+    struct link_sim sim = {
+        .offset_us = HOST_EPOCH_US,
+        .up_us = 2000,
+        .down_us = 2000,
+        .jitter_us = 45000,
+        .state = 0x12345678,
+    };
+    struct time_sync_model model;
+    uint32_t delays[TIME_SYNC_FILTER_LEN * 4];
+    uint64_t device_us = DEVICE_START_US;
+
+    time_sync_reset();
+
+    for (size_t i = 0; i < ARRAY_SIZE(delays); i++) {
+        struct time_sync_exchange x = exchange_at(&sim, device_us);
+        uint32_t best = UINT32_MAX;
+
+        delays[i] = exchange_delay(&x);
+        zassert_equal(time_sync_add(&x), 0, NULL);
+
+        for (size_t j = i + 1 - MIN(i + 1, TIME_SYNC_FILTER_LEN); j <= i; j++) {
+            best = MIN(best, delays[j]);
+        }
+        time_sync_get_model(&model);
+        zassert_equal(model.delay_us, best, "exchange %u", i);
+        zassert_true(llabs(host_error(&sim, model.ref_us)) <= best / 2, "exchange %u", i);
+
+        device_us += EXCHANGE_PERIOD_US;
+    }
+}
+
+/* Known skew, BLE-like delays that differ between the directions and
+ * vary by a few hundred microseconds. Half an hour of exchanges must pin
+ * the skew to a few ppm and keep predictions within the delay bound. */
+static void run_skew(int32_t skew_ppb, uint32_t seed)
+{
+    struct link_sim sim = {
+        .offset_us = HOST_EPOCH_US,
+        .skew_ppb = skew_ppb,
+        .up_us = 20000,
+        .down_us = 5000,
+        .jitter_us = 400,
+        .state = seed,
+    };
+    struct time_sync_model model;
+    struct time_sync_stats stats;
+    uint64_t device_us = DEVICE_START_US;
+    int64_t error, bound;
+
+    time_sync_reset();
+
+    for (int i = 0; i < 30 * 60 * USEC_PER_SEC / EXCHANGE_PERIOD_US; i++) {
+        struct time_sync_exchange x = exchange_at(&sim, device_us);
+
+        zassert_equal(time_sync_add(&x), 0, NULL);
+        device_us += EXCHANGE_PERIOD_US;
+    }
+
+    time_sync_get_model(&model);
+    time_sync_get_stats(&stats);
+    zassert_true(stats.skew_updates > 10, "%u skew updates", stats.skew_updates);
+    zassert_within(model.skew_ppb, skew_ppb, 5000, "skew %d ppb, expected %d",
+                   model.skew_ppb, skew_ppb);
+
+    /* A minute past the last exchange the prediction is still inside half
+     * the worst delay, plus what the skew error adds over that minute */
+    bound = (sim.up_us + sim.down_us + 2 * sim.jitter_us) / 2 + 60 * 5;
+    error = host_error(&sim, device_us + 60 * USEC_PER_SEC);
+    zassert_true(llabs(error) <= bound, "error %lld us", error);
+}
+
+static void test_skew_fast_host(void)
+{
+    run_skew(40000, 0xcafef00d);
+}
+
+static void test_skew_slow_host(void)
+{
+    run_skew(-25000, 0x600dd00d);
+}
+
+static void test_rejects(void)
+{
+    struct link_sim sim = {
+        .offset_us = HOST_EPOCH_US,
+        .up_us = 10000,
+        .down_us = 10000,
+    };
+    struct time_sync_exchange good = exchange_at(&sim, DEVICE_START_US);
+    struct time_sync_exchange x;
+    struct time_sync_model before, after;
+    struct time_sync_stats stats;
+    uint32_t rejected;
+
+    time_sync_reset();
+    zassert_equal(time_sync_add(&good), 0, NULL);
+    time_sync_get_model(&before);
+    time_sync_get_stats(&stats);
+    rejected = stats.rejected;
+
+    /* The reply came back before the device sent it */
+    x = exchange_at(&sim, DEVICE_START_US + EXCHANGE_PERIOD_US);
+    x.t4 = x.t1 + (x.t3 - x.t2) - 1;
+    zassert_equal(time_sync_add(&x), -EINVAL, NULL);
+
+    /* Too slow to be useful */
+    sim.down_us = TIME_SYNC_MAX_DELAY_US;
+    x = exchange_at(&sim, DEVICE_START_US + 2 * EXCHANGE_PERIOD_US);
+    zassert_equal(time_sync_add(&x), -EINVAL, NULL);
+
+    time_sync_get_model(&after);
+    time_sync_get_stats(&stats);
+    zassert_equal(stats.rejected, rejected + 2, NULL);
+    zassert_mem_equal(&after, &before, sizeof(before), NULL);
+}
+
+void test_main(void)
+{
+    ztest_test_suite(time_sync,
+                     ztest_unit_test(test_unsynced),
+                     ztest_unit_test(test_symmetric_delay),
+                     ztest_unit_test(test_asymmetric_delay),
+                     ztest_unit_test(test_filter_takes_min_delay),
+                     ztest_unit_test(test_skew_fast_host),
+                     ztest_unit_test(test_skew_slow_host),
+                     ztest_unit_test(test_rejects));
+    ztest_run_test_suite(time_sync);
+}